@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace bench {
+
+/*!
+ * Heap usage as seen by the global operator new/delete replacements of AllocTracker.cpp.
+ * Only linked in the benchmarks which include AllocTracker.cpp.
+ */
+struct AllocTracker {
+	//! Bytes currently allocated.
+	static size_t	getCurrentBytes();
+	//! Highest value reached by getCurrentBytes() since the last resetPeak().
+	static size_t	getPeakBytes();
+	//! Number of allocations since the program started.
+	static uint64_t	getNumAllocations();
+	static void		resetPeak();
+};
+
+} //end namespace bench
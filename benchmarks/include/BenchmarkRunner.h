@@ -0,0 +1,48 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+extern volatile char gSink;
+
+//! Keeps the compiler from optimizing away the benchmarked computations.
+template<typename T>
+inline void doNotOptimize( const T& value )
+{
+	gSink = *reinterpret_cast<const volatile char*>( &value );
+}
+
+struct Result {
+	std::string							mName;
+	std::map<std::string, double>		mParams;
+	size_t								mIterations;
+	double								mMinNs, mMedianNs, mMeanNs;
+};
+
+/*!
+ * Times a function over a number of samples (each sample running \a iterations calls) after
+ * a warm-up sample, and reports per-call timings in nanoseconds.
+ */
+class Runner {
+public:
+	Runner( size_t samples = 15, size_t iterations = 100 ) : mSamples( samples ), mIterations( iterations ) { }
+	
+	void	setSamples( size_t samples ) { mSamples = samples; }
+	void	setIterations( size_t iterations ) { mIterations = iterations; }
+	
+	const Result&	run( const std::string& name, const std::map<std::string, double>& params, const std::function<void()>& fn );
+	
+	const std::vector<Result>&	getResults() const { return mResults; }
+	void						writeJson( std::ostream& os ) const;
+private:
+	size_t				mSamples, mIterations;
+	std::vector<Result>	mResults;
+};
+
+} //end namespace bench
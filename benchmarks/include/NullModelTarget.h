@@ -0,0 +1,19 @@
+#pragma once
+
+#include "ModelIo.h"
+
+namespace model {
+
+//! Model target which discards everything but the skeleton, to measure the cost of a model source alone.
+class NullModelTarget : public ModelTarget {
+public:
+	virtual std::shared_ptr<Skeleton> getSkeleton() const override { return mSkeleton; }
+	
+	virtual void	loadVertexPositions( const std::vector<ci::Vec3f>& positions ) override { }
+	virtual void	loadIndices( const std::vector<uint32_t>& indices ) override { }
+	virtual void	loadSkeleton( const std::shared_ptr<Skeleton>& skeleton ) override { mSkeleton = skeleton; }
+private:
+	std::shared_ptr<Skeleton> mSkeleton;
+};
+
+} //end namespace model
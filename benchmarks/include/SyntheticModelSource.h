@@ -0,0 +1,65 @@
+#pragma once
+
+#include "ModelIo.h"
+
+namespace model {
+
+typedef std::shared_ptr< class SyntheticModelSource > SyntheticModelSourceRef;
+
+/*!
+ * Procedural skinned model used by the benchmarks. The rig is a spine of chain roots, each
+ * carrying a limb of CHAIN_LENGTH - 1 bones, so that the hierarchy depth grows like real rigs.
+ * Every bone is animated in every track with the same number of keys per channel, and every
+ * vertex is weighted by NB_WEIGHTS bones. Optionally, a share of the bones sit under a static
+ * helper node, as exported pivots do, and the section has morph targets, each moving a slice of
+ * the vertices, with weight curves in every track.
+ */
+class SyntheticModelSource : public ModelSource {
+public:
+	static const int CHAIN_LENGTH = 8;
+	
+	struct Format {
+		Format() : mNumBones( 64 ), mNumKeys( 30 ), mNumVertices( 5000 ), mNumTracks( 2 ), mHelperRatio( 0.0f ), mDuration( 1.0f ),
+			mNumMorphTargets( 0 ), mMorphCoverage( 0.1f ) { }
+		
+		Format& bones( int numBones ) { mNumBones = numBones; return *this; }
+		Format& keys( int numKeys ) { mNumKeys = numKeys; return *this; }
+		Format& vertices( int numVertices ) { mNumVertices = numVertices; return *this; }
+		Format& tracks( int numTracks ) { mNumTracks = numTracks; return *this; }
+		//! Number of static helper nodes per bone, between 0 and 1.
+		Format& helpers( float helperRatio ) { mHelperRatio = helperRatio; return *this; }
+		//! Number of morph targets, each moving a share \a coverage of the vertices. About half of them are active at any time.
+		Format& morphTargets( int numTargets, float coverage = 0.1f ) { mNumMorphTargets = numTargets; mMorphCoverage = coverage; return *this; }
+		
+		int		mNumBones, mNumKeys, mNumVertices, mNumTracks;
+		float	mHelperRatio;
+		float	mDuration;
+		int		mNumMorphTargets;
+		float	mMorphCoverage;
+	};
+	
+	static SyntheticModelSourceRef	create( const Format& format = Format() ) { return SyntheticModelSourceRef( new SyntheticModelSource( format ) ); }
+	
+	virtual size_t	getNumSections() const override { return 1; }
+	virtual size_t	getNumVertices( int section = 0 ) const override { return mFormat.mNumVertices; }
+	virtual size_t	getNumIndices( int section = 0 )  const override { return 3 * ( mFormat.mNumVertices / 3 ); }
+	virtual bool	hasNormals( int section = 0 ) const override { return true; }
+	virtual bool	hasSkeleton( int section = 0 ) const override { return true; }
+	virtual bool	hasMaterials( int section = 0 ) const override { return false; }
+	virtual bool	hasAnimations() const override { return true; }
+	
+	virtual void	load( ModelTarget *target ) override;
+	
+	const Format&	getFormat() const { return mFormat; }
+	
+	//! Build the synthetic skeleton only, with its bind pose offsets and animation curves.
+	std::shared_ptr<Skeleton>	createSkeleton() const;
+	//! Build the morph targets of the section and their weight curves, null without morph targets.
+	std::shared_ptr<MorphTargets>	createMorphTargets( const std::vector<ci::Vec3f>& normals ) const;
+protected:
+	SyntheticModelSource( const Format& format ) : mFormat( format ) { }
+private:
+	Format	mFormat;
+};
+
+} //end namespace model
@@ -0,0 +1,50 @@
+#include "AllocTracker.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace bench {
+
+namespace {
+	std::atomic<size_t>		sCurrentBytes( 0 );
+	std::atomic<size_t>		sPeakBytes( 0 );
+	std::atomic<uint64_t>	sNumAllocations( 0 );
+	
+	// The allocation size is stored in front of every block so that deletes can be accounted for.
+	const size_t HEADER_SIZE = alignof( std::max_align_t );
+	
+	void* trackedAlloc( size_t size )
+	{
+		void* block = std::malloc( size + HEADER_SIZE );
+		if( ! block )
+			throw std::bad_alloc();
+		*static_cast<size_t*>( block ) = size;
+		size_t current = sCurrentBytes += size;
+		size_t peak = sPeakBytes.load();
+		while( current > peak && ! sPeakBytes.compare_exchange_weak( peak, current ) ) { }
+		++sNumAllocations;
+		return static_cast<char*>( block ) + HEADER_SIZE;
+	}
+	
+	void trackedFree( void* ptr )
+	{
+		if( ! ptr )
+			return;
+		void* block = static_cast<char*>( ptr ) - HEADER_SIZE;
+		sCurrentBytes -= *static_cast<size_t*>( block );
+		std::free( block );
+	}
+}
+
+size_t AllocTracker::getCurrentBytes() { return sCurrentBytes; }
+size_t AllocTracker::getPeakBytes() { return sPeakBytes; }
+uint64_t AllocTracker::getNumAllocations() { return sNumAllocations; }
+void AllocTracker::resetPeak() { sPeakBytes = sCurrentBytes.load(); }
+
+} //end namespace bench
+
+void* operator new( size_t size ) { return bench::trackedAlloc( size ); }
+void* operator new[]( size_t size ) { return bench::trackedAlloc( size ); }
+void operator delete( void* ptr ) noexcept { bench::trackedFree( ptr ); }
+void operator delete[]( void* ptr ) noexcept { bench::trackedFree( ptr ); }
@@ -0,0 +1,249 @@
+/*
+ * Headless check that the per-frame update path does not touch the heap: the update logic of the
+ * samples (pose, blend, procedural edits, crowd with animation LOD and pose cache, morph targets, cpu skinning) runs
+ * on synthetic rigs, and every allocation made after the warm-up frames is counted through the global
+ * operator new replacement of AllocTracker.cpp. Results are written as JSON, and the exit code is 1
+ * when any scenario allocated, or when the paused character posed after a LOD change differs from
+ * a reference pose.
+ *
+ * Usage: AllocationCheck [--bones 92] [--vertices 1000] [--warmup 120] [--frames 600] [--output results.json]
+ */
+
+#include "AllocTracker.h"
+#include "SyntheticModelSource.h"
+
+#include "AnimLod.h"
+#include "BoneQuery.h"
+#include "PoseCache.h"
+#include "PoseEdit.h"
+#include "Skeleton.h"
+#include "SkinnedMesh.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+
+using namespace model;
+
+namespace {
+
+	struct Scenario {
+		std::string				mName;
+		std::function<void()>	mFrame;
+	};
+
+	struct CheckResult {
+		std::string		mName;
+		uint64_t		mAllocations;
+		int64_t			mRetainedBytes;
+	};
+
+	//! Sampling time of frame \a frame at 60 frames per second, looping over \a duration.
+	float getFrameTime( int frame, float duration )
+	{
+		float time = float( frame ) / 60.0f;
+		return time - duration * float( int( time / duration ) );
+	}
+
+	CheckResult runScenario( const Scenario& scenario, int warmupFrames, int frames )
+	{
+		for( int f = 0; f < warmupFrames; ++f ) {
+			scenario.mFrame();
+		}
+		CheckResult result;
+		result.mName = scenario.mName;
+		uint64_t allocations = bench::AllocTracker::getNumAllocations();
+		size_t bytes = bench::AllocTracker::getCurrentBytes();
+		for( int f = 0; f < frames; ++f ) {
+			scenario.mFrame();
+		}
+		result.mAllocations = bench::AllocTracker::getNumAllocations() - allocations;
+		result.mRetainedBytes = int64_t( bench::AllocTracker::getCurrentBytes() ) - int64_t( bytes );
+		return result;
+	}
+
+	void writeJson( std::ostream& os, const std::vector<CheckResult>& results, int warmupFrames, int frames )
+	{
+		os << "{" << std::endl;
+		os << "  \"warmup_frames\": " << warmupFrames << "," << std::endl;
+		os << "  \"frames\": " << frames << "," << std::endl;
+		os << "  \"scenarios\": [" << std::endl;
+		for( size_t r = 0; r < results.size(); ++r ) {
+			const CheckResult& result = results[r];
+			os << "    { \"name\": \"" << result.mName << "\", \"allocations\": " << result.mAllocations
+			   << ", \"retained_bytes\": " << result.mRetainedBytes << " }" << ( r + 1 < results.size() ? "," : "" ) << std::endl;
+		}
+		os << "  ]" << std::endl;
+		os << "}" << std::endl;
+	}
+}
+
+int main( int argc, char* argv[] )
+{
+	int bones = 92, vertices = 1000, warmupFrames = 120, frames = 600;
+	std::string output;
+
+	for( int i = 1; i < argc; ++i ) {
+		std::string arg = argv[i];
+		if( arg == "--bones" && i + 1 < argc ) {
+			bones = std::max( 2, std::atoi( argv[++i] ) );
+		} else if( arg == "--vertices" && i + 1 < argc ) {
+			vertices = std::max( 3, std::atoi( argv[++i] ) );
+		} else if( arg == "--warmup" && i + 1 < argc ) {
+			warmupFrames = std::max( 1, std::atoi( argv[++i] ) );
+		} else if( arg == "--frames" && i + 1 < argc ) {
+			frames = std::max( 1, std::atoi( argv[++i] ) );
+		} else if( arg == "--output" && i + 1 < argc ) {
+			output = argv[++i];
+		}
+	}
+
+	SyntheticModelSourceRef source = SyntheticModelSource::create( SyntheticModelSource::Format().bones( bones ).vertices( vertices ).tracks( 2 ) );
+	const float duration = source->getFormat().mDuration;
+	std::vector<Scenario> scenarios;
+
+	// SeymourDemo: one clip, posed and skinned every frame.
+	SkinnedMeshRef seymour = SkinnedMesh::create( source );
+	int seymourFrame = 0;
+	Scenario pose = { "setPose+update", [&] {
+		seymour->getSkeleton()->setPose( getFrameTime( seymourFrame++, duration ) );
+		seymour->update();
+	} };
+	scenarios.push_back( pose );
+
+	// MultipleAnimationsDemo: two clips blended.
+	SkinnedMeshRef blended = SkinnedMesh::create( source );
+	std::unordered_map<int, float> weights;
+	weights[0] = 0.5f;
+	weights[1] = 0.5f;
+	int blendFrame = 0;
+	Scenario blend = { "setBlendedPose+update", [&] {
+		blended->getSkeleton()->setBlendedPose( getFrameTime( blendFrame++, duration ), weights );
+		blended->update();
+	} };
+	scenarios.push_back( blend );
+
+	// ProceduralAnim: a few bones edited procedurally on top of the bind pose.
+	SkinnedMeshRef procedural = SkinnedMesh::create( source );
+	std::vector<NodeRef> editedBones;
+	for( const auto& entry : procedural->getSkeleton()->getBoneNames() ) {
+		if( editedBones.size() < 6 ) {
+			editedBones.push_back( entry.second );
+		}
+	}
+	PoseEdit poseEdit;
+	int editFrame = 0;
+	Scenario edit = { "PoseEdit::commit+update", [&] {
+		float angle = 0.01f * float( editFrame++ );
+		for( const NodeRef& bone : editedBones ) {
+			poseEdit.setRelativeRotation( bone, bone->getInitialRelativeRotation() * ci::Quatf( ci::Vec3f::xAxis(), angle ) );
+		}
+		poseEdit.commit();
+		procedural->update();
+	} };
+	scenarios.push_back( edit );
+
+	// ArmyDemo: a crowd sharing one skeleton, with animation and bone LOD, the pose cache and palette interpolation.
+	const int crowdSize = 64;
+	SkinnedMeshRef army = SkinnedMesh::create( source );
+	SkeletonRef armySkeleton = army->getSkeleton();
+	armySkeleton->generateLodBoneSets( { 0.5f, 0.2f } );
+	AnimLodScheduler scheduler;
+	std::vector<AnimLodState> lodStates( crowdSize );
+	PoseCache poseCache( 3 * crowdSize );
+	size_t nbBones = armySkeleton->getNumBones();
+	std::vector<ci::Matrix44f> boneMatrices( nbBones ), invTransposeMatrices( nbBones );
+	int armyFrame = 0;
+	Scenario crowd = { "crowd+PoseCache+AnimLod", [&] {
+		float time = getFrameTime( armyFrame++, duration );
+		scheduler.beginFrame();
+		for( int i = 0; i < crowdSize; ++i ) {
+			scheduler.submit( &lodStates[i], 10.0f * float( i ) );
+		}
+		scheduler.schedule();
+		for( int i = 0; i < crowdSize; ++i ) {
+			AnimLodState& lodState = lodStates[i];
+			if( lodState.needsUpdate() ) {
+				armySkeleton->setLod( std::min( i / 16, armySkeleton->getNumLods() - 1 ) );
+				poseCache.setPose( armySkeleton, time + duration * float( i % 8 ) / 8.0f );
+				armySkeleton->computeBonePalette( boneMatrices.data(), invTransposeMatrices.data(), nbBones );
+				lodState.storePalette( boneMatrices.data(), invTransposeMatrices.data(), nbBones );
+				army->update( lodState );
+			}
+			lodState.blendPalette( boneMatrices.data(), invTransposeMatrices.data(), nbBones );
+		}
+	} };
+	scenarios.push_back( crowd );
+
+	// A paused character switching bone LOD: bones rejoining the finer LOD must be posed again at the same time.
+	SkinnedMeshRef paused = SkinnedMesh::create( source );
+	SkeletonRef pausedSkeleton = paused->getSkeleton();
+	pausedSkeleton->generateLodBoneSets( { 0.2f } );
+	SkeletonRef reference = SkinnedMesh::create( source )->getSkeleton();
+	const float pausedTime = 0.3f * duration;
+	reference->setPose( pausedTime );
+	std::vector<NodeRef> pausedBones, referenceBones;
+	for( const auto& entry : pausedSkeleton->getBoneNames() ) {
+		pausedBones.push_back( entry.second );
+		referenceBones.push_back( reference->getBone( entry.first ) );
+	}
+	int pausedFrame = 0, mismatchedFrames = 0;
+	Scenario pausedLod = { "setLod+setPose(paused)", [&] {
+		int lod = ( pausedFrame++ % 2 ) ? 1 : 0;
+		pausedSkeleton->setLod( lod );
+		pausedSkeleton->setPose( pausedTime );
+		paused->update();
+		if( lod == 0 ) {
+			for( size_t b = 0; b < pausedBones.size(); ++b ) {
+				const ci::Quatf& rotation = pausedBones[b]->getRelativeRotation();
+				const ci::Quatf& expected = referenceBones[b]->getRelativeRotation();
+				if( rotation.w != expected.w || rotation.v != expected.v ) {
+					++mismatchedFrames;
+					break;
+				}
+			}
+		}
+	} };
+	scenarios.push_back( pausedLod );
+
+	// Facial rig: morph weights animated along with the bones, applied before skinning.
+	SyntheticModelSourceRef morphSource = SyntheticModelSource::create( SyntheticModelSource::Format().bones( bones ).vertices( vertices ).tracks( 2 ).morphTargets( 16 ) );
+	SkinnedMeshRef face = SkinnedMesh::create( morphSource );
+	int morphFrame = 0;
+	Scenario morph = { "setMorphPose+update", [&] {
+		float time = getFrameTime( morphFrame++, duration );
+		face->getSkeleton()->setPose( time );
+		face->setMorphPose( time );
+		face->update();
+	} };
+	scenarios.push_back( morph );
+
+	// Attachment points evaluated without posing the skeleton.
+	BoneQueryRef query = BoneQuery::create( editedBones );
+	std::vector<ci::Matrix44f> attachments( editedBones.size() );
+	int queryFrame = 0;
+	Scenario boneQuery = { "BoneQuery::evaluate", [&] {
+		query->evaluate( getFrameTime( queryFrame++, duration ), 0, attachments.data() );
+	} };
+	scenarios.push_back( boneQuery );
+
+	std::vector<CheckResult> results;
+	bool allocated = false;
+	for( const Scenario& scenario : scenarios ) {
+		results.push_back( runScenario( scenario, warmupFrames, frames ) );
+		allocated = allocated || results.back().mAllocations > 0;
+	}
+
+	if( output.empty() ) {
+		writeJson( std::cout, results, warmupFrames, frames );
+	} else {
+		std::ofstream file( output );
+		writeJson( file, results, warmupFrames, frames );
+	}
+	if( mismatchedFrames > 0 ) {
+		std::cerr << "setLod+setPose(paused): " << mismatchedFrames << " frames at LOD 0 differ from the reference pose" << std::endl;
+	}
+	return ( allocated || mismatchedFrames > 0 ) ? 1 : 0;
+}
@@ -0,0 +1,62 @@
+#include "BenchmarkRunner.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace bench {
+
+volatile char gSink;
+
+const Result& Runner::run( const std::string& name, const std::map<std::string, double>& params, const std::function<void()>& fn )
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	
+	// warm-up: fill the caches and let lazy initializations happen outside of the measurements
+	for( size_t i = 0; i < mIterations; ++i ) {
+		fn();
+	}
+	
+	std::vector<double> samples;
+	for( size_t s = 0; s < mSamples; ++s ) {
+		Clock::time_point start = Clock::now();
+		for( size_t i = 0; i < mIterations; ++i ) {
+			fn();
+		}
+		std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+		samples.push_back( elapsed.count() / double( mIterations ) );
+	}
+	std::sort( samples.begin(), samples.end() );
+	
+	Result result;
+	result.mName = name;
+	result.mParams = params;
+	result.mIterations = mIterations;
+	result.mMinNs = samples.front();
+	result.mMedianNs = samples[ samples.size() / 2 ];
+	result.mMeanNs = std::accumulate( samples.begin(), samples.end(), 0.0 ) / double( samples.size() );
+	mResults.push_back( result );
+	return mResults.back();
+}
+
+void Runner::writeJson( std::ostream& os ) const
+{
+	os << "{" << std::endl;
+	os << "  \"samples\": " << mSamples << "," << std::endl;
+	os << "  \"benchmarks\": [" << std::endl;
+	for( size_t r = 0; r < mResults.size(); ++r ) {
+		const Result& result = mResults[r];
+		os << "    { \"name\": \"" << result.mName << "\"";
+		for( const auto& param : result.mParams ) {
+			os << ", \"" << param.first << "\": " << param.second;
+		}
+		os << ", \"iterations\": " << result.mIterations
+		   << ", \"ns_per_op\": { \"min\": " << result.mMinNs
+		   << ", \"median\": " << result.mMedianNs
+		   << ", \"mean\": " << result.mMeanNs << " } }";
+		os << ( r + 1 < mResults.size() ? "," : "" ) << std::endl;
+	}
+	os << "  ]" << std::endl;
+	os << "}" << std::endl;
+}
+
+} //end namespace bench
@@ -0,0 +1,185 @@
+/*
+ * Headless load benchmark: runs ModelSourceAssimp over the sample assets with a null model
+ * target, and reports the time and peak heap memory of every loading phase as JSON.
+ * Textures are decoded but not uploaded, so no OpenGL context is needed.
+ *
+ * Usage: LoadBenchmark [--root path/to/Cinder-Skinning] [--runs 3] [--output results.json] [model files...]
+ */
+
+#include "AllocTracker.h"
+#include "NullModelTarget.h"
+
+#include "ModelSourceAssimp.h"
+#include "Skeleton.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+using namespace model;
+
+namespace {
+	
+	typedef std::chrono::high_resolution_clock Clock;
+	
+	double getMilliseconds( const Clock::time_point& start )
+	{
+		return std::chrono::duration<double, std::milli>( Clock::now() - start ).count();
+	}
+	
+	struct PhaseStats {
+		PhaseStats() : mCalls( 0 ), mMilliseconds( 0.0 ), mPeakBytes( 0 ) { }
+		int		mCalls;
+		double	mMilliseconds;
+		//! Highest heap growth reached during the phase (relative to the heap size when it began).
+		size_t	mPeakBytes;
+	};
+	
+	/*!
+	 * Accumulates the time and peak memory of each phase, by name. Phases reported by
+	 * ModelSourceAssimp are not nested.
+	 */
+	class PhaseProfiler : public LoadObserver {
+	public:
+		PhaseProfiler() : mPeakBytes( 0 ) { }
+		
+		virtual void beginPhase( const std::string& name ) override
+		{
+			mPeakBytes = std::max( mPeakBytes, bench::AllocTracker::getPeakBytes() );
+			bench::AllocTracker::resetPeak();
+			mStartBytes = bench::AllocTracker::getCurrentBytes();
+			mStart = Clock::now();
+		}
+		
+		virtual void endPhase( const std::string& name ) override
+		{
+			double ms = getMilliseconds( mStart );
+			size_t peak = bench::AllocTracker::getPeakBytes();
+			mPeakBytes = std::max( mPeakBytes, peak );
+			
+			if( mPhases.find( name ) == mPhases.end() ) {
+				mOrder.push_back( name );
+			}
+			PhaseStats& stats = mPhases[name];
+			stats.mCalls++;
+			stats.mMilliseconds += ms;
+			stats.mPeakBytes = std::max( stats.mPeakBytes, peak - std::min( peak, mStartBytes ) );
+		}
+		
+		size_t	getPeakBytes() const { return std::max( mPeakBytes, bench::AllocTracker::getPeakBytes() ); }
+		
+		std::vector<std::string>			mOrder;
+		std::map<std::string, PhaseStats>	mPhases;
+	private:
+		Clock::time_point	mStart;
+		size_t				mStartBytes, mPeakBytes;
+	};
+	
+	struct LoadResult {
+		std::string		mFile;
+		double			mMilliseconds;
+		size_t			mPeakBytes, mRetainedBytes;
+		PhaseProfiler	mProfiler;
+	};
+	
+	LoadResult loadOnce( const ci::fs::path& path )
+	{
+		LoadResult result;
+		result.mFile = path.filename().string();
+		size_t baseline = bench::AllocTracker::getCurrentBytes();
+		bench::AllocTracker::resetPeak();
+		
+		Clock::time_point start = Clock::now();
+		{
+			ModelSourceAssimpRef source = ModelSourceAssimp::create( path, "", &result.mProfiler );
+			source->setTextureUploadEnabled( false );
+			NullModelTarget target;
+			source->load( &target );
+			result.mMilliseconds = getMilliseconds( start );
+			// What stays alive with the model source and its skeleton
+			result.mRetainedBytes = bench::AllocTracker::getCurrentBytes() - baseline;
+		}
+		result.mPeakBytes = result.mProfiler.getPeakBytes() - baseline;
+		return result;
+	}
+	
+	void writeJson( std::ostream& os, const std::vector<LoadResult>& results, int runs )
+	{
+		os << "{" << std::endl;
+		os << "  \"runs\": " << runs << "," << std::endl;
+		os << "  \"assets\": [" << std::endl;
+		for( size_t r = 0; r < results.size(); ++r ) {
+			const LoadResult& result = results[r];
+			os << "    { \"file\": \"" << result.mFile << "\", \"ms\": " << result.mMilliseconds
+			   << ", \"peak_bytes\": " << result.mPeakBytes << ", \"retained_bytes\": " << result.mRetainedBytes
+			   << "," << std::endl << "      \"phases\": [" << std::endl;
+			const PhaseProfiler& profiler = result.mProfiler;
+			for( size_t p = 0; p < profiler.mOrder.size(); ++p ) {
+				const std::string& name = profiler.mOrder[p];
+				const PhaseStats& stats = profiler.mPhases.at( name );
+				os << "        { \"name\": \"" << name << "\", \"calls\": " << stats.mCalls
+				   << ", \"ms\": " << stats.mMilliseconds << ", \"peak_bytes\": " << stats.mPeakBytes << " }"
+				   << ( p + 1 < profiler.mOrder.size() ? "," : "" ) << std::endl;
+			}
+			os << "      ] }" << ( r + 1 < results.size() ? "," : "" ) << std::endl;
+		}
+		os << "  ]" << std::endl;
+		os << "}" << std::endl;
+	}
+}
+
+int main( int argc, char* argv[] )
+{
+	ci::fs::path root = ".";
+	int runs = 3;
+	std::string output;
+	std::vector<ci::fs::path> files;
+	
+	for( int i = 1; i < argc; ++i ) {
+		std::string arg = argv[i];
+		if( arg == "--root" && i + 1 < argc ) {
+			root = argv[++i];
+		} else if( arg == "--runs" && i + 1 < argc ) {
+			runs = std::max( 1, std::atoi( argv[++i] ) );
+		} else if( arg == "--output" && i + 1 < argc ) {
+			output = argv[++i];
+		} else {
+			files.push_back( arg );
+		}
+	}
+	
+	if( files.empty() ) {
+		files.push_back( root / "samples/SeymourDemo/assets/astroboy_walk.dae" );
+		files.push_back( root / "samples/ArmyDemo/assets/maggot3.md5mesh" );
+		files.push_back( root / "samples/MultipleAnimationsDemo/assets/Sinbad.mesh.xml" );
+		files.push_back( root / "samples/ProceduralAnim/assets/gannet rig2.DAE" );
+	}
+	
+	std::vector<LoadResult> results;
+	for( const ci::fs::path& file : files ) {
+		try {
+			// Keep the fastest run, the others mostly measure the file system cache warming up
+			LoadResult best = loadOnce( file );
+			for( int r = 1; r < runs; ++r ) {
+				LoadResult result = loadOnce( file );
+				if( result.mMilliseconds < best.mMilliseconds ) {
+					best = result;
+				}
+			}
+			results.push_back( best );
+		} catch( const ModelIoException& e ) {
+			std::cerr << file.string() << ": " << e.what() << std::endl;
+			return 1;
+		}
+	}
+	
+	if( output.empty() ) {
+		writeJson( std::cout, results, runs );
+	} else {
+		std::ofstream stream( output );
+		writeJson( stream, results, runs );
+	}
+	return 0;
+}
@@ -0,0 +1,280 @@
+/*
+ * Headless microbenchmarks of the animation and skinning core: curve sampling, pose
+ * evaluation, bone palette construction, morph targets and cpu skinning, on synthetic rigs.
+ * No window nor OpenGL context is created. Results are written as JSON.
+ *
+ * Usage: MicroBenchmarks [--bones 30,92,150] [--keys 10,60] [--vertices 1000,10000]
+ *                        [--samples 15] [--iterations 100] [--output results.json]
+ */
+
+#include "BenchmarkRunner.h"
+#include "SyntheticModelSource.h"
+
+#include "AnimTrack.h"
+#include "BoneQuery.h"
+#include "MorphTargets.h"
+#include "PoseCache.h"
+#include "PoseEdit.h"
+#include "Skeleton.h"
+#include "SkinnedMesh.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace model;
+
+namespace {
+	
+	std::vector<int> parseList( const std::string& arg )
+	{
+		std::vector<int> values;
+		std::stringstream ss( arg );
+		std::string item;
+		while( std::getline( ss, item, ',' ) ) {
+			values.push_back( std::atoi( item.c_str() ) );
+		}
+		return values;
+	}
+	
+	//! Advance the sampling time by an increment which does not fall on keyframes.
+	void advance( float* time, float duration )
+	{
+		*time += 0.0137f * duration;
+		if( *time > duration )
+			*time -= duration;
+	}
+	
+	void benchCurves( bench::Runner& runner, int numKeys )
+	{
+		const float duration = 1.0f;
+		std::shared_ptr<AnimTrack> track = AnimTrack::create( duration, 25.0f );
+		for( int k = 0; k < numKeys; ++k ) {
+			float time = duration * float( k ) / float( numKeys - 1 );
+			track->mTranslationCurve.addKeyframe( time, ci::Vec3f( float( k ), 0.0f, 0.0f ) );
+			track->mRotationCurve.addKeyframe( time, ci::Quatf( ci::Vec3f::yAxis(), 0.1f * k ) );
+		}
+		std::map<std::string, double> params = { { "keys", numKeys } };
+		
+		float time = 0.0f;
+		runner.run( "AnimCurve<Vec3f>::getValue", params, [&] {
+			bench::doNotOptimize( track->getTranslation( time ) );
+			advance( &time, duration );
+		} );
+		runner.run( "AnimCurve<Quatf>::getValue", params, [&] {
+			bench::doNotOptimize( track->getRotation( time ) );
+			advance( &time, duration );
+		} );
+	}
+	
+	void benchPoses( bench::Runner& runner, int numBones, int numKeys )
+	{
+		SyntheticModelSourceRef source = SyntheticModelSource::create( SyntheticModelSource::Format().bones( numBones ).keys( numKeys ) );
+		SkeletonRef skeleton = source->createSkeleton();
+		float duration = source->getFormat().mDuration;
+		std::map<std::string, double> params = { { "bones", numBones }, { "keys", numKeys } };
+		
+		float time = 0.0f;
+		runner.run( "Skeleton::setPose", params, [&] {
+			skeleton->setPose( time );
+			advance( &time, duration );
+		} );
+		
+		std::unordered_map<int, float> weights = { { 0, 0.5f }, { 1, 0.5f } };
+		runner.run( "Skeleton::setBlendedPose", params, [&] {
+			skeleton->setBlendedPose( time, weights );
+			advance( &time, duration );
+		} );
+		
+		// One leaf bone: its chain is as deep as the rig gets
+		BoneQueryRef query = BoneQuery::create( std::vector<NodeRef>( 1, skeleton->getBoneNames().rbegin()->second ) );
+		ci::Matrix44f transformation;
+		runner.run( "BoneQuery::evaluate", params, [&] {
+			query->evaluate( time, 0, &transformation );
+			bench::doNotOptimize( transformation );
+			advance( &time, duration );
+		} );
+		
+		// Procedural edits of a handful of bones spread over the rig, then a read of every bone as skinning does
+		std::vector<NodeRef> bones, editedBones;
+		for( const auto& kv : skeleton->getBoneNames() ) {
+			bones.push_back( kv.second );
+		}
+		for( size_t b = 0; b < bones.size(); b += std::max<size_t>( 1, bones.size() / 8 ) ) {
+			editedBones.push_back( bones[b] );
+		}
+		params["edited"] = double( editedBones.size() );
+		float angle = 0.0f;
+		runner.run( "Node::setRelativeRotation", params, [&] {
+			angle += 0.01f;
+			for( const NodeRef& bone : editedBones ) {
+				bone->setRelativeRotation( ci::Quatf( ci::Vec3f::yAxis(), angle ) );
+			}
+			for( const NodeRef& bone : bones ) {
+				bench::doNotOptimize( bone->getAbsoluteRotation() );
+			}
+		} );
+		PoseEdit edit;
+		runner.run( "PoseEdit::commit", params, [&] {
+			angle += 0.01f;
+			for( const NodeRef& bone : editedBones ) {
+				edit.setRelativeRotation( bone, ci::Quatf( ci::Vec3f::yAxis(), angle ) );
+			}
+			edit.commit();
+			for( const NodeRef& bone : bones ) {
+				bench::doNotOptimize( bone->getAbsoluteRotation() );
+			}
+		} );
+		params.erase( "edited" );
+		
+		// Half as many static helper nodes as bones, as in typical FBX and collada exports
+		SkeletonRef helperSkeleton = SyntheticModelSource::create( SyntheticModelSource::Format().bones( numBones ).keys( numKeys ).helpers( 0.5f ) )->createSkeleton();
+		params["nodes"] = double( helperSkeleton->getNumNodes() );
+		runner.run( "Skeleton::setPose(helpers)", params, [&] {
+			helperSkeleton->setPose( time );
+			advance( &time, duration );
+		} );
+		helperSkeleton->collapseStaticNodes();
+		params["nodes"] = double( helperSkeleton->getNumNodes() );
+		runner.run( "Skeleton::setPose(collapsed helpers)", params, [&] {
+			helperSkeleton->setPose( time );
+			advance( &time, duration );
+		} );
+		params.erase( "nodes" );
+		
+		// A crowd sharing one skeleton, spread over a few phases of the clip: pose and palette of every instance
+		const int numInstances = 64, numPhases = 8;
+		std::vector<ci::Matrix44f> palette( numBones );
+		params["instances"] = numInstances;
+		params["phases"] = numPhases;
+		runner.run( "Skeleton::setPose(crowd)", params, [&] {
+			for( int i = 0; i < numInstances; ++i ) {
+				skeleton->setPose( time + duration * float( i % numPhases ) / numPhases );
+				skeleton->computeBonePalette( palette.data(), nullptr, palette.size() );
+			}
+			bench::doNotOptimize( palette.back() );
+			advance( &time, duration );
+		} );
+		PoseCache cache( 2 * numPhases );
+		runner.run( "PoseCache::setPose(crowd)", params, [&] {
+			for( int i = 0; i < numInstances; ++i ) {
+				cache.setPose( skeleton, time + duration * float( i % numPhases ) / numPhases );
+				skeleton->computeBonePalette( palette.data(), nullptr, palette.size() );
+			}
+			bench::doNotOptimize( palette.back() );
+			advance( &time, duration );
+		} );
+		params.erase( "instances" );
+		params.erase( "phases" );
+		skeleton->setSharedPalette( nullptr );
+		
+		std::vector<ci::Matrix44f> boneMatrices( numBones ), invTransposeMatrices( numBones );
+		skeleton->setPose( 0.5f * duration );
+		runner.run( "Skeleton::computeBonePalette", params, [&] {
+			skeleton->computeBonePalette( boneMatrices.data(), invTransposeMatrices.data(), boneMatrices.size() );
+			bench::doNotOptimize( boneMatrices.back() );
+		} );
+	}
+	
+	void benchSkinning( bench::Runner& runner, int numBones, int numVertices )
+	{
+		SyntheticModelSourceRef source = SyntheticModelSource::create( SyntheticModelSource::Format().bones( numBones ).vertices( numVertices ) );
+		SkinnedMeshRef mesh = SkinnedMesh::create( source );
+		mesh->getSkeleton()->setPose( 0.5f * source->getFormat().mDuration );
+		std::map<std::string, double> params = { { "bones", numBones }, { "vertices", numVertices } };
+		
+		const NodeRef& root = mesh->getSkeleton()->getRootNode();
+		runner.run( "SkinnedMesh::update", params, [&] {
+			// A new pose version, so that the mesh is skinned every time
+			root->touchPose();
+			mesh->update();
+		} );
+		runner.run( "SkinnedMesh::update(unchanged pose)", params, [&] {
+			mesh->update();
+		} );
+	}
+	
+	void benchMorphs( bench::Runner& runner, int numBones, int numVertices )
+	{
+		// A facial rig: many targets, each moving a small share of the vertices.
+		const int numTargets = 32;
+		SyntheticModelSourceRef source = SyntheticModelSource::create( SyntheticModelSource::Format().bones( numBones ).vertices( numVertices ).morphTargets( numTargets, 0.05f ) );
+		SkinnedMeshRef mesh = SkinnedMesh::create( source );
+		const float duration = source->getFormat().mDuration;
+		mesh->getSkeleton()->setPose( 0.5f * duration );
+		std::map<std::string, double> params = { { "bones", numBones }, { "vertices", numVertices }, { "targets", numTargets } };
+		
+		const MorphTargetsRef& morphTargets = mesh->getSections().front()->getMorphTargets();
+		std::vector<ci::Vec3f> positions( numVertices ), normals( numVertices );
+		float time = 0.0f;
+		runner.run( "MorphTargets::apply", params, [&] {
+			advance( &time, duration );
+			morphTargets->animate( time );
+			const SkinnedMesh::MeshSectionRef& section = mesh->getSections().front();
+			morphTargets->apply( section->mInitialPositions.data(), section->mInitialNormals.data(), positions.data(), normals.data(), positions.size() );
+			bench::doNotOptimize( positions.back() );
+		} );
+		
+		const NodeRef& root = mesh->getSkeleton()->getRootNode();
+		runner.run( "SkinnedMesh::update(morphs)", params, [&] {
+			advance( &time, duration );
+			mesh->setMorphPose( time );
+			root->touchPose();
+			mesh->update();
+		} );
+	}
+}
+
+int main( int argc, char* argv[] )
+{
+	std::vector<int> bones = { 30, 92, 150 };
+	std::vector<int> keys = { 10, 60 };
+	std::vector<int> vertices = { 1000, 10000 };
+	size_t samples = 15, iterations = 100;
+	std::string output;
+	
+	for( int i = 1; i + 1 < argc; i += 2 ) {
+		std::string arg = argv[i];
+		std::string value = argv[i + 1];
+		if( arg == "--bones" ) {
+			bones = parseList( value );
+		} else if( arg == "--keys" ) {
+			keys = parseList( value );
+		} else if( arg == "--vertices" ) {
+			vertices = parseList( value );
+		} else if( arg == "--samples" ) {
+			samples = std::atoi( value.c_str() );
+		} else if( arg == "--iterations" ) {
+			iterations = std::atoi( value.c_str() );
+		} else if( arg == "--output" ) {
+			output = value;
+		} else {
+			std::cerr << "unknown argument " << arg << std::endl;
+			return 1;
+		}
+	}
+	
+	bench::Runner runner( samples, iterations );
+	for( int k : keys ) {
+		benchCurves( runner, std::max( k, 2 ) );
+	}
+	for( int b : bones ) {
+		for( int k : keys ) {
+			benchPoses( runner, b, std::max( k, 2 ) );
+		}
+		for( int v : vertices ) {
+			benchSkinning( runner, b, v );
+			benchMorphs( runner, b, v );
+		}
+	}
+	
+	if( output.empty() ) {
+		runner.writeJson( std::cout );
+	} else {
+		std::ofstream file( output );
+		runner.writeJson( file );
+	}
+	return 0;
+}
@@ -0,0 +1,140 @@
+/*
+ * Headless check of the draw ordering of the render queue (RenderOrder): the sort key orders the draws
+ * by program, then texture, material and cull mode, draws with equal states keep their submission
+ * order, and the number of state changes of a known submission sequence is the expected one. Results
+ * are written as JSON, and the exit code is 1 when any case fails.
+ *
+ * Usage: RenderQueueCheck [--output results.json]
+ */
+
+#include "RenderState.h"
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace model;
+
+namespace {
+
+	struct CheckResult {
+		std::string		mName;
+		bool			mPassed;
+	};
+
+	RenderState makeState( uint32_t features, uint32_t texture, uint32_t material, bool cullFace )
+	{
+		RenderState state;
+		state.mFeatures = features;
+		state.mTexture = texture;
+		state.mMaterial = material;
+		state.mCullFace = cullFace;
+		return state;
+	}
+
+	//! Each state component outweighs every lower order one, whatever their values.
+	bool checkKeyOrder()
+	{
+		bool passed = true;
+		passed &= makeState( 1, 0xffffff, 0x7fffff, true ).getSortKey() < makeState( 2, 0, 0, false ).getSortKey();
+		passed &= makeState( 1, 1, 0x7fffff, true ).getSortKey() < makeState( 1, 2, 0, false ).getSortKey();
+		passed &= makeState( 1, 1, 1, true ).getSortKey() < makeState( 1, 1, 2, false ).getSortKey();
+		passed &= makeState( 1, 1, 1, false ).getSortKey() < makeState( 1, 1, 1, true ).getSortKey();
+		passed &= makeState( 3, 2, 1, true ).getSortKey() == makeState( 3, 2, 1, true ).getSortKey();
+		return passed;
+	}
+
+	//! Interleaved submissions of two states come out grouped, each group in submission order.
+	bool checkStableGrouping()
+	{
+		RenderOrder order;
+		for( int i = 0; i < 8; ++i ) {
+			order.add( ( i % 2 ) ? makeState( 1, 1, 1, true ) : makeState( 2, 1, 1, true ) );
+		}
+		order.sort();
+		const uint32_t expected[] = { 1, 3, 5, 7, 0, 2, 4, 6 };
+		bool passed = order.size() == 8;
+		for( size_t i = 0; passed && i < order.size(); ++i ) {
+			passed &= order.getSortedIndex( i ) == expected[i];
+		}
+		return passed;
+	}
+
+	/*!
+	 * Submission sequence of two instances of a mesh with two sections (A: program 1, texture 1,
+	 * material 1, culled; B: program 1, texture 2, material 2, two sided) and a static prop (program 2,
+	 * no texture, material 1, culled). Sorted: A A B B prop, that is the 4 states of the first draw,
+	 * then texture, material and cull mode for B, then the 4 states again for the prop.
+	 */
+	bool checkStateChanges()
+	{
+		RenderState a = makeState( 1, 1, 1, true ), b = makeState( 1, 2, 2, false ), prop = makeState( 2, 0, 1, true );
+		RenderOrder order;
+		order.add( a );
+		order.add( b );
+		order.add( prop );
+		order.add( a );
+		order.add( b );
+		order.sort();
+
+		bool passed = order.getNumStateChanges() == 4 + 3 + 4;
+		passed &= getStateChanges( nullptr, a ) == CHANGE_ALL;
+		passed &= getStateChanges( &a, a ) == 0;
+		passed &= getStateChanges( &a, b ) == ( CHANGE_TEXTURE | CHANGE_MATERIAL | CHANGE_CULL_FACE );
+		passed &= getStateChanges( &b, prop ) == ( CHANGE_PROGRAM | CHANGE_TEXTURE | CHANGE_MATERIAL | CHANGE_CULL_FACE );
+		passed &= countStateChanges( CHANGE_ALL ) == 4;
+
+		// Clearing keeps nothing of the previous frame.
+		order.clear();
+		order.add( prop );
+		order.sort();
+		passed &= order.size() == 1 && order.getNumStateChanges() == 4;
+		return passed;
+	}
+
+	void writeJson( std::ostream& os, const std::vector<CheckResult>& results )
+	{
+		os << "{" << std::endl;
+		os << "  \"cases\": [" << std::endl;
+		for( size_t r = 0; r < results.size(); ++r ) {
+			const CheckResult& result = results[r];
+			os << "    { \"name\": \"" << result.mName << "\", \"passed\": " << ( result.mPassed ? "true" : "false" )
+			   << " }" << ( r + 1 < results.size() ? "," : "" ) << std::endl;
+		}
+		os << "  ]" << std::endl;
+		os << "}" << std::endl;
+	}
+}
+
+int main( int argc, char* argv[] )
+{
+	std::string output;
+
+	for( int i = 1; i < argc; ++i ) {
+		std::string arg = argv[i];
+		if( arg == "--output" && i + 1 < argc ) {
+			output = argv[++i];
+		}
+	}
+
+	std::vector<CheckResult> results;
+	CheckResult keyOrder = { "sort key order", checkKeyOrder() };
+	results.push_back( keyOrder );
+	CheckResult grouping = { "stable grouping", checkStableGrouping() };
+	results.push_back( grouping );
+	CheckResult stateChanges = { "state change count", checkStateChanges() };
+	results.push_back( stateChanges );
+
+	bool passed = true;
+	for( const CheckResult& result : results ) {
+		passed &= result.mPassed;
+	}
+
+	writeJson( std::cout, results );
+	if( ! output.empty() ) {
+		std::ofstream file( output.c_str() );
+		writeJson( file, results );
+	}
+	return passed ? 0 : 1;
+}
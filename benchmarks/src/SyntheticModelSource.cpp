@@ -0,0 +1,184 @@
+#include "SyntheticModelSource.h"
+
+#include "MorphTargets.h"
+#include "Skeleton.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace model {
+
+namespace {
+	std::string getBoneName( int index )
+	{
+		std::stringstream ss;
+		ss << "bone" << index;
+		return ss.str();
+	}
+	
+	//! Spread the helpers evenly over the bones.
+	bool hasHelper( int index, float helperRatio )
+	{
+		return int( ( index + 1 ) * helperRatio ) > int( index * helperRatio );
+	}
+	
+	int getParentIndex( int index )
+	{
+		if( index == 0 )
+			return -1;
+		if( index % SyntheticModelSource::CHAIN_LENGTH == 0 )
+			return index - SyntheticModelSource::CHAIN_LENGTH;
+		return index - 1;
+	}
+}
+
+SkeletonRef SyntheticModelSource::createSkeleton() const
+{
+	std::unordered_set<std::string> boneNames;
+	for( int b = 0; b < mFormat.mNumBones; ++b ) {
+		boneNames.insert( getBoneName( b ) );
+	}
+	SkeletonRef skeleton = Skeleton::create( boneNames );
+	// Same allocation scheme as the assimp loader
+	skeleton->setArena( Arena::create() );
+	
+	NodeRef root = Node::create( ci::Vec3f::zero(), ci::Quatf::identity(), ci::Vec3f::one(), "root", nullptr, 0, skeleton->getArena() );
+	skeleton->setRootNode( root );
+	
+	std::vector<NodeRef> bones;
+	for( int b = 0; b < mFormat.mNumBones; ++b ) {
+		int parentIndex = getParentIndex( b );
+		NodeRef parent = ( parentIndex < 0 ) ? root : bones[parentIndex];
+		if( hasHelper( b, mFormat.mHelperRatio ) ) {
+			std::stringstream helperName;
+			helperName << "helper" << b;
+			NodeRef helper = Node::create( ci::Vec3f( 0.0f, 0.1f, 0.0f ), ci::Quatf( ci::Vec3f::yAxis(), 0.2f ), ci::Vec3f::one(), helperName.str(), parent, parent->getLevel() + 1, skeleton->getArena() );
+			parent->addChild( helper );
+			parent = helper;
+		}
+		// Limbs branch sideways from the spine, spine and limb bones go up
+		ci::Vec3f position = ( b % CHAIN_LENGTH == 0 || parentIndex < 0 ) ? ci::Vec3f( 0.0f, 1.0f, 0.0f ) : ci::Vec3f( 0.5f, 0.5f, 0.0f );
+		std::string name = getBoneName( b );
+		NodeRef bone = Node::create( position, ci::Quatf::identity(), ci::Vec3f::one(), name, parent, parent->getLevel() + 1, skeleton->getArena() );
+		parent->addChild( bone );
+		bone->setBoneIndex( skeleton->findBoneIndex( name ) );
+		skeleton->insertBone( name, bone );
+		bones.push_back( bone );
+	}
+	
+	for( const NodeRef& bone : bones ) {
+		bone->setOffsetMatrix( bone->getAbsoluteTransformation().inverted() );
+	}
+	
+	float ticksPerSecond = 25.0f;
+	int numKeys = std::max( mFormat.mNumKeys, 2 );
+	for( int t = 0; t < mFormat.mNumTracks; ++t ) {
+		std::stringstream name;
+		name << "track" << t;
+		skeleton->setAnimInfo( t, mFormat.mDuration, ticksPerSecond, name.str() );
+		
+		for( int b = 0; b < mFormat.mNumBones; ++b ) {
+			const NodeRef& bone = bones[b];
+			bone->addAnimTrack( t, mFormat.mDuration, ticksPerSecond );
+			for( int k = 0; k < numKeys; ++k ) {
+				float time = mFormat.mDuration * float( k ) / float( numKeys - 1 );
+				float phase = 2.0f * float( M_PI ) * ( float( k ) / float( numKeys - 1 ) + 0.1f * b + 0.5f * t );
+				bone->addPositionKeyframe( t, time, bone->getInitialRelativePosition() + 0.05f * ci::Vec3f( std::sin( phase ), 0.0f, 0.0f ) );
+				bone->addRotationKeyframe( t, time, ci::Quatf( ci::Vec3f::zAxis(), 0.5f * std::sin( phase ) ) );
+				bone->addScalingKeyframe( t, time, ci::Vec3f::one() );
+			}
+		}
+	}
+	return skeleton;
+}
+
+MorphTargetsRef SyntheticModelSource::createMorphTargets( const std::vector<ci::Vec3f>& normals ) const
+{
+	if( mFormat.mNumMorphTargets <= 0 )
+		return nullptr;
+	
+	MorphTargetsRef morphTargets = MorphTargets::create();
+	size_t numVertices = normals.size();
+	size_t numMoved = std::max<size_t>( 1, size_t( mFormat.mMorphCoverage * float( numVertices ) ) );
+	for( int t = 0; t < mFormat.mNumMorphTargets; ++t ) {
+		// Each target inflates a slice of the vertices along their normals, slices wrapping around.
+		MorphTarget target;
+		std::stringstream name;
+		name << "morph" << t;
+		target.mName = name.str();
+		size_t first = size_t( t ) * numVertices / size_t( mFormat.mNumMorphTargets );
+		std::vector<uint32_t> vertices;
+		for( size_t i = 0; i < numMoved && i < numVertices; ++i ) {
+			vertices.push_back( uint32_t( ( first + i ) % numVertices ) );
+		}
+		std::sort( vertices.begin(), vertices.end() );
+		for( uint32_t v : vertices ) {
+			target.addDelta( v, 0.05f * normals[v], 0.1f * ci::Vec3f::yAxis() );
+		}
+		morphTargets->addTarget( target );
+	}
+	
+	float ticksPerSecond = 25.0f;
+	int numKeys = std::max( mFormat.mNumKeys, 2 );
+	for( int tr = 0; tr < mFormat.mNumTracks; ++tr ) {
+		morphTargets->addWeightTrack( tr, mFormat.mDuration, ticksPerSecond );
+		for( int t = 0; t < mFormat.mNumMorphTargets; ++t ) {
+			for( int k = 0; k < numKeys; ++k ) {
+				float time = mFormat.mDuration * float( k ) / float( numKeys - 1 );
+				float phase = 2.0f * float( M_PI ) * ( float( k ) / float( numKeys - 1 ) + float( t ) / float( mFormat.mNumMorphTargets ) + 0.5f * tr );
+				// Negative half waves are clamped: the target rests at 0 half of the time.
+				morphTargets->addWeightKeyframe( tr, t, time, std::max( 0.0f, std::sin( phase ) ) );
+			}
+		}
+	}
+	return morphTargets;
+}
+
+void SyntheticModelSource::load( ModelTarget *target )
+{
+	SkeletonRef skeleton = target->getSkeleton();
+	if( ! skeleton ) {
+		skeleton = createSkeleton();
+	}
+	std::vector<NodeRef> bones( mFormat.mNumBones );
+	for( const auto& entry : skeleton->getBoneNames() ) {
+		bones[ entry.second->getBoneIndex() ] = entry.second;
+	}
+	
+	size_t numVertices = getNumVertices();
+	std::vector<uint32_t> indices( getNumIndices() );
+	for( size_t i = 0; i < indices.size(); ++i ) {
+		indices[i] = uint32_t( i );
+	}
+	
+	std::vector<ci::Vec3f> positions, normals;
+	std::vector<BoneWeights> boneWeights( numVertices );
+	const float weights[BoneWeights::NB_WEIGHTS] = { 0.4f, 0.3f, 0.2f, 0.1f };
+	for( size_t v = 0; v < numVertices; ++v ) {
+		// Spread the vertices around their main bone and weight them along its parent chain
+		NodeRef bone = bones[ v % mFormat.mNumBones ];
+		float angle = 2.0f * float( M_PI ) * float( v ) / float( numVertices );
+		positions.push_back( bone->getAbsolutePosition() + 0.2f * ci::Vec3f( std::cos( angle ), 0.0f, std::sin( angle ) ) );
+		normals.push_back( ci::Vec3f( std::cos( angle ), 0.0f, std::sin( angle ) ) );
+		
+		for( int w = 0; w < BoneWeights::NB_WEIGHTS; ++w ) {
+			boneWeights[v].addWeight( bone, weights[w] );
+			if( bone->getParent() && bone->getParent()->getBoneIndex() >= 0 ) {
+				bone = bone->getParent();
+			}
+		}
+	}
+	
+	target->setActiveSection( 0 );
+	target->loadName( "synthetic" );
+	target->loadIndices( indices );
+	target->loadVertexPositions( positions );
+	target->loadVertexNormals( normals );
+	if( mFormat.mNumMorphTargets > 0 ) {
+		target->loadMorphTargets( createMorphTargets( normals ) );
+	}
+	target->loadSkeleton( skeleton );
+	target->loadBoneWeights( boneWeights );
+}
+
+} //end namespace model
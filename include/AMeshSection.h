@@ -12,16 +12,51 @@
 
 #include "cinder/gl/Material.h"
 #include "cinder/gl/Texture.h"
+#include "cinder/AxisAlignedBox.h"
 
 #include <vector>
 
 namespace model {
 	
 class Skeleton;
+class MorphTargets;
+
+//! Smallest box containing both boxes.
+ci::AxisAlignedBox3f includeBounds( const ci::AxisAlignedBox3f& a, const ci::AxisAlignedBox3f& b );
+
+/*!
+ * Memory held by a set of sections, counting each texture and each skeleton only once even
+ * when they are shared between sections.
+ */
+MemoryStats getSectionsMemoryStats( const std::vector<const class AMeshSection*>& sections );
+
+/*!
+ * The bone every vertex is fully weighted to, or null when the vertices blend several bones (or
+ * have no weights). Sections bound to a single bone move rigidly and need no per-vertex skinning.
+ */
+std::shared_ptr<Node> findRigidBone( const std::vector<BoneWeights>& boneWeights );
+//! Transform positions and normals in place, as when baking a default transformation into the vertices.
+void transformVertices( const ci::Matrix44f& transformation, std::vector<ci::Vec3f>* positions, std::vector<ci::Vec3f>* normals );
 
 class AMeshSection
 {
 public:
+	//! Bounds of the vertices influenced by a bone, expressed in that bone's space.
+	struct BoneBounds {
+		std::shared_ptr<Node>	mBone;
+		ci::AxisAlignedBox3f	mBounds;
+	};
+	
+	//! How the vertices of a section follow the skeleton, decided when the section is loaded.
+	enum Kind {
+		//! No bone weights: drawn as is, or with its default transformation.
+		KIND_STATIC,
+		//! Every vertex fully weighted to one bone: drawn whole with that bone's transformation, without per-vertex skinning.
+		KIND_RIGID,
+		//! Vertices blending several bones.
+		KIND_SKINNED
+	};
+
 	bool	hasTexture() { return mMatInfo.mTexture; }
 	bool	hasMaterial() { return mMatInfo.mHasMaterial; }
 	bool	hasNormals() const { return mHasNormals; }
@@ -35,6 +70,15 @@ public:
 	void						setDefaultTransformation( const ci::Matrix44f& transformation ) { mDefaultTransformation = transformation; mHasDefaultTransformation = true; }
 	const ci::Matrix44f&		getDefaultTranformation() const { return mDefaultTransformation; }
 	bool						hasDefaultTransformation() const { return mHasDefaultTransformation; }
+	//! Once the default transformation is baked into the vertices.
+	void						clearDefaultTransformation() { mDefaultTransformation = ci::Matrix44f::identity(); mHasDefaultTransformation = false; }
+	
+	void							setKind( Kind kind, const std::shared_ptr<Node>& rigidBone = nullptr ) { mKind = kind; mRigidBone = rigidBone; }
+	Kind							getKind() const { return mKind; }
+	//! The bone of a rigid section, null otherwise.
+	const std::shared_ptr<Node>&	getRigidBone() const { return mRigidBone; }
+	//! Skinning matrix of the rigid bone in the current pose, which the renderer applies to the whole section while it is animated.
+	virtual ci::Matrix44f			getRigidTransformation() const = 0;
 	
 	void								setSkeleton( std::shared_ptr<Skeleton> skeleton ) { mSkeleton = skeleton; }
 	std::shared_ptr<Skeleton>&			getSkeleton() { return mSkeleton; }
@@ -45,25 +89,62 @@ public:
 	const MaterialInfo&		getMatInfo() const { return mMatInfo; }
 	void					setMatInfo( const MaterialInfo& matInfo ) { mMatInfo = matInfo; }
 	
-	bool					isAnimated() { return mIsAnimated; }
+	bool					isAnimated() const { return mIsAnimated; }
+	
+	//! Morph targets applied to the vertices before skinning, null when the section has none.
+	void									setMorphTargets( const std::shared_ptr<MorphTargets>& morphTargets ) { mMorphTargets = morphTargets; }
+	const std::shared_ptr<MorphTargets>&	getMorphTargets() const { return mMorphTargets; }
+	bool									hasMorphTargets() const { return mMorphTargets != nullptr; }
+	
+	/*!
+	 * Compute the bind pose bounds and, for skinned sections, the per-bone bounds in bone space
+	 * (only vertices with a non-zero weight for a bone contribute to its bounds).
+	 */
+	void							computeBounds( const std::vector<ci::Vec3f>& positions, const std::vector<BoneWeights>& boneWeights = std::vector<BoneWeights>() );
+	const ci::AxisAlignedBox3f&		getBindPoseBounds() const { return mBindPoseBounds; }
+	const std::vector<BoneBounds>&	getBoneBounds() const { return mBoneBounds; }
+	//! Grow the bind pose bounds by \a margin, a mesh space distance, and the per-bone bounds by its bone space length, for vertices the morph targets move.
+	void							inflateBounds( float margin );
+	/*!
+	 * Conservative bounds of the section in its current pose. Skinned sections use the bone
+	 * transformations only, without touching the vertices. Static sections apply their default transformation.
+	 */
+	ci::AxisAlignedBox3f			getAnimatedBounds() const;
+	
+	//! Memory held by the section: bone weights, bounds and its texture (see getTextureBytes()).
+	virtual MemoryStats				getMemoryStats() const;
+	//! Estimated gpu size of the section's texture (4 bytes per texel, without mipmaps).
+	size_t							getTextureBytes() const;
 protected:
 	AMeshSection()
 	: mIsAnimated( false )
 	, mHasNormals( false )
 	, mHasDefaultTransformation( false )
+	, mKind( KIND_STATIC )
+	, mPoseVersion( 0 )
+	, mMorphVersion( 0 )
 	{ };
 	virtual void	updateMesh( bool enableSkinning = true ) = 0;
 	
 	bool		mIsAnimated;
 	bool		mHasNormals;
 	bool		mHasDefaultTransformation;
+	Kind		mKind;
+	//! Pose version of the skeleton when the section was last animated, 0 if it was not.
+	uint64_t	mPoseVersion;
+	//! Weight version of the morph targets when they were last applied, 0 if they were not.
+	uint64_t	mMorphVersion;
 	
 	std::shared_ptr<Skeleton>	mSkeleton;
 	MaterialInfo				mMatInfo;
 	ci::Matrix44f				mDefaultTransformation;
 	
 	std::vector<BoneWeights>	mBoneWeights;
+	std::shared_ptr<Node>		mRigidBone;
+	std::shared_ptr<MorphTargets>	mMorphTargets;
 	
+	ci::AxisAlignedBox3f		mBindPoseBounds;
+	std::vector<BoneBounds>		mBoneBounds;
 };
 
 } //end namespace model
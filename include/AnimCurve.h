@@ -4,6 +4,9 @@
 #include "cinder/Matrix44.h"
 #include "cinder/Quaternion.h"
 
+#include "Arena.h"
+#include "MemoryStats.h"
+
 #include <limits>
 #include <math.h>
 #include <map>
@@ -16,11 +19,35 @@ class AnimTrack;
 template< typename T >
 class AnimCurve {
 public:
+	typedef std::map< float, T, std::less<float>, ArenaAllocator< std::pair<const float, T> > > KeyframeMap;
+	
 	AnimCurve() { }
-	AnimCurve( const std::shared_ptr<AnimTrack>& parentTrack );
+	//! The keyframes are allocated from \a arena when one is given.
+	AnimCurve( AnimTrack* parentTrack, const ArenaRef& arena = nullptr );
 	void	addKeyframe(float time, T value);
 	T		getValue(float time) const;
 	bool	empty() { return mKeyframes.empty(); }
+	size_t	getNumKeyframes() const { return mKeyframes.size(); }
+	//! Replace the value of every keyframe by \a transform( value ).
+	template<typename Transform>
+	void	transformKeyframes( Transform transform )
+	{
+		for( auto& keyframe : mKeyframes ) {
+			keyframe.second = transform( keyframe.second );
+		}
+	}
+	//! Whether \a predicate( value ) holds for every keyframe.
+	template<typename Predicate>
+	bool	allKeyframes( Predicate predicate ) const
+	{
+		for( const auto& keyframe : mKeyframes ) {
+			if( ! predicate( keyframe.second ) )
+				return false;
+		}
+		return true;
+	}
+	//! Bytes held by the keyframe map nodes.
+	size_t	getKeyframeMemoryUsage() const { return memory::mapBytes( mKeyframes ); }
 	
 private:
 	static inline T		lerp( const T& start, const T& end, float time );
@@ -29,7 +56,7 @@ private:
 	void				updateAverageFrameDuration( float time );
 	
 	AnimTrack*			mParentTrack;
-	std::map<float, T>	mKeyframes;
+	KeyframeMap			mKeyframes;
 	float mStartTime, mEndTime;
 	float mVirtualDuration, mAverageFrameDuration;
 };
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "cinder/Matrix44.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace model {
+
+/*!
+ * Maps the distance to the camera (or the projected screen size) of an animated mesh
+ * to an update interval: every frame, or every 2, 4 or 8 frames.
+ */
+class AnimLodPolicy {
+public:
+	static const int NB_LEVELS = 4;
+
+	AnimLodPolicy();
+	//! Distances beyond which the animation rate is respectively halved, quartered and divided by eight.
+	AnimLodPolicy( float halfRateDistance, float quarterRateDistance, float eighthRateDistance );
+
+	void	setDistances( float halfRateDistance, float quarterRateDistance, float eighthRateDistance );
+	//! Screen sizes (in pixels) under which the animation rate is respectively halved, quartered and divided by eight.
+	void	setScreenSizes( float halfRateSize, float quarterRateSize, float eighthRateSize );
+
+	int		getIntervalFromDistance( float distance ) const;
+	int		getIntervalFromScreenSize( float screenSize ) const;
+private:
+	std::array<float, NB_LEVELS - 1> mDistances;
+	std::array<float, NB_LEVELS - 1> mScreenSizes;
+};
+
+/*!
+ * Per-instance animation LOD state. It stores the scheduling bookkeeping along with the
+ * two last evaluated bone palettes, which are interpolated on the frames where the
+ * instance is not re-posed.
+ */
+class AnimLodState {
+public:
+	AnimLodState();
+
+	//! True when the instance was scheduled for a full pose evaluation this frame.
+	bool	needsUpdate() const { return mNeedsUpdate; }
+	//! True once at least one palette has been evaluated (nothing sensible can be drawn before that).
+	bool	hasPalette() const { return ! mNextBoneMatrices.empty(); }
+	int		getInterval() const { return mInterval; }
+	//! Interpolation factor between the previous and the last evaluated palettes.
+	float	getBlendFactor() const;
+
+	//! Store a freshly evaluated palette. The palette displayed so far becomes the interpolation start. \a invTransposeMatrices may be null.
+	void	storePalette( const ci::Matrix44f* boneMatrices, const ci::Matrix44f* invTransposeMatrices, size_t nbBones );
+	//! Write the interpolated palette for the current frame.
+	void	blendPalette( ci::Matrix44f* boneMatrices, ci::Matrix44f* invTransposeMatrices, size_t nbBones ) const;
+private:
+	friend class AnimLodScheduler;
+
+	int			mInterval;
+	int			mPhase;
+	uint32_t	mFrame;
+	uint32_t	mLastUpdateFrame;
+	bool		mNeedsUpdate;
+	bool		mHasPhase;
+
+	std::vector<ci::Matrix44f> mPrevBoneMatrices, mNextBoneMatrices;
+	std::vector<ci::Matrix44f> mPrevInvTransposeMatrices, mNextInvTransposeMatrices;
+};
+
+/*!
+ * Decides, every frame, which instances get re-posed and re-skinned. Instances are
+ * staggered across frames according to their update interval, and at most
+ * \a maxUpdatesPerFrame instances are updated per frame (0 means unbounded). Deferred
+ * instances are prioritized on the following frames.
+ *
+ * Usage: beginFrame(), submit() every instance, schedule(), then query needsUpdate().
+ */
+class AnimLodScheduler {
+public:
+	explicit AnimLodScheduler( size_t maxUpdatesPerFrame = 0 );
+
+	AnimLodPolicy&			getPolicy() { return mPolicy; }
+	const AnimLodPolicy&	getPolicy() const { return mPolicy; }
+	void					setPolicy( const AnimLodPolicy& policy ) { mPolicy = policy; }
+
+	size_t	getMaxUpdatesPerFrame() const { return mMaxUpdatesPerFrame; }
+	void	setMaxUpdatesPerFrame( size_t maxUpdates ) { mMaxUpdatesPerFrame = maxUpdates; }
+
+	void	beginFrame();
+	void	submit( AnimLodState* state, float distance );
+	void	submitScreenSize( AnimLodState* state, float screenSize );
+	void	schedule();
+
+	uint32_t	getFrame() const { return mFrame; }
+	//! Number of instances updated by the last schedule() call.
+	size_t		getNumUpdates() const { return mNumUpdates; }
+private:
+	void	submitInterval( AnimLodState* state, int interval );
+
+	AnimLodPolicy	mPolicy;
+	size_t			mMaxUpdatesPerFrame;
+	size_t			mNumUpdates;
+	uint32_t		mFrame;
+	int				mNextPhase;
+	std::vector<AnimLodState*>	mDueStates;
+};
+
+} //end namespace model
@@ -16,12 +16,10 @@ namespace model {
 
 class AnimTrack {
 public:
-	static std::shared_ptr<AnimTrack> create(float duration, float ticksPerSecond ) {
-		std::shared_ptr<AnimTrack> track( new AnimTrack( duration, ticksPerSecond ) );
-		track->mTranslationCurve = std::unique_ptr<AnimCurve<ci::Vec3f>>( new AnimCurve<ci::Vec3f>( track ) );
-		track->mRotationCurve = std::unique_ptr<AnimCurve<ci::Quatf>>( new AnimCurve<ci::Quatf>( track ) );
-		track->mScalingCurve = std::unique_ptr<AnimCurve<ci::Vec3f>>( new AnimCurve<ci::Vec3f>( track ) );
-		return track;
+	//! The track, its curves and their keyframes are allocated from \a arena when one is given.
+	static std::shared_ptr<AnimTrack> create( float duration, float ticksPerSecond, const ArenaRef& arena = nullptr ) {
+		AnimTrack* track = new( allocateInArena<AnimTrack>( arena ) ) AnimTrack( duration, ticksPerSecond, arena );
+		return makeArenaShared( track, arena );
 	}
 	
 	float	getAnimDuration() { return mDuration; }
@@ -31,48 +29,59 @@ public:
 	
 	ci::Vec3f getTranslation( float time ) const
 	{
-		return mTranslationCurve->getValue( time );
+		return mTranslationCurve.getValue( time );
 	}
 	
 	ci::Quatf getRotation( float time ) const
 	{
-		return mRotationCurve->getValue( time );
+		return mRotationCurve.getValue( time );
 	}
 	
 	ci::Vec3f getScaling( float time ) const
 	{
-		return mScalingCurve->getValue( time );
+		return mScalingCurve.getValue( time );
 	}
 	
 	void getValues( float time, ci::Vec3f* translate, ci::Quatf* rotation,  ci::Vec3f* scale )
 	{
-		*translate = mTranslationCurve->getValue( time );
-		*rotation = mRotationCurve->getValue( time );
-		*scale = mScalingCurve->getValue( time );
+		*translate = mTranslationCurve.getValue( time );
+		*rotation = mRotationCurve.getValue( time );
+		*scale = mScalingCurve.getValue( time );
 	}
 	
 	ci::Matrix44f getTransformation( float time ) const
 	{
-		ci::Matrix44f t = ci::Matrix44f::createScale( mScalingCurve->getValue( time ) );
-		t *= mRotationCurve->getValue( time ).toMatrix44();
-		t.setTranslate( mTranslationCurve->getValue( time ) );
+		ci::Matrix44f t = ci::Matrix44f::createScale( mScalingCurve.getValue( time ) );
+		t *= mRotationCurve.getValue( time ).toMatrix44();
+		t.setTranslate( mTranslationCurve.getValue( time ) );
 		return t;
 	}
 	
-	std::unique_ptr<AnimCurve<ci::Vec3f>>	mTranslationCurve;
-	std::unique_ptr<AnimCurve<ci::Quatf>>	mRotationCurve;
-	std::unique_ptr<AnimCurve<ci::Vec3f>>	mScalingCurve;
+	//! Bytes held by the track, its three curves and their keyframes.
+	size_t getMemoryUsage() const
+	{
+		return sizeof( AnimTrack ) + memory::SHARED_PTR_CONTROL_BYTES
+			+ mTranslationCurve.getKeyframeMemoryUsage() + mRotationCurve.getKeyframeMemoryUsage() + mScalingCurve.getKeyframeMemoryUsage();
+	}
 private:
-	AnimTrack( float duration, float ticksPerSecond )
+	AnimTrack( float duration, float ticksPerSecond, const ArenaRef& arena )
 	: mDuration( duration )
 	, mTicksPerSecond( ticksPerSecond )
+	, mTranslationCurve( this, arena )
+	, mRotationCurve( this, arena )
+	, mScalingCurve( this, arena )
 	{ }
 	
 	// TODO: Implement copy/assignment operators before rendering them public again.
 	AnimTrack(const AnimTrack& that);
 	AnimTrack& operator=(const AnimTrack&);
 	
+	//! Declared before the curves, which read the duration on construction.
 	float mDuration, mTicksPerSecond;
+public:
+	AnimCurve<ci::Vec3f>	mTranslationCurve;
+	AnimCurve<ci::Quatf>	mRotationCurve;
+	AnimCurve<ci::Vec3f>	mScalingCurve;
 };
 	
 }
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace model {
+
+typedef std::shared_ptr<class Arena> ArenaRef;
+
+/*!
+ * Bump allocator handing out memory from large blocks. Individual deallocations are no-ops:
+ * every block is released at once when the arena is destroyed. Objects allocated through an
+ * ArenaAllocator keep the arena alive, so the arena goes away with the last of them.
+ * Not thread-safe; an arena is meant to be filled by a single loader.
+ */
+class Arena {
+public:
+	static const size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+	static ArenaRef create( size_t blockSize = DEFAULT_BLOCK_SIZE ) { return ArenaRef( new Arena( blockSize ) ); }
+
+	void*	allocate( size_t bytes, size_t alignment );
+
+	//! Bytes handed out so far.
+	size_t	getBytesAllocated() const { return mBytesAllocated; }
+	//! Bytes reserved from the system (the sum of the block sizes).
+	size_t	getBytesReserved() const { return mBytesReserved; }
+	size_t	getNumBlocks() const { return mBlocks.size(); }
+private:
+	explicit Arena( size_t blockSize );
+	Arena( const Arena& );
+	Arena& operator=( const Arena& );
+
+	std::vector< std::unique_ptr<char[]> >	mBlocks;
+	size_t	mBlockSize;
+	char*	mCurrent;
+	size_t	mRemaining;
+	size_t	mBytesAllocated, mBytesReserved;
+};
+
+/*!
+ * Standard allocator drawing from an arena. A default constructed (or null arena) allocator
+ * falls back to the global heap, so that containers using it behave as usual outside of a loader.
+ */
+template<typename T>
+class ArenaAllocator {
+public:
+	typedef T			value_type;
+	typedef T*			pointer;
+	typedef const T*	const_pointer;
+	typedef T&			reference;
+	typedef const T&	const_reference;
+	typedef size_t		size_type;
+	typedef ptrdiff_t	difference_type;
+
+	template<typename U>
+	struct rebind { typedef ArenaAllocator<U> other; };
+
+	ArenaAllocator() { }
+	ArenaAllocator( const ArenaRef& arena ) : mArena( arena ) { }
+	template<typename U>
+	ArenaAllocator( const ArenaAllocator<U>& other ) : mArena( other.getArena() ) { }
+
+	T* allocate( size_t n )
+	{
+		if( mArena )
+			return static_cast<T*>( mArena->allocate( n * sizeof( T ), std::alignment_of<T>::value ) );
+		return static_cast<T*>( ::operator new( n * sizeof( T ) ) );
+	}
+
+	void deallocate( T* p, size_t )
+	{
+		if( ! mArena )
+			::operator delete( p );
+	}
+
+	size_t max_size() const { return size_t( -1 ) / sizeof( T ); }
+
+	const ArenaRef&	getArena() const { return mArena; }
+private:
+	ArenaRef	mArena;
+};
+
+template<typename T, typename U>
+bool operator==( const ArenaAllocator<T>& a, const ArenaAllocator<U>& b ) { return a.getArena() == b.getArena(); }
+
+template<typename T, typename U>
+bool operator!=( const ArenaAllocator<T>& a, const ArenaAllocator<U>& b ) { return a.getArena() != b.getArena(); }
+
+//! Destroys an object placement-constructed in arena memory, leaving the memory to the arena.
+template<typename T>
+struct ArenaDeleter {
+	void operator()( T* p ) const { p->~T(); }
+};
+
+/*!
+ * Memory for a \a T taken from the arena, or from the heap when the arena is null. Construct the
+ * object in place and hand it to makeArenaShared().
+ */
+template<typename T>
+void* allocateInArena( const ArenaRef& arena )
+{
+	return arena ? arena->allocate( sizeof( T ), std::alignment_of<T>::value ) : ::operator new( sizeof( T ) );
+}
+
+//! Shared ownership of an object allocated with allocateInArena(). Its control block lives in the arena as well.
+template<typename T>
+std::shared_ptr<T> makeArenaShared( T* object, const ArenaRef& arena )
+{
+	if( ! arena )
+		return std::shared_ptr<T>( object );
+	return std::shared_ptr<T>( object, ArenaDeleter<T>(), ArenaAllocator<T>( arena ) );
+}
+
+} //end namespace model
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "BonePartition.h"
+
+#include "cinder/gl/gl.h"
+#include "cinder/gl/GlslProg.h"
+#include "cinder/gl/Vbo.h"
+#include "cinder/Matrix44.h"
+
+#include <vector>
+
+namespace model {
+
+/*!
+ * Write the palette of \a bones as rows of 3x4 affine matrices (3 per bone) and the matching
+ * normal transforms: the upper 3x3 of uniformly scaled bones, and the cofactor matrix (the inverse
+ * transpose up to scale) of the others. Returns true if any bone is non-uniformly scaled.
+ */
+bool	packAffinePalette( const std::vector<ci::Matrix44f>& boneMatrices, const std::vector<int>& bones, ci::Vec4f* boneRows, ci::Vec4f* normalRows );
+//! Whether any of \a boneMatrices is non-uniformly scaled, so that its normals need the normal palette.
+bool	hasNonUniformScale( const std::vector<ci::Matrix44f>& boneMatrices );
+
+//! Bone palette uniforms of a skinning shader, resolved once per shader.
+struct PaletteUniforms {
+	//! Cached per shader until it is released. The "BonePalette" uniform block, if any, is bound to PaletteBuffer::BINDING.
+	static const PaletteUniforms&	get( const ci::gl::GlslProgRef& shader );
+	
+	//! The normal palette is only declared by the NORMAL_PALETTE permutation, -1 otherwise.
+	GLint	mBonePalette, mNormalPalette;
+	GLint	mBoneMatrices, mInvTransposeMatrices;
+	//! True if the palette is read from the "BonePalette" uniform block.
+	bool	mHasBlock;
+};
+
+/*!
+ * Uniform buffer holding the affine palettes of the bone batches of a mesh, one slice per distinct
+ * batch. It is uploaded at most once per update and each draw only binds the range of its batch. Each
+ * slice matches the std140 layout of the "BonePalette" block of the default shaders:
+ * vec4 bonePalette[3 * MAXBONES] followed by vec4 normalPalette[3 * MAXBONES], which permutations
+ * without NORMAL_PALETTE leave unread.
+ */
+class PaletteBuffer {
+public:
+	static const GLuint BINDING = 0;
+	
+	//! Uniform buffer objects require GL_ARB_uniform_buffer_object (or GL 3.1).
+	static bool	isSupported();
+	//! Whether, in addition, a slice of \a maxBones bones fits in a uniform block (GL_MAX_UNIFORM_BLOCK_SIZE, 16KB at least).
+	static bool	isSupported( size_t maxBones );
+	
+	//! \a maxBones is the palette size declared by the shader block.
+	explicit PaletteBuffer( size_t maxBones );
+	
+	//! Slice of \a batch. Batches referencing the same bones share their slice.
+	size_t	addBatch( const BoneBatch& batch );
+	//! Palette of every slice, packed and uploaded by the next bind(). \a boneMatrices must outlive it.
+	void	update( const std::vector<ci::Matrix44f>& boneMatrices );
+	/*!
+	 * Pack and upload \a nbPalettes skeleton palettes at once, each into its own set of slices, so that
+	 * the instances of a mesh drawn from a render queue share a single upload. selectPalette() then
+	 * picks the palette bind() uses.
+	 */
+	void	update( const std::vector<ci::Matrix44f>* const* palettes, size_t nbPalettes );
+	void	selectPalette( size_t palette ) { mPalette = palette; }
+	//! Bind a slice of the selected palette to BINDING.
+	void	bind( size_t slice );
+	
+	size_t	getNumSlices() const { return mSlices.size(); }
+	//! Size of the gpu buffer.
+	size_t	getBytes() const { return mNumPalettes * mSlices.size() * mSliceStride; }
+	size_t	getCpuBytes() const;
+private:
+	size_t							mMaxBones, mSliceBytes, mSliceStride;
+	std::vector< std::vector<int> >	mSlices;
+	//! Palette of the last single update(), not uploaded yet.
+	const std::vector<ci::Matrix44f>*	mPendingPalette;
+	size_t							mPalette, mNumPalettes;
+	std::vector<ci::Vec4f>			mStaging;
+	ci::gl::Vbo						mBuffer;
+};
+
+} //end namespace model
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "ModelIo.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace model {
+
+//! Bone indices of a vertex into the palette of its batch.
+typedef std::array<uint8_t, BoneWeights::NB_WEIGHTS> PaletteIndices;
+
+//! Range of a section's indices drawn with its own palette of at most maxBones bones.
+struct BoneBatch {
+	BoneBatch() : mFirstIndex( 0 ), mNumIndices( 0 ) { }
+	size_t				mFirstIndex, mNumIndices;
+	//! Skeleton bone index of each entry of the batch palette.
+	std::vector<int>	mBones;
+};
+
+/*!
+ * Triangles of a skinned section regrouped into batches referencing at most maxBones bones each.
+ * Vertices shared by several batches are duplicated so that each copy indexes its own palette.
+ */
+struct BonePartition {
+	std::vector<BoneBatch>		mBatches;
+	//! Source vertex of each vertex of the partitioned section.
+	std::vector<uint32_t>		mVertexRemap;
+	//! Partitioned triangles, batch after batch.
+	std::vector<uint32_t>		mIndices;
+	std::vector<PaletteIndices>	mPaletteIndices;
+};
+
+/*!
+ * Greedily split \a indices (triangles) so that no batch uses more than \a maxBones bones. Throws a
+ * ModelTargetException if \a maxBones is larger than 256 or if a single triangle needs more bones.
+ */
+BonePartition	partitionBones( const std::vector<uint32_t>& indices, const std::vector<BoneWeights>& boneWeights, size_t maxBones );
+
+//! Vertices sorted by influence count: those blending \a n bones are [mFirst[n], mFirst[n + 1]).
+struct InfluenceRuns {
+	InfluenceRuns() { mFirst.fill( 0 ); }
+	std::array<size_t, BoneWeights::NB_WEIGHTS + 2>	mFirst;
+};
+
+/*!
+ * Stable sort of the vertices by number of bone influences, so that the vertices blending the same number
+ * of bones are contiguous. Rewrites \a indices and returns the source vertex of each sorted vertex, to be
+ * applied to the attributes with remapVertices().
+ */
+std::vector<uint32_t>	sortByInfluenceCount( std::vector<uint32_t>* indices, const std::vector<BoneWeights>& boneWeights, InfluenceRuns* runs );
+
+//! Attribute of every partitioned vertex, empty if \a attribute is.
+template<typename T>
+std::vector<T> remapVertices( const std::vector<T>& attribute, const std::vector<uint32_t>& remap )
+{
+	std::vector<T> remapped;
+	if( attribute.empty() )
+		return remapped;
+	remapped.reserve( remap.size() );
+	for( uint32_t source : remap ) {
+		remapped.push_back( attribute[source] );
+	}
+	return remapped;
+}
+
+} //end namespace model
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "Node.h"
+#include "Skeleton.h"
+
+#include "cinder/Matrix44.h"
+
+#include <string>
+#include <vector>
+
+namespace model {
+
+typedef std::shared_ptr<class BoneQuery> BoneQueryRef;
+
+/*!
+ * World transformations of a few bones, such as attachment or hit points, evaluated at any time of
+ * any animation without posing the skeleton: only the queried bones and their ancestors are sampled,
+ * and the nodes are left untouched. The ancestor chain is gathered once, when the query is created,
+ * so one query serves every entity animated with the same skeleton. Evaluations share a scratch
+ * buffer: use one query per thread.
+ */
+class BoneQuery {
+public:
+	static BoneQueryRef create( const std::vector<NodeRef>& bones ) { return BoneQueryRef( new BoneQuery( bones ) ); }
+	//! Bones looked up by name with Skeleton::getBone(), which throws for unknown names.
+	static BoneQueryRef create( const SkeletonRef& skeleton, const std::vector<std::string>& boneNames );
+	
+	size_t	getNumBones() const { return mBoneLinks.size(); }
+	//! Nodes sampled by each evaluation: the queried bones and their ancestors, shared ancestors counted once.
+	size_t	getNumNodes() const { return mChain.size(); }
+	
+	//! Absolute transformations of the queried bones at \a time of animation \a animId, in query order.
+	void			evaluate( float time, int animId, ci::Matrix44f* transformations ) const;
+	//! Absolute transformation of a single queried bone.
+	ci::Matrix44f	evaluate( size_t bone, float time, int animId = 0 ) const;
+private:
+	explicit BoneQuery( const std::vector<NodeRef>& bones );
+	
+	//! Sample the chain up to link \a last, parents first.
+	void	evaluateChain( size_t last, float time, int animId ) const;
+	
+	struct Link {
+		NodeRef	mNode;
+		//! Index of the parent link, -1 for the root.
+		int		mParent;
+	};
+	struct Transformation {
+		ci::Vec3f	mPosition, mScale;
+		ci::Quatf	mRotation;
+	};
+	
+	//! Ancestors before their descendants.
+	std::vector<Link>	mChain;
+	//! Link of each queried bone.
+	std::vector<size_t>	mBoneLinks;
+	mutable std::vector<Transformation>	mTransformations;
+};
+
+} //end namespace model
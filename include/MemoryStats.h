@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace model {
+
+/*!
+ * Memory footprint of a model (or a part of it) in bytes, broken down by category.
+ * CPU figures are estimates of the heap memory held by the containers, including their
+ * per-node overhead. GPU figures are the sizes of the buffers and textures created for the model.
+ */
+struct MemoryStats {
+	enum Category {
+		//! Vertex and index data kept on the cpu (trimeshes, rest pose positions and normals).
+		GEOMETRY,
+		//! Per-vertex bone weights and bone palettes.
+		SKINNING,
+		//! Bind pose and per-bone bounds.
+		BOUNDS,
+		//! Node hierarchy, names and bone map.
+		HIERARCHY,
+		//! Animation tracks, curves and keyframes.
+		ANIMATION,
+		//! Imported scene kept alive by the model source.
+		IMPORTER,
+		GPU_BUFFERS,
+		GPU_TEXTURES,
+		NB_CATEGORIES
+	};
+
+	MemoryStats() { mBytes.fill( 0 ); }
+
+	void	add( Category category, size_t bytes ) { mBytes[category] += bytes; }
+	size_t	get( Category category ) const { return mBytes[category]; }
+	size_t	getCpuBytes() const;
+	size_t	getGpuBytes() const { return mBytes[GPU_BUFFERS] + mBytes[GPU_TEXTURES]; }
+	size_t	getTotalBytes() const { return getCpuBytes() + getGpuBytes(); }
+
+	MemoryStats& operator+=( const MemoryStats& rhs );
+
+	static const char*	getCategoryName( Category category );
+
+	std::array<size_t, NB_CATEGORIES> mBytes;
+};
+
+extern std::ostream& operator<<( std::ostream& o, const MemoryStats& stats );
+
+//! Heap size estimates of the standard containers used by the block.
+namespace memory {
+	//! Size of a std::shared_ptr control block allocated separately from its object.
+	const size_t SHARED_PTR_CONTROL_BYTES = 2 * sizeof( void* ) + 2 * sizeof( int );
+	//! Red-black tree node overhead of std::map (three links and a color).
+	const size_t MAP_NODE_BYTES = 4 * sizeof( void* );
+	//! Singly linked node overhead of std::unordered_map (next link and cached hash).
+	const size_t HASH_NODE_BYTES = sizeof( void* ) + sizeof( size_t );
+
+	template<typename T>
+	size_t vectorBytes( const std::vector<T>& v ) { return v.capacity() * sizeof( T ); }
+
+	//! Short strings live in the small string buffer and own no heap memory.
+	inline size_t stringBytes( const std::string& s ) { return s.capacity() > 15 ? s.capacity() + 1 : 0; }
+
+	//! Any std::map, whatever its comparator and allocator.
+	template<typename Map>
+	size_t mapBytes( const Map& m ) { return m.size() * ( sizeof( typename Map::value_type ) + MAP_NODE_BYTES ); }
+
+	//! Any std::unordered_map, whatever its hash, predicate and allocator.
+	template<typename Map>
+	size_t unorderedMapBytes( const Map& m )
+	{
+		return m.bucket_count() * sizeof( void* ) + m.size() * ( sizeof( typename Map::value_type ) + HASH_NODE_BYTES );
+	}
+}
+
+} //end namespace model
@@ -5,13 +5,17 @@
 #include "cinder/gl/Material.h"
 #include "cinder/Exception.h"
 
+#include "MemoryStats.h"
+
 #include <array>
+#include <string>
 
 namespace model {
 	
 class Skeleton;
 class Node;
 class ModelTarget;
+class MorphTargets;
 
 typedef std::shared_ptr<class ModelSource> ModelSourceRef;
 typedef std::shared_ptr<ModelTarget> ModelTargetRef;
@@ -46,6 +50,36 @@ private:
 	std::array<std::shared_ptr<Node>, NB_WEIGHTS> mBones;
 };
 
+/*!
+ * Receives the successive phases of a model load (import, post-processing steps, vertex
+ * extraction, skeleton construction, texture decoding, etc.) so that loading can be profiled.
+ */
+class LoadObserver {
+public:
+	virtual ~LoadObserver() { }
+	virtual void	beginPhase( const std::string& name ) = 0;
+	virtual void	endPhase( const std::string& name ) = 0;
+};
+
+//! Reports a phase to an (optional) load observer for the lifetime of the object.
+class ScopedLoadPhase {
+public:
+	ScopedLoadPhase( LoadObserver* observer, const std::string& name )
+	: mObserver( observer ), mName( name )
+	{
+		if( mObserver )
+			mObserver->beginPhase( mName );
+	}
+	~ScopedLoadPhase()
+	{
+		if( mObserver )
+			mObserver->endPhase( mName );
+	}
+private:
+	LoadObserver*	mObserver;
+	std::string		mName;
+};
+
 class ModelSource {
 public:
 	virtual size_t	getNumSections() const = 0;
@@ -57,6 +91,8 @@ public:
 	virtual bool	hasAnimations() const = 0;
 	
   	virtual	void	load( ModelTarget *target ) = 0;
+	//! Memory held by the source itself (e.g. the imported scene it keeps alive).
+	virtual MemoryStats	getMemoryStats() const { return MemoryStats(); }
 };
 	
 class ModelIoException : public ci::Exception
@@ -101,6 +137,8 @@ public:
   	virtual void	loadSkeleton( const std::shared_ptr<Skeleton>& skeleton );
 	virtual void	loadBoneWeights( const std::vector<BoneWeights>& boneWeights );
 	virtual void	loadDefaultTransformation( const ci::Matrix44f& transformation );
+	//! Morph targets of the active section, indexed like the vertex positions. Sources create a set per load.
+	virtual void	loadMorphTargets( const std::shared_ptr<MorphTargets>& morphTargets );
 };
 
 } //end namespace model
\ No newline at end of file
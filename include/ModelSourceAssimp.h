@@ -16,6 +16,8 @@ namespace ai {
 	
 	//! Assimp loader settings/flags.
 	extern unsigned int flags;
+	//! Every post-processing step with its name, in the order assimp applies them.
+	extern const std::vector< std::pair<unsigned int, const char*> > postProcessSteps;
 	
 	//! Convert aiVector3D to ci::Vec3f.
 	inline ci::Vec3f				get( const aiVector3D &v );
@@ -35,8 +37,9 @@ namespace ai {
 	std::vector<ci::Vec2f>			getTexCoords( const aiMesh* aimesh );
 	//! Extract vertex indices from an assimp mesh section.
 	std::vector<uint32_t>			getIndices( const aiMesh* aimesh );
-	//! Extract material information (including textures) for a mesh section.
-	model::MaterialInfo				getTexture( const aiScene* aiscene, const aiMesh *aimesh, ci::fs::path modelPath, ci::fs::path rootPath = ""  );
+	//! Extract material information (including textures) for a mesh section. Textures are only decoded (not uploaded to the gpu) if uploadTexture is false.
+	model::MaterialInfo				getTexture( const aiScene* aiscene, const aiMesh *aimesh, ci::fs::path modelPath, ci::fs::path rootPath = "",
+											    model::LoadObserver* observer = nullptr, bool uploadTexture = true );
 	//! Extract skeletal bone weights for each vertex of an assimp mesh section.
 	std::vector<model::BoneWeights>	getBoneWeights( const aiMesh* aimesh, const model::Skeleton* skeleton );
 	//! Extract a mesh section's default transformation (use when there is no bones)
@@ -45,7 +48,8 @@ namespace ai {
 	//! Construct skeleton from assimp scene.
 	std::shared_ptr<class model::Skeleton>	getSkeleton( const aiScene* aiscene,
 														 bool hasAnimations,
-														 const aiNode* root = nullptr );
+														 const aiNode* root = nullptr,
+														 model::LoadObserver* observer = nullptr );
 	//! Traverse assimp nodes to find the aiNode with specified name.
 	const aiNode*							findMeshNode( const std::string& meshName,
 														  const aiScene* aiscene,
@@ -72,7 +76,12 @@ class ModelSourceAssimp : public ModelSource {
 	bool		mHasSkeleton;
 	bool		mHasAnimations;
 public:
-	static ModelSourceAssimpRef	create( const ci::fs::path& modelPath, const ci::fs::path& rootAssetFolderPath = ""  );
+	/*!
+	 * When a load observer is given, the file is imported without post-processing and the post-processing
+	 * steps are then applied one at a time (in assimp's pipeline order) so that each of them can be timed.
+	 * The observer must outlive the model source.
+	 */
+	static ModelSourceAssimpRef	create( const ci::fs::path& modelPath, const ci::fs::path& rootAssetFolderPath = "", LoadObserver* observer = nullptr );
 	
 	virtual size_t	getNumSections() const override { return mSections.size(); }
 	virtual size_t	getNumVertices( int section = 0 ) const override { return mSections[section].mNumVertices; }
@@ -83,9 +92,24 @@ public:
 	virtual bool	hasAnimations() const override { return mHasAnimations; }
 	
 	virtual void	load( ModelTarget *target ) override;
+	//! Estimated size of the assimp scene, which stays in memory as long as the source does.
+	virtual MemoryStats	getMemoryStats() const override;
 	
+	//! Disable to decode textures without creating gl textures (e.g. without a gl context).
+	void			setTextureUploadEnabled( bool enabled ) { mUploadTextures = enabled; }
+	bool			isTextureUploadEnabled() const { return mUploadTextures; }
+	/*!
+	 * Fold the static helper nodes of the scene (pivots, mesh and export helpers) into their children when
+	 * building the skeleton, see Skeleton::collapseStaticNodes(). Disabled by default: the children of the
+	 * folded helpers change their relative space, which code posing them relative to their initial
+	 * transformation (e.g. getInitialRelativeRotation() * rotation) or blending poses may rely on.
+	 */
+	void			setStaticNodeCollapsingEnabled( bool enabled ) { mCollapseStaticNodes = enabled; }
+	bool			isStaticNodeCollapsingEnabled() const { return mCollapseStaticNodes; }
+	//! Keep a helper node when collapsing, for instance to find an attachment point by name with Skeleton::getNode().
+	void			pinNode( const std::string& name ) { mPinnedNodes.insert( name ); }
 protected:
-	ModelSourceAssimp( const ci::fs::path& modelPath, const ci::fs::path& rootAssetFolderPath = ""  );
+	ModelSourceAssimp( const ci::fs::path& modelPath, const ci::fs::path& rootAssetFolderPath = "", LoadObserver* observer = nullptr );
 private:
 	//! Assimp importer instance which cannot be destroyed until the scene loading is complete.
 	std::unique_ptr<Assimp::Importer>	mImporter;
@@ -98,6 +122,11 @@ private:
 	ci::fs::path						mRootAssetFolderPath;
 	//! Information extracted (upon class instantiation) from assimp about each model section
 	std::vector<SectionInfo>			mSections;
+	//! Optional observer of the loading phases.
+	LoadObserver*						mObserver;
+	bool								mUploadTextures;
+	bool								mCollapseStaticNodes;
+	std::unordered_set<std::string>		mPinnedNodes;
 };
 
 } //end namespace model
@@ -23,6 +23,14 @@ public:
   	virtual void	loadSkeleton( const std::shared_ptr<Skeleton>& skeleton )  override;
 	virtual void	loadBoneWeights( const std::vector<BoneWeights>& boneWeights )  override;
 	virtual void	loadDefaultTransformation( const ci::Matrix44f& transformation ) override;
+	virtual void	loadMorphTargets( const std::shared_ptr<MorphTargets>& morphTargets ) override;
+	
+	/*!
+	 * Classify the loaded sections as static, rigid or skinned. Rigid sections drop their bone weights,
+	 * static ones get their default transformation baked into their vertices, and skinned ones have their
+	 * vertices sorted by influence count. The morph targets follow, and grow the bounds. Call once after loading.
+	 */
+	void			finishLoading();
 private:
   	SkinnedMesh*	mSkinnedMesh;
 };
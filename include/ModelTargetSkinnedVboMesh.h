@@ -1,6 +1,8 @@
 #pragma once
 
 #include "ModelIo.h"
+#include "SectionMerge.h"
+#include "SkinnedVboMesh.h"
 #include <vector>
 
 #include "cinder/Vector.h"
@@ -8,8 +10,14 @@
 namespace model {
 
 class Skeleton;
-class SkinnedVboMesh;
 
+/*!
+ * Stages the attributes of each section on the cpu and uploads them as a single interleaved
+ * vertex buffer once the section is complete, either as floats or as packed vertices. When the
+ * mesh format merges sections, every section is staged until the end of the load, then compatible
+ * sections are concatenated into one. Sections with morph targets keep float positions and normals,
+ * streamed from a buffer of their own, and are neither packed nor merged.
+ */
 class ModelTargetSkinnedVboMesh : public ModelTarget {
 public:	
 	ModelTargetSkinnedVboMesh( SkinnedVboMesh *mesh );
@@ -24,17 +32,49 @@ public:
   	virtual void	loadSkeleton( const std::shared_ptr<Skeleton>& skeleton ) override;
 	virtual void	loadBoneWeights( const std::vector<BoneWeights>& boneWeights ) override;
  	virtual void	loadDefaultTransformation( const ci::Matrix44f& transformation ) override;
+	virtual void	loadMorphTargets( const std::shared_ptr<MorphTargets>& morphTargets ) override;
+	
+	//! Upload the last staged section, and merge the sections if the mesh format asks for it. Call once after loading.
+	void			finishLoading();
 private:
+	typedef SkinnedVboMesh::MeshSection::VertexAttrib VertexAttrib;
+	
+	//! Section staged until the end of the load, to be merged.
+	struct StagedSection {
+		int				mIndex;
+		SectionGeometry	mGeometry;
+	};
+	
   	SkinnedVboMesh*			mSkinnedVboMesh;
 	
-	void					incrementOffsets( size_t dataSize );
-	void					resetOffsets();
+	//! Upload the staged attributes of the active section, or keep them for merging. Called on every section change.
+	void			finishSection();
+	//! Group the staged sections that can be merged, and upload each group as one section.
+	void			mergeSections();
+	//! Split a group whose textures do not fit in an atlas into groups sharing a texture.
+	std::vector< std::vector<size_t> >	splitByTexture( const std::vector<size_t>& group ) const;
+	void			uploadGroup( const std::vector<size_t>& group );
+	//! Partition, interleave and upload \a geometry into \a section.
+	void			uploadSection( const MeshVboSectionRef& section, SectionGeometry& geometry, const std::vector<SubSection>& subSections );
+	
+	void			addAttrib( std::vector<VertexAttrib>* attribs, VertexSemantic semantic, GLint size, GLenum type, GLboolean normalized, size_t offset,
+							   bool streamed = false ) const;
+	void			finishFloatSection( const MeshVboSectionRef& section, const SectionGeometry& geometry );
+	void			finishPackedSection( const MeshVboSectionRef& section, const SectionGeometry& geometry );
+	//! Features of the default shader permutation drawing \a geometry.
+	ShaderFeatures	getShaderFeatures( const MeshVboSectionRef& section, const SectionGeometry& geometry ) const;
 	
-	template<class T> void	bufferSubData( const T& buffer, size_t dataSize);
-	void					setCustomAttribute( GLuint location, const std::string& name );
+	//! Attribute locations of the mesh shader.
+	const ShaderAttribs&	mShaderAttribs;
 	
-	GLuint			mAttribLocation;
-	ptrdiff_t		mSubDataOffset;
+	//! Staged attributes of the active section.
+	int							mActiveIndex;
+	SectionGeometry				mGeometry;
+	//! Batch palette slots of the bone weights, once the section is partitioned.
+	std::vector<PaletteIndices>	mPaletteIndices;
+	bool						mHasStagedSection;
+	//! Complete sections waiting to be merged.
+	std::vector<StagedSection>	mStagedSections;
 };
 
-} //end namespace model
\ No newline at end of file
+} //end namespace model
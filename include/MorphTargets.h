@@ -0,0 +1,128 @@
+#pragma once
+
+#include "AnimCurve.h"
+#include "MemoryStats.h"
+
+#include "cinder/Matrix44.h"
+#include "cinder/Vector.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace model {
+
+class AnimTrack;
+
+/*!
+ * Shape of a section (facial expression, corrective shape) stored as the displacement of the
+ * vertices it moves only, in runs of consecutive vertices sorted by vertex index. Deltas are flat
+ * floats (x, y, z of each vertex of each run in turn), laid out as the vertices of a run, so that
+ * applying a run is a single unit-stride loop the compiler vectorizes. Short gaps between moved
+ * vertices are filled with zero deltas rather than starting a new run. Normal deltas are empty when
+ * the shape does not change the normals.
+ */
+struct MorphTarget {
+	//! Unmoved vertices between two moved ones up to which the run goes on, with zero deltas.
+	static const uint32_t	MAX_RUN_GAP = 4;
+
+	struct Run {
+		uint32_t	mFirstVertex, mNumVertices;
+	};
+
+	std::string			mName;
+	std::vector<Run>	mRuns;
+	//! 3 floats per vertex of the runs, in run order.
+	std::vector<float>	mPositionDeltas;
+	std::vector<float>	mNormalDeltas;
+
+	//! Vertices covered by the runs, moved or filling a gap.
+	size_t	getNumVertices() const { return mPositionDeltas.size() / 3; }
+	//! Append the deltas of \a vertex, which must follow the last vertex added. A target has normal deltas for all its vertices or none.
+	void	addDelta( uint32_t vertex, const ci::Vec3f& positionDelta );
+	void	addDelta( uint32_t vertex, const ci::Vec3f& positionDelta, const ci::Vec3f& normalDelta );
+};
+
+/*!
+ * Sparse target of the vertices whose position or normal moves by more than \a epsilon from the
+ * base to the target shape. Either normal array may be empty, for a target without normal deltas.
+ */
+MorphTarget createMorphTarget( const std::string& name, const std::vector<ci::Vec3f>& basePositions, const std::vector<ci::Vec3f>& targetPositions,
+							   const std::vector<ci::Vec3f>& baseNormals, const std::vector<ci::Vec3f>& targetNormals, float epsilon = 1e-6f );
+
+typedef std::shared_ptr<class MorphTargets> MorphTargetsRef;
+
+/*!
+ * Morph targets (blend shapes) of a section and their weights, set through the API or sampled from
+ * weight curves. apply() adds the deltas of the targets with a non-zero weight to the base vertices;
+ * meshes run it before skinning. The weight version changes whenever a weight does, so that meshes
+ * only re-apply the targets when needed. Each mesh loads its own set, its vertex order following the
+ * vertex reordering the mesh does at load.
+ */
+class MorphTargets {
+public:
+	static MorphTargetsRef create() { return MorphTargetsRef( new MorphTargets() ); }
+
+	void				addTarget( const MorphTarget& target );
+	size_t				getNumTargets() const { return mTargets.size(); }
+	const MorphTarget&	getTarget( size_t target ) const { return mTargets[target]; }
+	//! Index of the target named \a name, -1 if there is none.
+	int					findTarget( const std::string& name ) const;
+
+	void		setWeight( size_t target, float weight );
+	float		getWeight( size_t target ) const { return mWeights[target]; }
+	//! Set every weight to 0.
+	void		resetWeights();
+	//! Whether any target has a non-zero weight.
+	bool		hasActiveTargets() const { return mNumActiveTargets > 0; }
+	//! Incremented on every weight change.
+	uint64_t	getWeightVersion() const { return mWeightVersion; }
+
+	//! Weight curves of animation \a animId, to which keyframes are then added, in ticks as bone tracks.
+	void		addWeightTrack( int animId, float duration, float ticksPerSecond );
+	void		addWeightKeyframe( int animId, size_t target, float time, float weight );
+	bool		hasWeightTrack( int animId ) const { return mWeightTracks.count( animId ) > 0; }
+	//! Set the weights of the targets animated by \a animId to their value at \a time. Other weights are left as they are.
+	void		animate( float time, int animId = 0 );
+
+	/*!
+	 * Write the base vertices with the active targets applied to \a positions and \a normals (skipped when
+	 * null). Targets with a zero weight cost nothing; the others add their deltas run by run.
+	 * Normals are not renormalized, the skinning and the shaders handle unnormalized normals.
+	 */
+	void		apply( const ci::Vec3f* basePositions, const ci::Vec3f* baseNormals, ci::Vec3f* positions, ci::Vec3f* normals, size_t nbVertices ) const;
+
+	/*!
+	 * Follow a reordering or duplication of the vertices, \a remap giving the source vertex of each
+	 * new vertex as returned by sortByInfluenceCount() and partitionBones().
+	 */
+	void		remapVertices( const std::vector<uint32_t>& remap );
+	//! Follow a transformation baked into the base vertices (see transformVertices()).
+	void		transform( const ci::Matrix44f& transformation );
+	//! Largest displacement of a vertex with every weight within [0, 1], to keep the section bounds conservative.
+	float		getMaxDisplacement() const;
+
+	MemoryStats	getMemoryStats() const;
+private:
+	MorphTargets() : mNumActiveTargets( 0 ), mWeightVersion( 0 ) { }
+
+	struct WeightCurve {
+		size_t				mTarget;
+		AnimCurve<float>	mCurve;
+	};
+	struct WeightTrack {
+		//! Time base of the curves.
+		std::shared_ptr<AnimTrack>	mTrack;
+		std::vector<WeightCurve>	mCurves;
+	};
+
+	std::vector<MorphTarget>		mTargets;
+	std::vector<float>				mWeights;
+	size_t							mNumActiveTargets;
+	uint64_t						mWeightVersion;
+	std::map<int, WeightTrack>		mWeightTracks;
+};
+
+} //end namespace model
@@ -12,6 +12,7 @@
 
 #include "cinder/Matrix44.h"
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -24,8 +25,22 @@ class Node {
 public:
 	enum RenderMode { CONNECTED, JOINTS };
 	
+	//! Relative and absolute transformations of the node in a given pose, as saved and restored by a PoseCache.
+	struct PoseState {
+		ci::Vec3f	mRelativePosition, mRelativeScale, mAbsolutePosition, mAbsoluteScale;
+		ci::Quatf	mRelativeRotation, mAbsoluteRotation;
+		bool		mIsAnimated;
+	};
+	
+	typedef std::unordered_map< int, std::shared_ptr<AnimTrack>, std::hash<int>, std::equal_to<int>,
+								ArenaAllocator< std::pair<const int, std::shared_ptr<AnimTrack> > > > AnimTrackMap;
+	
+	//! The node, its track map and the tracks added later on are allocated from \a arena when one is given.
+	static NodeRef create( const ci::Vec3f& position, const ci::Quatf& rotation, const ci::Vec3f& scale,
+						   const std::string& name, NodeRef parent = nullptr, int level = 0, const ArenaRef& arena = nullptr );
+	
 	explicit Node( const ci::Vec3f& position, const ci::Quatf& rotation, const ci::Vec3f& scale,
-				   const std::string& name, NodeRef parent = nullptr, int level = 0 );
+				   const std::string& name, NodeRef parent = nullptr, int level = 0, const ArenaRef& arena = nullptr );
 	
 	NodeRef clone() const;
 	
@@ -45,6 +60,11 @@ public:
 	const std::string&	getName() const { return mName; }
 	void				setName( const std::string& name ) { mName = name; }
 	
+	/*!
+	 * Relative transformations are expressed in the parent's space. After Skeleton::collapseStaticNodes(),
+	 * the children of the folded helpers have their new parent's space: their relative and initial relative
+	 * transformations then include the folded helpers' transformations.
+	 */
 	ci::Vec3f&				getRelativePosition() { return mRelativePosition; }
 	const ci::Vec3f&		getRelativePosition() const { return mRelativePosition; }
 	ci::Quatf&				getRelativeRotation() { return mRelativeRotation; }
@@ -74,10 +94,55 @@ public:
 	
 	void					resetToInitial();
 	
+	//! Relative transformation at \a time of track \a trackId, leaving the node untouched. Nodes without the track keep their current one.
+	void					sampleRelative( float time, int trackId, ci::Vec3f* position, ci::Quatf* rotation, ci::Vec3f* scale ) const;
+	/*!
+	 * Turn a relative transformation into an absolute one given the parent's absolute transformation,
+	 * as the node does when updated.
+	 */
+	static void				composeTransformation( const ci::Vec3f& parentPosition, const ci::Quatf& parentRotation, const ci::Vec3f& parentScale,
+												   ci::Vec3f* position, ci::Quatf* rotation, ci::Vec3f* scale );
+	static void				computeTransformation( const ci::Vec3f& t, const ci::Quatf& r, const ci::Vec3f& s,  ci::Matrix44f* transformation );
+	/*!
+	 * Fold the static transformation of a removed parent into the node: its relative and initial
+	 * transformations and its keyframes are composed with it, so that its absolute transformation is unchanged.
+	 */
+	void					foldParentTransformation( const ci::Vec3f& position, const ci::Quatf& rotation, const ci::Vec3f& scale );
+	//! Whether the relative scale is uniform in the current and initial transformations and in every scaling keyframe.
+	bool					hasUniformScale() const;
+	
+	/*!
+	 * Pose version of the hierarchy the node belongs to, held by its root. It changes whenever a relative
+	 * transformation is set or the skeleton is posed, and is never reused, even across hierarchies, so that
+	 * meshes can skip skinning a pose they already skinned. The only exception are the skeletons restored
+	 * to a pose saved in a PoseCache, which share the version of that pose.
+	 */
+	uint64_t				getPoseVersion() const;
+	//! Give the hierarchy a new pose version. Call it after editing the transformation through the non-const accessors.
+	void					touchPose();
+	//! Give the hierarchy the version recorded along with a saved pose, which it is restored to.
+	void					setPoseVersion( uint64_t poseVersion );
+	
+	void					savePoseState( PoseState* state ) const;
+	/*!
+	 * Restore saved transformations without dirtying the subtree: the whole hierarchy is expected to be
+	 * restored to the same pose, as Skeleton::restorePose() does.
+	 */
+	void					restorePoseState( const PoseState& state );
+	
 	int		getLevel() const { return mLevel; }
 	void	setLevel( int level ) { mLevel = level; }
 	int		getBoneIndex() const { return mBoneIndex; }
 	void	setBoneIndex( int boneIndex ) { mBoneIndex = boneIndex; }
+	//! Coarsest skeleton LOD at which this node is still evaluated (0 means full detail only).
+	int		getLodLevel() const { return mLodLevel; }
+	void	setLodLevel( int lodLevel ) { mLodLevel = lodLevel; }
+	//! Summed skinning weights of the vertices bound to this bone.
+	float	getInfluence() const { return mInfluence; }
+	void	addInfluence( float weight ) { mInfluence += weight; }
+	
+	//! Arena holding the node's animation data, if any.
+	ArenaRef	getArena() const { return mAnimTracks.get_allocator().getArena(); }
 	
 	// Animation functions
 	void	addAnimTrack( int trackId, float duration, float ticksPerSecond );
@@ -86,6 +151,8 @@ public:
 	void	addScalingKeyframe( int trackId, float time, const ci::Vec3f& scaling );
 	
 	bool	isAnimated() const { return mIsAnimated; }
+	//! Whether the node has keyframes in any animation.
+	bool	hasAnimTracks() const { return ! mAnimTracks.empty(); }
 	float	getTime() { return mTime; }
 	
 	/*! 
@@ -100,6 +167,12 @@ public:
 	void		setOffsetMatrix( const ci::Matrix44f& offset ) { mOffset =  std::unique_ptr<ci::Matrix44f>( new ci::Matrix44f(offset) ); }
 	const std::unique_ptr<ci::Matrix44f>& getOffset() { return mOffset; }
 	
+	//! Bytes held by the node itself (name, children, offset matrix), excluding its animation tracks.
+	size_t		getMemoryUsage() const;
+	//! Bytes held by the node's animation tracks.
+	size_t		getAnimMemoryUsage() const;
+	size_t		getAnimMemoryUsage( int trackId ) const;
+	
 	bool operator==( Node &rhs )
 	{
 		return (	getName() == rhs.getName()
@@ -111,14 +184,17 @@ public:
 		return !(*this == rhs);
 	}
 protected:
+	friend class PoseEdit;
 	
-	static void computeTransformation( const ci::Vec3f& t, const ci::Quatf& r, const ci::Vec3f& s,  ci::Matrix44f* transformation );
-
 	void	update() const;
+	//! Update the node and all its descendants, parents first.
+	void	updateSubtree() const;
 	void	requestSubtreeUpdate();
 	bool	hasAnimations( int trackId = 0 ) const;
 	
 	mutable bool		mNeedsUpdate;
+	//! Only meaningful on the root node.
+	uint64_t			mPoseVersion;
 	ci::Vec3f			mRelativePosition, mRelativeScale;
 	ci::Quatf			mRelativeRotation;
 	mutable ci::Vec3f	mAbsolutePosition, mAbsoluteScale;
@@ -141,6 +217,8 @@ protected:
 	std::string	mName;
 	int			mLevel;
 	int			mBoneIndex;
+	int			mLodLevel;
+	float		mInfluence;
 	
 	/*!
 	 * An unordered_map storing the different animation tracks with
@@ -148,7 +226,7 @@ protected:
 	 * This data-structure was chosen because a bone may be
 	 * animated in some animation tracks, and not in others.
 	 * */
-	std::unordered_map< int, std::shared_ptr<AnimTrack> >	mAnimTracks;
+	AnimTrackMap	mAnimTracks;
 private:
 	Node( const Node &rhs ); // private to prevent copying; use clone() method instead
 	Node& operator=( const Node &rhs ); // not defined to prevent copying
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "Skeleton.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace model {
+
+/*!
+ * Poses shared between the instances of a skeleton which play the same clip at (nearly) the same time,
+ * as in crowds. Poses are keyed by skeleton definition, clip, active bone LOD and time quantized to
+ * \a timeStep seconds. A hit restores the node transformations saved on the miss, without sampling any
+ * curve, and hands the skeleton the palette computed on the miss, so that meshes skip building it.
+ * Restored skeletons share the pose version of the cached pose: a mesh drawing several instances in the
+ * same pose in a row only skins it once. At most \a capacity poses are kept, the least recently used
+ * ones being evicted first. Once the cache is full, a miss recycles the buffers of the evicted pose and
+ * neither hits nor misses allocate. Not thread-safe.
+ */
+class PoseCache {
+public:
+	struct Stats {
+		Stats() : mHits( 0 ), mMisses( 0 ), mEvictions( 0 ) { }
+		float	getHitRate() const { return ( mHits + mMisses > 0 ) ? float( mHits ) / float( mHits + mMisses ) : 0.0f; }
+
+		size_t	mHits, mMisses, mEvictions;
+	};
+
+	explicit PoseCache( size_t capacity = 64, float timeStep = 1.0f / 120.0f );
+
+	/*!
+	 * Pose \a skeleton at \a time of animation \a animId, rounded to the time step, from the cache when
+	 * the pose was already evaluated. Returns true on a hit.
+	 */
+	bool	setPose( const SkeletonRef& skeleton, float time, int animId = 0 );
+
+	size_t	getCapacity() const { return mCapacity; }
+	//! Evicts the least recently used poses beyond \a capacity.
+	void	setCapacity( size_t capacity );
+	float	getTimeStep() const { return mTimeStep; }
+	size_t	getNumPoses() const { return mPoses.size(); }
+
+	const Stats&	getStats() const { return mStats; }
+	void			resetStats() { mStats = Stats(); }
+	void			clear();
+
+	//! Memory held by the cached poses and palettes.
+	MemoryStats		getMemoryStats() const;
+private:
+	struct Key {
+		uint64_t	mDefinitionId;
+		int			mAnimId, mLod;
+		int64_t		mTimeStep;
+
+		bool operator==( const Key& rhs ) const
+		{
+			return mDefinitionId == rhs.mDefinitionId && mAnimId == rhs.mAnimId && mLod == rhs.mLod && mTimeStep == rhs.mTimeStep;
+		}
+	};
+	struct Pose {
+		Key								mKey;
+		std::vector<Node::PoseState>	mStates;
+		std::shared_ptr<PosePalette>	mPalette;
+		//! Neighbours in the recency list, -1 at its ends.
+		int								mPrev, mNext;
+	};
+
+	size_t	getHomeBucket( const Key& key ) const;
+	//! Bucket holding \a key, or the empty bucket where it would be inserted.
+	size_t	findBucket( const Key& key ) const;
+	void	eraseBucket( size_t bucket );
+	void	rebuildBuckets();
+	void	unlink( int pose );
+	void	pushFront( int pose );
+
+	size_t	mCapacity;
+	float	mTimeStep;
+	std::vector<Pose>	mPoses;
+	//! Most and least recently used poses.
+	int		mHead, mTail;
+	//! Open addressing index of the poses (-1 for empty buckets), at most half full.
+	std::vector<int>	mBuckets;
+	Stats	mStats;
+};
+
+} //end namespace model
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Node.h"
+
+#include <vector>
+
+namespace model {
+
+/*!
+ * Batch of procedural edits of relative bone transformations (IK, look-at, physics driven bones).
+ * The Node setters dirty the subtree of the edited node on every call; a PoseEdit records the
+ * edits instead, and commit() applies them at once: each affected subtree is recomputed a single
+ * time, parents first, and the pose version is changed once. Keep the edit around from frame to
+ * frame to reuse its buffer. Edits still pending are committed when the edit is destroyed.
+ */
+class PoseEdit {
+public:
+	PoseEdit() { }
+	~PoseEdit() { commit(); }
+
+	void	setRelativePosition( const NodeRef& node, const ci::Vec3f& position );
+	void	setRelativeRotation( const NodeRef& node, const ci::Quatf& rotation );
+	void	setRelativeScale( const NodeRef& node, const ci::Vec3f& scale );
+
+	//! Apply the pending edits, a later edit of the same node overriding an earlier one.
+	void	commit();
+	//! Drop the pending edits without applying them.
+	void	cancel() { mEdits.clear(); }
+
+	size_t	getNumEdits() const { return mEdits.size(); }
+	bool	isEmpty() const { return mEdits.empty(); }
+private:
+	PoseEdit( const PoseEdit& );
+	PoseEdit& operator=( const PoseEdit& );
+
+	enum Field { POSITION, ROTATION, SCALE };
+
+	struct Edit {
+		NodeRef		mNode;
+		Field		mField;
+		ci::Vec3f	mVector;
+		ci::Quatf	mRotation;
+	};
+
+	std::vector<Edit>	mEdits;
+};
+
+} //end namespace model
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "cinder/Cinder.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//! Define MODEL_PROFILING (preprocessor definition) to compile the instrumentation in.
+//! Otherwise the macros below expand to nothing and the hot paths are left untouched.
+#ifdef MODEL_PROFILING
+#define MODEL_PROFILE_CONCAT_IMPL( a, b ) a##b
+#define MODEL_PROFILE_CONCAT( a, b ) MODEL_PROFILE_CONCAT_IMPL( a, b )
+#define MODEL_PROFILE_SCOPE( name ) model::ProfileZone MODEL_PROFILE_CONCAT( profileZone, __LINE__ )( name )
+#define MODEL_PROFILE_COUNT( counter, n ) model::Profiler::instance().add( model::Profiler::counter, n )
+#else
+#define MODEL_PROFILE_SCOPE( name )
+#define MODEL_PROFILE_COUNT( counter, n )
+#endif
+
+namespace model {
+
+struct ProfileCounters {
+	ProfileCounters() : mBonesEvaluated( 0 ), mVerticesSkinned( 0 ), mDrawCalls( 0 ), mBytesUploaded( 0 ), mStateChanges( 0 ) { }
+	uint64_t	mBonesEvaluated;
+	uint64_t	mVerticesSkinned;
+	uint64_t	mDrawCalls;
+	uint64_t	mBytesUploaded;
+	//! Program, texture, material and cull mode changes issued by the render queue.
+	uint64_t	mStateChanges;
+};
+
+//! Time spent in a profiled zone during one frame.
+struct ProfileZoneTime {
+	const char*	mName;
+	double		mMilliseconds;
+	uint32_t	mCalls;
+};
+
+/*!
+ * Collects the scoped zone timings and the per-frame counters of the block (bones evaluated,
+ * vertices skinned, draw calls, bytes uploaded to the GPU and state changes). Call beginFrame() once per frame,
+ * then read the last completed frame with getFrameCounters() and getFrameZoneTimes().
+ *
+ * When trace capture is enabled, every zone is also recorded and can be exported with
+ * writeChromeTrace() (chrome://tracing or Perfetto format).
+ */
+class Profiler {
+public:
+	enum Counter { BONES_EVALUATED, VERTICES_SKINNED, DRAW_CALLS, BYTES_UPLOADED, STATE_CHANGES, NB_COUNTERS };
+
+	virtual ~Profiler() { }
+	static Profiler& instance();
+	//! True when the block was compiled with MODEL_PROFILING.
+	static bool		isCompiledIn();
+
+	void			add( Counter counter, uint64_t n ) { mCounters[counter].fetch_add( n, std::memory_order_relaxed ); }
+	void			recordZone( const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end );
+
+	//! Closes the current frame: its counters and zone times become the ones returned by the getters below.
+	void			beginFrame();
+	ProfileCounters	getFrameCounters() const;
+	std::vector<ProfileZoneTime>	getFrameZoneTimes() const;
+
+	//! Trace events are only recorded while capture is enabled, up to \a maxEvents.
+	void			setCaptureEnabled( bool enabled, size_t maxEvents = 1 << 20 );
+	bool			isCaptureEnabled() const { return mCaptureEnabled; }
+	size_t			getNumTraceEvents() const;
+	void			clearTrace();
+	//! Writes the captured zones, along with one counter sample per frame, in the Chrome trace event format.
+	void			writeChromeTrace( const ci::fs::path& path ) const;
+private:
+	Profiler();
+	Profiler(const Profiler& that);
+	Profiler& operator=(const Profiler&);
+
+	struct TraceEvent {
+		const char*	mName;
+		double		mStartUs, mDurationUs;
+		uint32_t	mThread;
+	};
+
+	struct CounterSample {
+		double			mTimeUs;
+		ProfileCounters	mCounters;
+	};
+
+	double		toMicroseconds( std::chrono::steady_clock::time_point time ) const;
+	uint32_t	getThreadIndex();
+
+	static std::unique_ptr<Profiler> mInstance;
+	static std::once_flag mOnceFlag;
+
+	std::array<std::atomic<uint64_t>, NB_COUNTERS>	mCounters;
+	ProfileCounters						mFrameCounters;
+	std::vector<ProfileZoneTime>		mZoneTimes, mFrameZoneTimes;
+
+	std::atomic<bool>					mCaptureEnabled;
+	size_t								mMaxEvents;
+	std::vector<TraceEvent>				mTraceEvents;
+	std::vector<CounterSample>			mCounterSamples;
+	std::vector<std::thread::id>		mThreads;
+	std::chrono::steady_clock::time_point	mEpoch;
+	mutable std::mutex					mMutex;
+};
+
+//! Times the enclosing scope. \a name must outlive the profiler (typically a string literal).
+class ProfileZone {
+public:
+	explicit ProfileZone( const char* name )
+	: mName( name ), mStart( std::chrono::steady_clock::now() )
+	{ }
+	~ProfileZone()
+	{
+		Profiler::instance().recordZone( mName, mStart, std::chrono::steady_clock::now() );
+	}
+private:
+	const char*								mName;
+	std::chrono::steady_clock::time_point	mStart;
+};
+
+} //end namespace model
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "RenderState.h"
+#include "SkinnedVboMesh.h"
+
+#include "cinder/gl/Material.h"
+#include "cinder/gl/Texture.h"
+#include "cinder/Matrix44.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace model {
+
+class PaletteBuffer;
+
+/*!
+ * Deferred draws of SkinnedVboMesh sections. Submitting a mesh records its sections with the current
+ * model view and a copy of its palette, so that a single mesh can be updated and submitted once per
+ * instance. SkinningRenderer::draw( RenderQueue& ) then sorts the draws by render state and issues them,
+ * applying only the state that changes from one draw to the next.
+ *
+ * Sorting and state filtering are done by a RenderOrder, without OpenGL. The submitted meshes must outlive the flush.
+ */
+class RenderQueue {
+public:
+	//! Copy of the skeleton palette of a submitted mesh, shared by its sections.
+	struct Palette {
+		std::vector<ci::Matrix44f>	mBoneMatrices, mInvTransposeMatrices;
+		//! Palette buffer of the mesh, null with uniform palettes.
+		PaletteBuffer*				mBuffer;
+		//! Index of the palette among those uploaded to mBuffer by uploadPalettes(), to select before drawing.
+		size_t						mBufferPalette;
+	};
+	
+	struct Item {
+		const SkinnedVboMesh::MeshSection*	mSection;
+		ci::Matrix44f						mModelView;
+		//! Index of the palette, -1 for the bind pose.
+		int									mPalette;
+	};
+	
+	RenderQueue();
+	
+	//! Queue the sections of \a mesh with the current model view.
+	void	submit( const SkinnedVboMeshRef& mesh );
+	//! Queue the sections of \a mesh with \a modelView. Sections with a default transformation append it.
+	void	submit( const SkinnedVboMeshRef& mesh, const ci::Matrix44f& modelView );
+	//! Queue a draw with an explicit state, without any OpenGL resource.
+	void	submit( const RenderState& state, const SkinnedVboMesh::MeshSection* section, const ci::Matrix44f& modelView, int palette = -1 );
+	
+	//! Sort the draws by state key. Draws with the same key keep their submission order.
+	void	sort();
+	//! Upload the palettes of every palette buffer at once, each palette to its own slices.
+	void	uploadPalettes();
+	//! Remove every draw, keeping the memory for the next frame.
+	void	clear();
+	
+	bool	empty() const { return mItems.empty(); }
+	size_t	size() const { return mItems.size(); }
+	//! Draw \a i in sorted order, once sort() was called.
+	const Item&			getSortedItem( size_t i ) const { return mItems[ mOrder.getSortedIndex( i ) ]; }
+	const RenderState&	getSortedState( size_t i ) const { return mOrder.getSortedState( i ); }
+	//! Number of state changes of the sorted draws, after filtering out the redundant ones.
+	size_t				getNumStateChanges() const { return mOrder.getNumStateChanges(); }
+	
+	const ci::gl::Texture&		getTexture( uint32_t index ) const { return mTextures[ index - 1 ]; }
+	const ci::gl::Material&		getMaterial( uint32_t index ) const { return *mMaterials[ index - 1 ]; }
+	const Palette&				getPalette( int index ) const { return mPalettes[ index ]; }
+private:
+	uint32_t	internTexture( const ci::gl::Texture& texture );
+	uint32_t	internMaterial( const ci::gl::Material* material );
+	
+	std::vector<Item>							mItems;
+	//! States of the items, in the same order.
+	RenderOrder									mOrder;
+	//! Palettes in use are the first mNumPalettes, the others are kept for their memory.
+	std::vector<Palette>						mPalettes;
+	size_t										mNumPalettes;
+	//! Scratch of uploadPalettes(): the distinct palette buffers and the palettes of one of them.
+	std::vector<PaletteBuffer*>					mBuffers;
+	std::vector<const std::vector<ci::Matrix44f>*>	mBufferPalettes;
+	//! Few distinct textures and materials are expected per queue: they are looked up linearly. Materials
+	//! are compared by address, so the instances of a mesh share theirs.
+	std::vector<ci::gl::Texture>				mTextures;
+	std::vector<const ci::gl::Material*>		mMaterials;
+};
+
+} //end namespace model
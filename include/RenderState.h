@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace model {
+
+/*!
+ * Render state of a queued draw: the shader permutation, the texture, the material and the cull mode.
+ * Textures and materials are ids interned by the render queue, 0 standing for none, so that the
+ * state is plain data and sorts without OpenGL.
+ */
+struct RenderState {
+	RenderState() : mFeatures( 0 ), mTexture( 0 ), mMaterial( 0 ), mCullFace( true ) { }
+
+	//! ShaderFeatures bits of the permutation.
+	uint32_t		mFeatures;
+	uint32_t		mTexture;
+	uint32_t		mMaterial;
+	bool			mCullFace;
+
+	//! Key grouping the draws by program first (the most expensive switch), then texture, material and cull mode.
+	uint64_t		getSortKey() const;
+};
+
+enum RenderStateChange {
+	CHANGE_PROGRAM		= 1 << 0,
+	CHANGE_TEXTURE		= 1 << 1,
+	CHANGE_MATERIAL		= 1 << 2,
+	CHANGE_CULL_FACE	= 1 << 3,
+	CHANGE_ALL			= CHANGE_PROGRAM | CHANGE_TEXTURE | CHANGE_MATERIAL | CHANGE_CULL_FACE
+};
+
+//! State to apply between two consecutive draws, every state for the first draw (a null \a previous).
+uint32_t	getStateChanges( const RenderState* previous, const RenderState& next );
+//! Number of states set by \a changes.
+size_t		countStateChanges( uint32_t changes );
+
+/*!
+ * Draw order of a render queue: the states of the draws in submission order and their order sorted
+ * by key. Draws with the same key keep their submission order.
+ */
+class RenderOrder {
+public:
+	//! Append a draw, returning its submission index.
+	uint32_t	add( const RenderState& state );
+	void		sort();
+	//! Remove every draw, keeping the memory for the next frame.
+	void		clear();
+
+	bool		empty() const { return mStates.empty(); }
+	size_t		size() const { return mStates.size(); }
+	//! Submission index of draw \a i in sorted order, once sort() was called.
+	uint32_t			getSortedIndex( size_t i ) const { return mOrder[i].second; }
+	const RenderState&	getSortedState( size_t i ) const { return mStates[ mOrder[i].second ]; }
+	//! Number of state changes of the sorted draws, after filtering out the redundant ones.
+	size_t				getNumStateChanges() const;
+private:
+	std::vector<RenderState>						mStates;
+	//! Sort key and submission index of each draw.
+	std::vector< std::pair<uint64_t, uint32_t> >	mOrder;
+};
+
+} //end namespace model
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "ModelIo.h"
+#include "BonePartition.h"
+
+#include "cinder/gl/Texture.h"
+#include "cinder/Vector.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace model {
+
+class AMeshSection;
+
+//! Attributes of a section staged on the cpu until its buffers are created.
+struct SectionGeometry {
+	std::vector<ci::Vec3f>		mPositions;
+	std::vector<ci::Vec3f>		mNormals;
+	std::vector<ci::Vec2f>		mTexCoords;
+	std::vector<BoneWeights>	mBoneWeights;
+	std::vector<uint32_t>		mIndices;
+	//! Sub-section of each vertex, for merged sections. Empty for a single section.
+	std::vector<uint32_t>		mVertexSubSections;
+	
+	bool	empty() const { return mPositions.empty() && mIndices.empty(); }
+	void	clear();
+};
+
+//! Part of a mesh section coming from one section of the model source, which can be hidden on its own.
+struct SubSection {
+	SubSection() : mSourceIndex( 0 ), mVisible( true ) { }
+	int		mSourceIndex;
+	bool	mVisible;
+};
+
+//! Contiguous triangles of one sub-section.
+struct SubSectionRange {
+	size_t		mFirstIndex, mNumIndices;
+	uint32_t	mSubSection;
+};
+
+/*!
+ * Whether two sections can be drawn as one: same kind of skinning, same attributes, same default
+ * transformation and same material, and no morph targets. Their textures may only differ if \a allowAtlas is set and both
+ * sections have texture coordinates within [0, 1].
+ */
+bool	canMergeSections( const AMeshSection& a, const SectionGeometry& geometryA, const AMeshSection& b, const SectionGeometry& geometryB, bool allowAtlas );
+//! Texture coordinates within [0, 1], that can be remapped into an atlas without wrapping.
+bool	hasNormalizedTexCoords( const std::vector<ci::Vec2f>& texCoords );
+
+//! Concatenate \a parts, each becoming the sub-section of its index.
+SectionGeometry	mergeGeometry( const std::vector<const SectionGeometry*>& parts );
+
+/*!
+ * Reorder the triangles of each batch (or of the whole section without batches) by sub-section, so that
+ * each sub-section covers one range per batch. Returns the ranges, in index order. Without vertex
+ * sub-sections, the ranges are the batches of sub-section 0.
+ */
+std::vector<SubSectionRange>	sortBySubSection( std::vector<uint32_t>* indices, const std::vector<BoneBatch>& batches, const std::vector<uint32_t>& vertexSubSections );
+
+//! Texel rectangle of a texture packed into an atlas.
+struct AtlasRect {
+	int	mX, mY, mWidth, mHeight;
+};
+
+struct AtlasLayout {
+	ci::Vec2i				mSize;
+	std::vector<AtlasRect>	mRects;
+};
+
+/*!
+ * Shelf packing of textures of \a sizes into a power of two atlas no larger than \a maxSize, keeping
+ * \a padding texels between them against filtering bleed. Returns false if they do not fit.
+ */
+bool	packAtlas( const std::vector<ci::Vec2i>& sizes, int maxSize, int padding, AtlasLayout* layout );
+//! Map texture coordinates of a texture to its rectangle in the atlas.
+void	remapTexCoords( std::vector<ci::Vec2f>* texCoords, const AtlasRect& rect, const ci::Vec2i& atlasSize );
+//! Read back \a textures and copy them into a new texture as laid out by \a layout.
+ci::gl::Texture	createAtlasTexture( const std::vector<ci::gl::Texture>& textures, const AtlasLayout& layout );
+
+} //end namespace model
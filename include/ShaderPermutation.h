@@ -0,0 +1,53 @@
+#pragma once
+
+#include "cinder/gl/gl.h"
+#include "cinder/gl/GlslProg.h"
+
+#include <cstdint>
+#include <string>
+
+namespace model {
+
+/*!
+ * Feature bits of a permutation of the default skinning shader. Each feature maps to a define
+ * of the shader sources, so that a permutation only compiles the attributes and the math it uses.
+ */
+typedef uint32_t ShaderFeatures;
+
+enum ShaderFeature {
+	//! Blend the bone palette transforms (SKINNED). Static permutations skip the skinning math.
+	SHADER_SKINNED			= 1 << 0,
+	//! Lit with vertex normals (HAS_NORMALS).
+	SHADER_NORMALS			= 1 << 1,
+	//! Sample the diffuse texture (HAS_TEXTURE).
+	SHADER_TEXTURE			= 1 << 2,
+	//! Dequantize PackedVertex attributes (PACKED_VERTICES).
+	SHADER_PACKED_VERTICES	= 1 << 3,
+	//! Read the palette from the "BonePalette" uniform block (BONE_PALETTE_UBO).
+	SHADER_PALETTE_BUFFER	= 1 << 4,
+	//! Transform normals with the "normalPalette" rows rather than the upper 3x3 of the bones (NORMAL_PALETTE).
+	//! Only drawn while a bone is non-uniformly scaled, so that the other permutations do not reserve its uniforms.
+	SHADER_NORMAL_PALETTE	= 1 << 5
+};
+
+//! Bone influences blended per vertex by a skinned permutation, from 1 to 4 (MAX_INFLUENCES).
+ShaderFeatures	setMaxInfluences( ShaderFeatures features, int maxInfluences );
+int				getMaxInfluences( ShaderFeatures features );
+//! Preamble defining the features, to prepend to the vertex and fragment sources.
+std::string		getShaderDefines( ShaderFeatures features );
+
+//! Vertex attributes of the skinning shaders.
+enum VertexSemantic { ATTRIB_POSITION, ATTRIB_NORMAL, ATTRIB_TEXCOORD, ATTRIB_BONE_WEIGHTS, ATTRIB_BONE_INDICES, NB_VERTEX_SEMANTICS };
+
+//! Name of the shader attribute of \a semantic.
+const char*		getAttribName( VertexSemantic semantic );
+
+//! Attribute locations of a shader, resolved once per shader. Locations of attributes the shader does not use are -1.
+struct ShaderAttribs {
+	//! Cached per shader until it is released.
+	static const ShaderAttribs&	get( const ci::gl::GlslProgRef& shader );
+	
+	GLint	mLocations[NB_VERTEX_SEMANTICS];
+};
+
+} //end namespace model
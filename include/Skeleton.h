@@ -20,6 +20,12 @@ namespace model {
 
 typedef std::shared_ptr< class Skeleton> SkeletonRef;
 
+//! Bone palette of a pose, computed once and shared by the skeletons restored to that pose (see PoseCache).
+struct PosePalette {
+	uint64_t					mPoseVersion;
+	std::vector<ci::Matrix44f>	mBoneMatrices, mInvTransposeMatrices;
+};
+
 /** 
  * The skeleton is composed of a hierachy of nodes, some of which are its bones.
  * Its bones are internally identified by a map from std::string names to NodeRef(s).
@@ -36,22 +42,39 @@ public:
 	enum RenderMode { FULL, CLEANED };
 	static enum RenderMode mRenderMode;
 	
+	/**
+	 * Criterion used to rank bones when generating LOD bone sets.
+	 * DEPTH keeps the bones closest to the root (spine and limbs before fingers and facial bones).
+	 * INFLUENCE keeps the bones carrying the most skinning weight.
+	 */
+	enum LodCriterion { LOD_DEPTH, LOD_INFLUENCE };
+	
 	static SkeletonRef create() { return SkeletonRef( new Skeleton() ); }
 	//! Initialize a skeleton with bone names first so that when bones are created, we can set their bone index with findBoneIndex (used for gpu skinning)
 	static SkeletonRef create( const std::unordered_set<std::string>& boneNames );
 	static SkeletonRef create( NodeRef root, std::map<std::string, NodeRef> boneNames ) { return SkeletonRef( new Skeleton( root, boneNames ) ); }
 	
+	virtual ~Skeleton();
+	
 	//! Deep copy of the node hierarchy and names map. Heavy, non-recommended operation. Prefer extracting different informations out of the same skeleton.
 	virtual SkeletonRef clone() const;
 	
 	virtual void setPoseDefault() override;
-	//! Update animation pose to specific time. (FIXME: If time exceeds bounds, only cyclic behavior for now.)
+	/*!
+	 * Update animation pose to specific time. (FIXME: If time exceeds bounds, only cyclic behavior for now.)
+	 * Posing again at the same time and animation does nothing, unless a node was edited or the LOD changed in between.
+	 */
 	virtual void setPose( float time, int animId = 0 ) override;
 	
 	virtual void setBlendedPose( float time, const std::unordered_map<int, float>& weights )override;
 	
 	const NodeRef&	getRootNode() const { return mRootNode; }
-	void			setRootNode( const NodeRef& root ) { mRootNode = root; }
+	void			setRootNode( const NodeRef& root );
+	/*!
+	 * Identifies the node hierarchy and animations of the skeleton, so that poses can be shared between the
+	 * instances using it. Changed by setRootNode() and collapseStaticNodes(); clones get their own.
+	 */
+	uint64_t		getDefinitionId() const { return mDefinitionId; }
 	
 	int				findBoneIndex( const std::string& name ) const;
 	bool			hasBone( const std::string& name ) const;
@@ -65,13 +88,84 @@ public:
 	
 	NodeRef			getNode( const std::string& name) const;
 	
-	void			traverseNodes( const NodeRef& node, std::function<void(NodeRef)> visit ) const;
+	void			traverseNodes( const NodeRef& node, const std::function<void(const NodeRef&)>& visit ) const;
+	size_t			getNumNodes() const;
+	
+	/*!
+	 * Fold static helper nodes (neither bones, animated nor listed in \a pinnedNodes) into their children
+	 * and remove them from the hierarchy, so that posing visits fewer nodes. Since scales apply componentwise
+	 * before rotations, a rotated helper is only folded when its parent's absolute scale is uniform in every
+	 * pose (no non-uniform scale in the relative transformations or keyframes of the parent and its
+	 * ancestors); absolute transformations are then unchanged, but the relative transformations and
+	 * keyframes of the children now include the folded nodes' (blended poses, which mix rotations starting
+	 * from the identity, may differ slightly). Scales set later with PoseEdit or the node setters are not
+	 * foreseen. Call it once the animations are loaded. Returns the number of nodes removed.
+	 */
+	size_t			collapseStaticNodes( const std::unordered_set<std::string>& pinnedNodes = std::unordered_set<std::string>() );
+	
+	//! Version of the current pose, changed by setPose(), setBlendedPose() and any node transformation setter (see Node::getPoseVersion()).
+	uint64_t		getPoseVersion() const { return mRootNode ? mRootNode->getPoseVersion() : 0; }
+	
+	/*!
+	 * Compute the skinning matrices (absolute transformation * offset) of the current pose along
+	 * with their inverse transposes, in bone index order. At most maxBones matrices are written.
+	 * Pass a null \a invTransposeMatrices to skip the inversions.
+	 */
+	void			computeBonePalette( ci::Matrix44f* boneMatrices, ci::Matrix44f* invTransposeMatrices, size_t maxBones ) const;
+	//! Palette already computed for the current pose: computeBonePalette() copies it for as long as the pose version matches.
+	void			setSharedPalette( const std::shared_ptr<const PosePalette>& palette ) { mSharedPalette = palette; }
+	
+	//! Transformations of every node, in traversal order.
+	void			savePose( std::vector<Node::PoseState>* states ) const;
+	//! Restore a pose saved from a skeleton of the same definition, along with its pose version.
+	void			restorePose( const std::vector<Node::PoseState>& states, uint64_t poseVersion );
+	
+	/*!
+	 * Bone LOD sets: lodBoneSets[i] lists the bones still evaluated at LOD i + 1 (LOD 0 always
+	 * evaluates every node). A bone is evaluated up to the coarsest LOD listing it, so finer sets
+	 * are implicitly extended with the bones of the coarser ones, and the ancestors of every
+	 * listed bone are kept so that the hierarchy stays consistent.
+	 */
+	void			setLodBoneSets( const std::vector< std::unordered_set<std::string> >& lodBoneSets );
+	/*!
+	 * Generate the bone LOD sets automatically. keepRatios[i] is the fraction of bones still
+	 * evaluated at LOD i + 1. Influence-based ranking falls back to depth for bones which
+	 * have no skinning weights.
+	 */
+	void			generateLodBoneSets( const std::vector<float>& keepRatios, LodCriterion criterion = LOD_INFLUENCE );
+	int				getNumLods() const { return mNumLods; }
+	int				getLod() const { return mLod; }
+	/*!
+	 * Set the active bone LOD. Bones excluded from it keep their parent-relative rest transform
+	 * and are skipped by setPose() and setBlendedPose().
+	 */
+	void			setLod( int lod );
+	//! Number of bones evaluated at a given LOD.
+	int				getNumLodBones( int lod ) const;
+	
+	/*!
+	 * Arena holding the node hierarchy and the animation data of loaded skeletons. When the skeleton
+	 * owns an arena, its nodes are detached from their parents on destruction so that the whole
+	 * hierarchy, and with it the arena, is released at once.
+	 */
+	const ArenaRef&	getArena() const { return mArena; }
+	void			setArena( const ArenaRef& arena ) { mArena = arena; }
+	
+	//! Memory held by the node hierarchy, the bone map and every animation.
+	MemoryStats		getMemoryStats() const;
+	//! Memory held by the tracks and keyframes of a single animation clip.
+	MemoryStats		getAnimMemoryStats( int animId ) const;
 protected:
-	Skeleton() { };
+	Skeleton();
 	explicit Skeleton( NodeRef root, std::map<std::string, NodeRef> boneNames );
 	
 	//! Find the node by traversing the hierarchy
 	NodeRef findNode( const std::string& name, const NodeRef& node ) const;
+	//! Traverse the hierarchy, pruning the subtrees excluded from the active LOD
+	void traverseLodNodes( const NodeRef& node, const std::function<void(const NodeRef&)>& visit ) const;
+	//! Animate the nodes of the active LOD, without going through a std::function per node
+	void animateLodNodes( const NodeRef& node, float time, int animId );
+	void blendLodNodes( const NodeRef& node, float time, const std::unordered_map<int, float>& weights );
 	
 	friend std::ostream& operator<<( std::ostream& o, const Skeleton& skeleton );
 
@@ -81,6 +175,14 @@ private:
 	
 	NodeRef mRootNode;
 	std::map<std::string, NodeRef> mBoneNames;
+	int		mLod, mNumLods;
+	ArenaRef	mArena;
+	//! Arguments and resulting pose version of the last setPose().
+	float		mPosedTime;
+	int			mPosedAnimId;
+	uint64_t	mPosedVersion;
+	uint64_t	mDefinitionId;
+	std::shared_ptr<const PosePalette>	mSharedPalette;
 };
 
 extern std::ostream& operator<<( std::ostream& lhs, const Skeleton& rhs );
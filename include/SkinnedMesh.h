@@ -1,8 +1,10 @@
 #pragma once
 
 #include "AMeshSection.h"
+#include "BonePartition.h"
 
 #include "cinder/TriMesh.h"
+#include "cinder/Frustum.h"
 
 #include <vector>
 #include <string>
@@ -11,6 +13,8 @@ class model::Skeleton;
 
 namespace model {
 
+class AnimLodState;
+
 typedef std::shared_ptr< class SkinnedMesh > SkinnedMeshRef;
 
 class SkinnedMesh
@@ -19,18 +23,38 @@ public:
 	struct MeshSection : public AMeshSection
 	{
 		MeshSection() : AMeshSection() { }
+		//! Skins the vertices, or only the rigid bone transformation of rigid sections.
 		void updateMesh( bool enableSkinning = true ) override;
+		ci::Matrix44f getRigidTransformation() const override { return mRigidTransformation; }
+		MemoryStats getMemoryStats() const override;
+		/*!
+		 * Reorder the vertices by influence count (see sortByInfluenceCount()), so that updateMesh() skins
+		 * each run with a kernel specialized for its count. Done at load; updateMesh() sorts unsorted sections.
+		 */
+		void sortVerticesByInfluence();
+		//! Write the bind pose vertices, morphed or not, to the trimesh.
+		void copyVertices( const ci::Vec3f* positions, const ci::Vec3f* normals );
 		
 		std::string mName;
 		ci::TriMesh mTriMesh;
 		std::vector< ci::Vec3f > mInitialPositions;
 		std::vector< ci::Vec3f > mInitialNormals;
+		//! Bind pose vertices with the morph targets applied, skinned instead of the initial ones while a target is active.
+		std::vector< ci::Vec3f > mMorphedPositions;
+		std::vector< ci::Vec3f > mMorphedNormals;
+		ci::Matrix44f mRigidTransformation;
+		InfluenceRuns mInfluenceRuns;
+		//! Skinning matrix of every bone, computed once per update.
+		std::vector< ci::Matrix44f > mSkinningMatrices;
 	};
 	typedef std::shared_ptr< struct SkinnedMesh::MeshSection > MeshSectionRef;
 	
 	static SkinnedMeshRef create( ModelSourceRef modelSource, std::shared_ptr<Skeleton> skeleton = nullptr );
 	void appendSection( const MeshSectionRef& meshSection );
+	//! Skin the sections in the current pose of their skeleton. Sections whose skeleton was not posed since their last update are skipped.
 	void update();
+	//! Animation LOD aware update: vertices are only re-skinned on the frames the state was scheduled for.
+	void update( const AnimLodState& lodState );
 	
 	std::shared_ptr<Skeleton>&			getSkeleton() { return mActiveSection->getSkeleton(); }
 	const std::shared_ptr<Skeleton>&	getSkeleton() const { return mActiveSection->getSkeleton(); }
@@ -46,6 +70,19 @@ public:
 	const ci::Matrix44f&		getDefaultTranformation() const { return mActiveSection->getDefaultTranformation(); }
 	
 	void setEnableSkinning( bool enabled ) { mEnableSkinning = enabled; }
+	
+	//! Set the weight of the morph targets named \a name, in every section that has one. Applied on the next update().
+	void setMorphWeight( const std::string& name, float weight );
+	//! Set the morph weights animated by \a animId to their value at \a time, as Skeleton::setPose() does for the bones.
+	void setMorphPose( float time, int animId = 0 );
+	
+	//! Conservative bounds of the current pose (union of every section's animated bounds).
+	ci::AxisAlignedBox3f	getBounds() const;
+	//! Frustum test of the current pose bounds, placed in the world with \a transform. Use it to skip the update and draw of culled meshes.
+	bool					isVisible( const ci::Frustumf& frustum, const ci::Matrix44f& transform = ci::Matrix44f::identity() ) const;
+	
+	//! Memory held by the mesh, its sections and its skeleton(s).
+	MemoryStats				getMemoryStats() const;
 protected:
 	SkinnedMesh( ModelSourceRef modelSource, std::shared_ptr<Skeleton> skeleton = nullptr );
 	//add full behavior/functions relating to "active section"
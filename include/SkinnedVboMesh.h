@@ -9,43 +9,210 @@
 #pragma once
 
 #include "AMeshSection.h"
+#include "BonePalette.h"
+#include "BonePartition.h"
+#include "SectionMerge.h"
+#include "ShaderPermutation.h"
+#include "VertexPacking.h"
 
 #include "cinder/app/App.h"
 #include "cinder/gl/Vbo.h"
 #include "cinder/gl/GlslProg.h"
+#include "cinder/Frustum.h"
 
+#include <algorithm>
+#include <string>
 #include <vector>
 
 class Skeleton;
 
 namespace model {
 
+class AnimLodState;
+
 typedef std::shared_ptr<class SkinnedVboMesh> SkinnedVboMeshRef;
 
 class SkinnedVboMesh
 {
 public:
+	//! Size of the bone palette arrays of the skinning shaders: the most bones a single draw can use.
 	static const int MAXBONES = 92;
 	
+	class Format {
+	public:
+		enum PaletteMode {
+			//! Used bones as rows of 3x4 affine matrices ("bonePalette"); normals use their upper 3x3, or a
+			//! "normalPalette" in the NORMAL_PALETTE permutation, drawn while a bone of the mesh is non-uniformly scaled.
+			PALETTE_AFFINE,
+			//! Used bones as 4x4 matrices along with their inverse transposes ("boneMatrices" and "invTransposeMatrices").
+			PALETTE_MATRIX44
+		};
+		
+		Format() : mPackVertices( false ), mMaxBonesPerBatch( MAXBONES ), mPaletteMode( PALETTE_AFFINE ), mMergeSections( false ), mBuildAtlas( false ) { }
+		/*!
+		 * Use the compressed vertex layout (see PackedVertex): 24 bytes per vertex instead of 64,
+		 * and 16-bit indices for sections with fewer than 65536 vertices. The shader must
+		 * dequantize the attributes, as the default skinning shader does.
+		 */
+		Format&	packVertices( bool pack = true ) { mPackVertices = pack; return *this; }
+		bool	isPackingVertices() const { return mPackVertices; }
+		/*!
+		 * Skinned sections are split at load time into batches using at most \a maxBones bones each
+		 * (see partitionBones()), so rigs with more than MAXBONES bones stay on the gpu. Lower it to
+		 * upload smaller palettes. Clamped to MAXBONES.
+		 */
+		Format&	maxBonesPerBatch( size_t maxBones ) { mMaxBonesPerBatch = std::min<size_t>( maxBones, MAXBONES ); return *this; }
+		size_t	getMaxBonesPerBatch() const { return mMaxBonesPerBatch; }
+		//! Bone palette uniforms expected by the mesh shader. Shaders written for 4x4 palettes need PALETTE_MATRIX44.
+		Format&		paletteMode( PaletteMode mode ) { mPaletteMode = mode; return *this; }
+		PaletteMode	getPaletteMode() const { return mPaletteMode; }
+		/*!
+		 * Concatenate the sections sharing their material, skinning and attributes into one section, drawn with
+		 * one call per bone batch (see canMergeSections()). With \a buildAtlas, sections whose textures differ
+		 * are merged as well, their textures packed into an atlas. Source sections stay sub-sections that can be
+		 * hidden with setSectionVisible().
+		 */
+		Format&	mergeSections( bool merge = true, bool buildAtlas = false ) { mMergeSections = merge; mBuildAtlas = buildAtlas; return *this; }
+		bool	isMergingSections() const { return mMergeSections; }
+		bool	isBuildingAtlas() const { return mBuildAtlas; }
+	private:
+		bool		mPackVertices;
+		size_t		mMaxBonesPerBatch;
+		PaletteMode	mPaletteMode;
+		bool		mMergeSections, mBuildAtlas;
+	};
+	
 	struct MeshSection : public AMeshSection
 	{
+		//! Attribute of the interleaved vertex stream, bound to its location in the mesh shader.
+		struct VertexAttrib {
+			VertexSemantic	mSemantic;
+			GLint		mLocation;
+			GLint		mSize;
+			GLenum		mType;
+			GLboolean	mNormalized;
+			size_t		mOffset;
+			//! Read from the streamed buffer of morphed vertices rather than the interleaved one (see setStreamedVertices()).
+			bool		mStreamed;
+		};
+		
 		MeshSection();
 		void updateMesh( bool enableSkinning = true ) override;
+		//! Rigid bone matrix of the mesh palette, identity when not animated.
+		ci::Matrix44f getRigidTransformation() const override;
+		//! Rigid bone matrix of a given skeleton palette, such as the one a render queue submits.
+		ci::Matrix44f getRigidTransformation( const std::vector<ci::Matrix44f>& boneMatrices ) const;
+		//! Includes the size of the vertex and index buffers.
+		MemoryStats getMemoryStats() const override;
+		
+		/*!
+		 * Upload interleaved vertices of \a stride bytes in a single buffer. Indices are stored
+		 * on 16 bits when the vertex count allows it.
+		 */
+		void				setVertices( const void* vertices, size_t numVertices, size_t stride, const std::vector<uint32_t>& indices,
+										 const std::vector<VertexAttrib>& attribs );
+		//! Upload packed vertices, which the shader dequantizes with \a quantization.
+		void				setPackedVertices( const std::vector<PackedVertex>& vertices, const std::vector<uint32_t>& indices,
+											   const std::vector<VertexAttrib>& attribs, const VertexQuantization& quantization );
+		/*!
+		 * Keep the bind pose \a positions and \a normals of a section with morph targets on the cpu, and stream
+		 * them with the active targets applied to a buffer of their own, read by the streamed attributes.
+		 */
+		void				setStreamedVertices( const std::vector<ci::Vec3f>& positions, const std::vector<ci::Vec3f>& normals );
+		//! Apply the morph targets and upload the streamed vertices, unless the morph weights are unchanged.
+		void				updateMorphTargets();
+		bool				isPacked() const { return mIsPacked; }
+		const VertexQuantization&	getQuantization() const { return mQuantization; }
+		size_t				getNumVertices() const { return mNumVertices; }
+		size_t				getNumIndices() const { return mNumIndices; }
+		//! Draw the section with the mesh shader bound, whatever its vertex layout.
+		void				draw() const;
+		/*!
+		 * Draw each bone batch of an animated section after uploading its palette to the bound \a shader, as set
+		 * by the palette mode. Attributes are bound to the locations of \a shader, skipping those it does not use.
+		 */
+		void				draw( const ci::gl::GlslProgRef& shader ) const;
+		//! Draw with a given skeleton palette, such as a copy taken by a render queue. Empty palettes draw the bind pose.
+		void				draw( const ci::gl::GlslProgRef& shader, const std::vector<ci::Matrix44f>& boneMatrices,
+								  const std::vector<ci::Matrix44f>& invTransposeMatrices ) const;
+		
+		//! Features of the shader permutation matching the section attributes, set at load.
+		void				setShaderFeatures( ShaderFeatures features ) { mShaderFeatures = features; }
+		ShaderFeatures		getShaderFeatures() const { return mShaderFeatures; }
+		/*!
+		 * Features of the permutation drawing the section in its current state: without skinning when it
+		 * is not animated, reading the palette from the palette buffer when the section has one, and
+		 * transforming normals with the normal palette while the mesh palette has non-uniformly scaled bones.
+		 */
+		ShaderFeatures		getDrawShaderFeatures() const;
+		//! Set by the mesh with each palette: whether one of its bones is non-uniformly scaled.
+		void				setNeedsNormalPalette( bool needsNormalPalette ) { mNeedsNormalPalette = needsNormalPalette; }
+		
+		void					setPaletteMode( Format::PaletteMode mode ) { mPaletteMode = mode; }
+		Format::PaletteMode		getPaletteMode() const { return mPaletteMode; }
+		//! Use the mesh palette buffer for shaders declaring the "BonePalette" block, registering the batches as its slices.
+		void					setPaletteBuffer( PaletteBuffer* buffer );
 		
-		ci::gl::VboMesh&		getVboMesh() { return mVboMesh; }
-		const ci::gl::VboMesh&	getVboMesh() const { return mVboMesh; }
-		void				setVboMesh( size_t numVertices, size_t numIndices, ci::gl::VboMesh::Layout layout, GLenum primitiveType );
+		void							setBatches( const std::vector<BoneBatch>& batches ) { mBatches = batches; }
+		const std::vector<BoneBatch>&	getBatches() const { return mBatches; }
 		
-		std::array<ci::Matrix44f, MAXBONES>* boneMatrices;
-		std::array<ci::Matrix44f, MAXBONES>* invTransposeMatrices;
+		//! Source sections making up this one, and the index ranges of their triangles.
+		void							setSubSections( const std::vector<SubSection>& subSections, const std::vector<SubSectionRange>& ranges );
+		const std::vector<SubSection>&	getSubSections() const { return mSubSections; }
+		//! Hidden sub-sections are skipped by draw(), splitting the batch draws around them.
+		void							setSubSectionVisible( size_t index, bool visible );
+		
+		//! Palette of the whole skeleton, shared by the sections of the mesh. The inverse transposes are only computed in PALETTE_MATRIX44 mode.
+		std::vector<ci::Matrix44f>* boneMatrices;
+		std::vector<ci::Matrix44f>* invTransposeMatrices;
+		//! Uniform buffer of the mesh palettes, null when unsupported or in PALETTE_MATRIX44 mode.
+		PaletteBuffer*				paletteBuffer;
 	private:
-		ci::gl::VboMesh mVboMesh;
+		size_t						getIndexSize() const;
+		//! Draw the visible sub-section ranges within [first, first + count).
+		void						drawIndices( size_t first, size_t count ) const;
+		//! Bind the attributes to \a locations, indexed by semantic, or to their mesh shader locations if null.
+		void						bindBuffers( const GLint* locations ) const;
+		void						unbindBuffers( const GLint* locations ) const;
+		void						uploadMatrixPalette( const ci::gl::GlslProgRef& shader, const PaletteUniforms& uniforms, const BoneBatch& batch,
+														 const std::vector<ci::Matrix44f>& boneMatrices, const std::vector<ci::Matrix44f>& invTransposeMatrices ) const;
+		void						uploadAffinePalette( const ci::gl::GlslProgRef& shader, const PaletteUniforms& uniforms, const BoneBatch& batch,
+														 const std::vector<ci::Matrix44f>& boneMatrices ) const;
+		
+		ci::gl::Vbo					mVertexBuffer, mIndexBuffer;
+		//! Morphed positions then normals, one block each, and their bind pose source.
+		ci::gl::Vbo					mStreamBuffer;
+		std::vector<ci::Vec3f>		mBaseVertices, mStreamVertices;
+		std::vector<VertexAttrib>	mAttribs;
+		bool						mIsPacked;
+		VertexQuantization			mQuantization;
+		size_t						mNumVertices, mNumIndices, mStride;
+		GLenum						mIndexType;
+		ShaderFeatures				mShaderFeatures;
+		
+		std::vector<BoneBatch>		mBatches;
+		std::vector<SubSection>		mSubSections;
+		std::vector<SubSectionRange>	mSubSectionRanges;
+		size_t						mNumHiddenSubSections;
+		//! Palette buffer slice of each batch.
+		std::vector<size_t>			mBatchSlices;
+		Format::PaletteMode			mPaletteMode;
+		bool						mNeedsNormalPalette;
+		//! Scratch palette of the batch being drawn.
+		mutable std::vector<ci::Matrix44f>	mBatchBoneMatrices, mBatchInvTransposeMatrices;
+		mutable std::vector<ci::Vec4f>		mBatchBoneRows;
+		mutable std::vector<ci::Vec4f>		mBatchNormalRows;
 	};
 	typedef std::shared_ptr< struct SkinnedVboMesh::MeshSection > MeshVboSectionRef;
 	
-	static SkinnedVboMeshRef create( ModelSourceRef modelSource, std::shared_ptr<Skeleton> skeleton = nullptr, ci::gl::GlslProgRef skinningShader = nullptr );
+	static SkinnedVboMeshRef create( ModelSourceRef modelSource, std::shared_ptr<Skeleton> skeleton = nullptr, ci::gl::GlslProgRef skinningShader = nullptr,
+									 const Format& format = Format() );
 	
+	//! Compute and upload the bone palette of the current pose, unless the skeleton was not posed since the last update.
 	void update();
+	/*! Animation LOD aware update: the bone palette is only recomputed when the state was scheduled
+	 *  for an update, and is interpolated from the two last evaluated palettes otherwise. */
+	void update( AnimLodState& lodState );
 	
 	MeshVboSectionRef&						getActiveSection() { return mActiveSection; }
 	const MeshVboSectionRef&				getActiveSection() const { return mActiveSection; }
@@ -66,14 +233,45 @@ public:
 	
 	void setEnableSkinning( bool enabled ) { mEnableSkinning = enabled; }
 	
+	//! Set the weight of the morph targets named \a name, in every section that has one. Uploaded on the next update().
+	void setMorphWeight( const std::string& name, float weight );
+	//! Set the morph weights animated by \a animId to their value at \a time, as Skeleton::setPose() does for the bones.
+	void setMorphPose( float time, int animId = 0 );
+	//! Show or hide the part of the mesh loaded from section \a sourceIndex of the model source, merged or not.
+	void setSectionVisible( int sourceIndex, bool visible );
+	
+	const Format&	getFormat() const { return mFormat; }
+	
+	//! Conservative bounds of the current pose (union of every section's animated bounds).
+	ci::AxisAlignedBox3f	getBounds() const;
+	//! Frustum test of the current pose bounds, placed in the world with \a transform. Use it to skip the update and draw of culled meshes.
+	bool					isVisible( const ci::Frustumf& frustum, const ci::Matrix44f& transform = ci::Matrix44f::identity() ) const;
+	
+	//! Memory held by the mesh, its bone palettes, its sections, their gpu buffers and its skeleton(s).
+	MemoryStats				getMemoryStats() const;
+	
 	friend struct SkinnedVboMesh::MeshSection;
+	friend class ModelTargetSkinnedVboMesh;
 	
-	std::array<ci::Matrix44f, MAXBONES> mBoneMatrices;
-	std::array<ci::Matrix44f, MAXBONES> mInvTransposeMatrices;
+	std::vector<ci::Matrix44f> mBoneMatrices;
+	std::vector<ci::Matrix44f> mInvTransposeMatrices;
 	ci::gl::GlslProgRef mSkinningShader;
 protected:
 	bool mEnableSkinning;
-	SkinnedVboMesh( ModelSourceRef modelSource, ci::gl::GlslProgRef skinningShader, std::shared_ptr<Skeleton> skeleton = nullptr );
+	Format mFormat;
+	std::unique_ptr<PaletteBuffer> mPaletteBuffer;
+	//! Pose version of the skeleton palette in mBoneMatrices, 0 when it holds none (skinning disabled, or an interpolated palette).
+	uint64_t mPaletteVersion;
+	
+	//! Compute the mesh palette once for every section. Returns false, doing nothing, when the pose is unchanged.
+	bool updateSections();
+	//! Stream the morphed vertices of the sections whose morph weights changed.
+	void updateMorphTargets();
+	//! Replace the sections by the merged ones.
+	void setSections( const std::vector< MeshVboSectionRef >& sections ) { mMeshSections = sections; mActiveSection = mMeshSections.front(); }
+	//! Hand the skeleton palette to the palette buffer, which uploads it on the next draw, and pick the normal palette permutation of the sections.
+	void uploadPalette();
+	SkinnedVboMesh( ModelSourceRef modelSource, ci::gl::GlslProgRef skinningShader, std::shared_ptr<Skeleton> skeleton, const Format& format );
 	MeshVboSectionRef mActiveSection;
 	std::vector< MeshVboSectionRef > mMeshSections;
 };
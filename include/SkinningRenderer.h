@@ -8,23 +8,33 @@
 
 #include "AMeshSection.h"
 #include "Node.h"
+#include "ShaderPermutation.h"
+
+#include <map>
 
 namespace model {
 	
 	class SkinnedMesh;
 	class SkinnedVboMesh;
 	class Skeleton;
+	class RenderQueue;
 	
 	class SkinningRenderer {
 	public:
 		virtual ~SkinningRenderer() { }
 		static SkinningRenderer& instance();
 		
+		//! Permutation with every attribute, used by default to load meshes.
 		ci::gl::GlslProgRef			getShader() { return mSkinningShader; }
 		const ci::gl::GlslProgRef	getShader() const { return mSkinningShader; }
+		//! Permutation of the skinning shader with \a features, compiled on first use. Null if it fails to compile.
+		ci::gl::GlslProgRef			getShader( ShaderFeatures features ) const { return getPermutation( features ).mShader; }
+		size_t						getNumPermutations() const { return mPermutations.size(); }
 		
 		static void		draw( std::shared_ptr<SkinnedMesh> skinnedMesh );
 		static void		draw( std::shared_ptr<SkinnedVboMesh> skinnedVboMesh );
+		//! Sort the queued draws by render state, draw them and clear the queue.
+		static void		draw( RenderQueue& renderQueue );
 		static void		draw( std::shared_ptr<Skeleton> skeleton, bool absolute = true, const std::string& name = "" );
 		//! Render the node names.
 		static void		drawLabels( std::shared_ptr<Skeleton> skeleton, const ci::CameraPersp& camera );
@@ -35,6 +45,7 @@ namespace model {
 		
 		void	privateDraw( std::shared_ptr<SkinnedMesh> skinnedMesh ) const;
 		void	privateDraw( std::shared_ptr<SkinnedVboMesh> skinnedVboMesh ) const;
+		void	privateDraw( RenderQueue& renderQueue ) const;
 		void	privateDraw( std::shared_ptr<Skeleton> skeleton, bool absolute = true, const std::string& name = "" ) const;
 		//! Render the node names.
 		void	privateDrawLabels( std::shared_ptr<Skeleton> skeleton, const ci::CameraPersp& camera ) const;
@@ -59,6 +70,18 @@ namespace model {
 		void drawSkeletonNodeRelative( const Node& node, Node::RenderMode mode = Node::RenderMode::CONNECTED ) const;
 		void drawLabel( const Node& node, const ci::CameraPersp& camera, const ci::Matrix44f& mv ) const;
 		
+		//! Compiled permutation and its uniform locations.
+		struct Permutation {
+			Permutation() : mTexture( -1 ), mPositionScale( -1 ), mPositionOffset( -1 ), mTexcoordScale( -1 ), mTexcoordOffset( -1 ) { }
+			ci::gl::GlslProgRef mShader;
+			GLint mTexture;
+			GLint mPositionScale, mPositionOffset, mTexcoordScale, mTexcoordOffset;
+		};
+		const Permutation&	getPermutation( ShaderFeatures features ) const;
+		
+		std::string			mVertexSource, mFragmentSource;
+		//! Permutations compiled so far, by features.
+		mutable std::map<ShaderFeatures, Permutation>	mPermutations;
 		ci::gl::GlslProgRef mSkinningShader;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "ModelIo.h"
+#include "BonePartition.h"
+
+#include "cinder/Vector.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace model {
+
+/*!
+ * Compressed vertex of the gpu skinning path (24 bytes instead of 64):
+ * snorm16 positions relative to the section bounds, octahedral snorm16 normals, unorm16
+ * texture coordinates relative to their range, ubyte bone indices and unorm8 bone weights.
+ */
+struct PackedVertex {
+	int16_t		mPosition[4];	//!< xyz, w is padding
+	int16_t		mNormal[2];
+	uint16_t	mTexCoord[2];
+	uint8_t		mBoneIndices[4];
+	uint8_t		mBoneWeights[4];
+};
+
+//! Dequantization parameters of a packed section: value = normalized * scale + offset.
+struct VertexQuantization {
+	VertexQuantization()
+	: mPositionScale( 1.0f, 1.0f, 1.0f ), mPositionOffset( ci::Vec3f::zero() )
+	, mTexCoordScale( 1.0f, 1.0f ), mTexCoordOffset( ci::Vec2f::zero() )
+	{ }
+	ci::Vec3f	mPositionScale, mPositionOffset;
+	ci::Vec2f	mTexCoordScale, mTexCoordOffset;
+};
+
+int16_t		packSnorm16( float value );
+uint16_t	packUnorm16( float value );
+//! Octahedral mapping of a unit vector onto the [-1, 1] square.
+ci::Vec2f	encodeOctahedral( const ci::Vec3f& normal );
+ci::Vec3f	decodeOctahedral( const ci::Vec2f& encoded );
+//! Bone weights as unorm8, distributing the rounding error so that the weights of a skinned vertex always sum to 255.
+void		packBoneWeights( const BoneWeights& boneWeights, uint8_t weights[BoneWeights::NB_WEIGHTS] );
+
+//! Position and texture coordinates ranges of a section, used as their dequantization parameters.
+VertexQuantization			computeQuantization( const std::vector<ci::Vec3f>& positions, const std::vector<ci::Vec2f>& texCoords );
+/*!
+ * Pack the attributes of a section. Normals, texture coordinates and bone weights may be empty. Bone indices
+ * are taken from \a paletteIndices, the batch palette slots of the bone weights (see partitionBones()).
+ */
+std::vector<PackedVertex>	packVertices( const VertexQuantization& quantization, const std::vector<ci::Vec3f>& positions, const std::vector<ci::Vec3f>& normals,
+										  const std::vector<ci::Vec2f>& texCoords, const std::vector<BoneWeights>& boneWeights,
+										  const std::vector<PaletteIndices>& paletteIndices );
+
+} //end namespace model
@@ -2,21 +2,38 @@
 precision highp float;
 #endif
 
+// Compiled with the defines of the vertex shader permutation
+#ifndef SHADER_PERMUTATION
+#define HAS_NORMALS
+#define HAS_TEXTURE
+#endif
+
+varying vec3 V;
+#ifdef HAS_NORMALS
+varying vec3 N, L;
+#endif
+#ifdef HAS_TEXTURE
 varying vec2 Tc;
-varying vec3 N, L, V;
 
 uniform sampler2D texture;
+#endif
 
 void main (void)
 {
+#ifdef HAS_TEXTURE
 	vec4 Dm = texture2D( texture, Tc );
+#else
+	vec4 Dm = vec4( 1.0 );
+#endif
 	
 	vec3 L = normalize(gl_LightSource[0].position.xyz);
 	vec3 E = normalize(-V);
-	vec3 R = normalize(reflect(L, N));
 	
 	vec4 Iamb = gl_FrontLightProduct[0].ambient * Dm;
 	
+#ifdef HAS_NORMALS
+	vec3 R = normalize(reflect(L, N));
+	
 	vec4 Idiff = gl_FrontLightProduct[0].diffuse * max(dot(N, L), 0.0) * Dm;
 		
 //	vec4 Ispec =  gl_FrontLightProduct[0].specular * pow( max( dot(R, E), 0.0 ), 0.95 );
@@ -24,4 +41,9 @@ void main (void)
 	
 //	gl_FragColor = gl_FrontMaterial.emission + Iamb + Idiff + Ispec;
 	gl_FragColor = gl_FrontMaterial.emission + 2.0*(Iamb + Idiff + Ispec);
+#else
+	vec4 Idiff = gl_FrontLightProduct[0].diffuse * Dm;
+	
+	gl_FragColor = gl_FrontMaterial.emission + 2.0*(Iamb + Idiff);
+#endif
 }
\ No newline at end of file
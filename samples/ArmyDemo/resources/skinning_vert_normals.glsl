@@ -1,38 +1,143 @@
+// Permutations of this shader are selected by the renderer with the defines:
+// SKINNED, MAX_INFLUENCES (1 to 4), HAS_NORMALS, HAS_TEXTURE, PACKED_VERTICES, BONE_PALETTE_UBO and NORMAL_PALETTE.
+// Without SHADER_PERMUTATION, the shader is compiled with every attribute.
+#ifndef SHADER_PERMUTATION
+#define SKINNED
+#define MAX_INFLUENCES 4
+#define HAS_NORMALS
+#define HAS_TEXTURE
+#define NORMAL_PALETTE
+#endif
+
 const int MAXBONES = 92;
 
 attribute vec3 position;
+#ifdef HAS_NORMALS
 attribute vec3 normal;
+#endif
+#ifdef HAS_TEXTURE
 attribute vec2 texcoord;
+#endif
+
+#ifdef SKINNED
 attribute vec4 boneWeights;
 attribute vec4 boneIndices;
 
-uniform bool isAnimated;
-uniform mat4 boneMatrices[MAXBONES];
-uniform mat4 invTransposeMatrices[MAXBONES];
+// Rows of the affine bone transforms (3 per bone), followed by the rows of the normal
+// transforms, only declared by the permutation drawing non-uniformly scaled bones
+#ifdef BONE_PALETTE_UBO
+layout(std140) uniform BonePalette {
+	vec4 bonePalette[3 * MAXBONES];
+#ifdef NORMAL_PALETTE
+	vec4 normalPalette[3 * MAXBONES];
+#endif
+};
+#else
+uniform vec4 bonePalette[3 * MAXBONES];
+#ifdef NORMAL_PALETTE
+uniform vec4 normalPalette[3 * MAXBONES];
+#endif
+#endif
+#endif
+
+#ifdef PACKED_VERTICES
+// Dequantization of packed vertices
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+uniform vec2 texcoordScale;
+uniform vec2 texcoordOffset;
+#endif
 
+varying vec3 V;
+#ifdef HAS_NORMALS
+varying vec3 N, L;
+#endif
+#ifdef HAS_TEXTURE
 varying vec2 Tc;
-varying vec3 N, L, V;
+#endif
+
+#ifdef PACKED_VERTICES
+vec3 decodeOctahedral( vec2 e )
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if( n.z < 0.0 ) {
+		n.xy = (1.0 - abs(n.yx)) * vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+	}
+	return normalize(n);
+}
+#endif
+
+#ifdef SKINNED
+vec3 transformPosition( int bone, vec4 p )
+{
+	return vec3(dot(bonePalette[3*bone], p), dot(bonePalette[3*bone+1], p), dot(bonePalette[3*bone+2], p));
+}
+
+vec3 transformNormal( int bone, vec3 n )
+{
+#ifdef NORMAL_PALETTE
+	return vec3(dot(normalPalette[3*bone].xyz, n), dot(normalPalette[3*bone+1].xyz, n), dot(normalPalette[3*bone+2].xyz, n));
+#else
+	// The upper 3x3 is exact up to scale for uniformly scaled bones
+	return vec3(dot(bonePalette[3*bone].xyz, n), dot(bonePalette[3*bone+1].xyz, n), dot(bonePalette[3*bone+2].xyz, n));
+#endif
+}
+#endif
 
 void main()
-{	
+{
+#ifdef PACKED_VERTICES
+	vec4 pos = vec4(position * positionScale + positionOffset, 1.0);
+#else
 	vec4 pos = vec4(position, 1.0);
-	vec4 norm = vec4(normal, 1.0);
-	if( isAnimated ) {
-		pos =	boneMatrices[int(boneIndices.x)] * pos * boneWeights.x +
-		boneMatrices[int(boneIndices.y)] * pos * boneWeights.y +
-		boneMatrices[int(boneIndices.z)] * pos * boneWeights.z +
-		boneMatrices[int(boneIndices.w)] * pos * boneWeights.w ;
-		
-		norm =  invTransposeMatrices[int(boneIndices.x)] * norm * boneWeights.x +
-		invTransposeMatrices[int(boneIndices.y)] * norm * boneWeights.y +
-		invTransposeMatrices[int(boneIndices.z)] * norm * boneWeights.z +
-		invTransposeMatrices[int(boneIndices.w)] * norm * boneWeights.w ;
-		pos.w = 1.0;
-		norm.w = 0.0;
-	}
+#endif
+#ifdef HAS_NORMALS
+#ifdef PACKED_VERTICES
+	vec3 norm = decodeOctahedral(normal.xy);
+#else
+	vec3 norm = normal;
+#endif
+#endif
+
+#ifdef SKINNED
+	vec3 skinnedPos = transformPosition(int(boneIndices.x), pos) * boneWeights.x;
+#if MAX_INFLUENCES > 1
+	skinnedPos += transformPosition(int(boneIndices.y), pos) * boneWeights.y;
+#endif
+#if MAX_INFLUENCES > 2
+	skinnedPos += transformPosition(int(boneIndices.z), pos) * boneWeights.z;
+#endif
+#if MAX_INFLUENCES > 3
+	skinnedPos += transformPosition(int(boneIndices.w), pos) * boneWeights.w;
+#endif
+	pos.xyz = skinnedPos;
+	
+#ifdef HAS_NORMALS
+	vec3 skinnedNorm = transformNormal(int(boneIndices.x), norm) * boneWeights.x;
+#if MAX_INFLUENCES > 1
+	skinnedNorm += transformNormal(int(boneIndices.y), norm) * boneWeights.y;
+#endif
+#if MAX_INFLUENCES > 2
+	skinnedNorm += transformNormal(int(boneIndices.z), norm) * boneWeights.z;
+#endif
+#if MAX_INFLUENCES > 3
+	skinnedNorm += transformNormal(int(boneIndices.w), norm) * boneWeights.w;
+#endif
+	norm = skinnedNorm;
+#endif
+#endif
+
 	V = (gl_ModelViewMatrix * pos).xyz;
-	N = normalize(gl_NormalMatrix * norm.xyz);
+#ifdef HAS_NORMALS
+	N = normalize(gl_NormalMatrix * norm);
 	L = normalize(vec3(gl_LightSource[0].position));
+#endif
+#ifdef HAS_TEXTURE
+#ifdef PACKED_VERTICES
+	Tc = texcoord * texcoordScale + texcoordOffset;
+#else
 	Tc = texcoord;
+#endif
+#endif
 	gl_Position = gl_ModelViewProjectionMatrix * pos;
 }
\ No newline at end of file
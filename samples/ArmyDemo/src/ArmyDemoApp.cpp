@@ -6,6 +6,7 @@ using namespace ci::app;
 using namespace std;
 
 #include "cinder/Camera.h"
+#include "cinder/Frustum.h"
 #include "cinder/MayaCamUI.h"
 #include "cinder/gl/Light.h"
 #include "cinder/params/Params.h"
@@ -15,6 +16,10 @@ using namespace std;
 #include "SkinnedVboMesh.h"
 #include "Skeleton.h"
 #include "SkinningRenderer.h"
+#include "RenderQueue.h"
+#include "AnimLod.h"
+#include "PoseCache.h"
+#include "Profiling.h"
 
 const int ROW_LEN = 10;
 const int NUM_MONSTERS = ROW_LEN * ROW_LEN;
@@ -36,6 +41,9 @@ public:
 	void update();
 	void draw();
 private:
+	Vec3f getMonsterPosition( int i, int j ) const;
+	Matrix44f getMonsterTransform( int i, int j ) const;
+	
 	SkinnedVboMeshRef				mSkinnedVboMesh;
 	
 	MayaCamUI						mMayaCam;
@@ -47,6 +55,31 @@ private:
 	float							mTime, mFps;
 	params::InterfaceGl				mParams;
 	bool mDrawSkeleton, mDrawMesh, mDrawAbsolute, mEnableWireframe;
+	
+	AnimLodScheduler				mLodScheduler;
+	std::array<AnimLodState, NUM_MONSTERS>	mLodStates;
+	std::array<int, NUM_MONSTERS>	mBoneLods;
+	//! Monsters sorted by bone LOD, so that the shared skeleton changes LOD at most once per LOD each frame
+	std::array<int, NUM_MONSTERS>	mPoseOrder;
+	bool							mEnableAnimLod, mEnableBoneLod;
+	int								mMaxUpdatesPerFrame, mNumUpdates;
+	
+	//! Monsters playing the clip at the same time share their pose
+	PoseCache						mPoseCache;
+	bool							mEnablePoseCache;
+	float							mPoseCacheHitRate;
+	
+	//! Bounds of the last pose evaluated for each monster
+	std::array<AxisAlignedBox3f, NUM_MONSTERS>	mBounds;
+	std::array<bool, NUM_MONSTERS>	mHasBounds;
+	bool							mEnableCulling;
+	int								mNumCulled;
+	
+	//! Last frame counters, only non-zero when the block is compiled with MODEL_PROFILING
+	int								mNumBonesEvaluated, mNumDrawCalls, mNumStateChanges;
+	
+	//! Monsters are drawn once all of them are submitted, sorted by render state
+	RenderQueue						mRenderQueue;
 };
 
 void ArmyDemoApp::setup()
@@ -68,19 +101,57 @@ void ArmyDemoApp::setup()
 	mParams.addParam( "Relative/Abolute skeleton", &mDrawAbsolute );
 	mEnableWireframe = false;
 	mParams.addParam( "Wireframe", &mEnableWireframe );
+	mParams.addSeparator();
+	mEnableAnimLod = true;
+	mParams.addParam( "Animation LOD", &mEnableAnimLod );
+	mEnableBoneLod = true;
+	mParams.addParam( "Bone LOD", &mEnableBoneLod );
+	mMaxUpdatesPerFrame = 25;
+	mParams.addParam( "Max updates per frame", &mMaxUpdatesPerFrame, "min=0 max=100" );
+	mNumUpdates = 0;
+	mParams.addParam( "Updates", &mNumUpdates, "", true );
+	mEnablePoseCache = true;
+	mParams.addParam( "Pose cache", &mEnablePoseCache );
+	mPoseCacheHitRate = 0.0f;
+	mParams.addParam( "Pose cache hit rate", &mPoseCacheHitRate, "", true );
+	mEnableCulling = true;
+	mParams.addParam( "Frustum culling", &mEnableCulling );
+	mNumCulled = 0;
+	mParams.addParam( "Culled", &mNumCulled, "", true );
+	mNumBonesEvaluated = mNumDrawCalls = mNumStateChanges = 0;
+	if( Profiler::isCompiledIn() ) {
+		mParams.addSeparator();
+		mParams.addParam( "Bones evaluated", &mNumBonesEvaluated, "", true );
+		mParams.addParam( "Draw calls", &mNumDrawCalls, "", true );
+		mParams.addParam( "State changes", &mNumStateChanges, "", true );
+	}
+	
+	mLodScheduler.getPolicy().setDistances( 20.0f, 40.0f, 80.0f );
+	// Room for every monster at every bone LOD
+	mPoseCache.setCapacity( 3 * NUM_MONSTERS );
 	
 	gl::enableDepthWrite();
 	gl::enableDepthRead();
 	gl::enableAlphaBlending();
 	
-	mSkinnedVboMesh = SkinnedVboMesh::create( loadModel( getAssetPath( "maggot3.md5mesh" ) ) );
+	mSkinnedVboMesh = SkinnedVboMesh::create( loadModel( getAssetPath( "maggot3.md5mesh" ) ), nullptr, nullptr, SkinnedVboMesh::Format().packVertices().mergeSections() );
+	mSkinnedVboMesh->getSkeleton()->generateLodBoneSets( { 0.5f, 0.2f } );
+	mBoneLods.fill( 0 );
+	for( int index = 0; index < NUM_MONSTERS; ++index ) {
+		mPoseOrder[ index ] = index;
+	}
+	mHasBounds.fill( false );
 }
 
 void ArmyDemoApp::fileDrop( FileDropEvent event )
 {
 	try {
 		fs::path modelFile = event.getFile( 0 );
-		mSkinnedVboMesh = SkinnedVboMesh::create( loadModel( modelFile ) );
+		mSkinnedVboMesh = SkinnedVboMesh::create( loadModel( modelFile ), nullptr, nullptr, SkinnedVboMesh::Format().packVertices().mergeSections() );
+		mSkinnedVboMesh->getSkeleton()->generateLodBoneSets( { 0.5f, 0.2f } );
+		mLodStates.fill( AnimLodState() );
+		mHasBounds.fill( false );
+		mPoseCache.clear();
 	}
 	catch( ... ) {
 		console() << "unable to load the asset!" << std::endl;
@@ -124,10 +195,58 @@ void ArmyDemoApp::resize()
 	gl::enableDepthRead();
 }
 
+Vec3f ArmyDemoApp::getMonsterPosition( int i, int j ) const
+{
+	return Vec3f( 0, -5.0f, 0.0f ) + 0.1f * Vec3f( SPACING * (i - 0.5f * ROW_LEN), 0, SPACING * (j - 0.5f * ROW_LEN) );
+}
+
+Matrix44f ArmyDemoApp::getMonsterTransform( int i, int j ) const
+{
+	Matrix44f transform = Matrix44f::createTranslation( getMonsterPosition( i, j ) );
+	transform.scale( Vec3f( 0.1f, 0.1f, 0.1f ) );
+	return transform;
+}
+
 void ArmyDemoApp::update()
 {
 	mFps = getAverageFps();
+	Profiler::instance().beginFrame();
+	ProfileCounters counters = Profiler::instance().getFrameCounters();
+	mNumBonesEvaluated = (int) counters.mBonesEvaluated;
+	mNumDrawCalls = (int) counters.mDrawCalls;
+	mNumStateChanges = (int) counters.mStateChanges;
+	mPoseCacheHitRate = mPoseCache.getStats().getHitRate();
+	mPoseCache.resetStats();
 	mTime = 0.05f * mSkinnedVboMesh->getSkeleton()->getAnimDuration() * mMouseHorizontalPos / getWindowWidth();
+	
+	Vec3f eye = mMayaCam.getCamera().getEyePoint();
+	const AnimLodPolicy& policy = mLodScheduler.getPolicy();
+	if( mEnableAnimLod ) {
+		mLodScheduler.setMaxUpdatesPerFrame( mMaxUpdatesPerFrame );
+		mLodScheduler.beginFrame();
+	}
+	for(int i=0; i < ROW_LEN; ++i) {
+		for(int j=0; j < ROW_LEN; ++j ) {
+			float distance = eye.distance( getMonsterPosition( i, j ) );
+			if( mEnableAnimLod ) {
+				mLodScheduler.submit( &mLodStates[ i * ROW_LEN + j ], distance );
+			}
+			// Same distance thresholds as the update rate: 1 frame -> lod 0, 2 frames -> lod 1, etc.
+			int lod = 0;
+			for( int interval = policy.getIntervalFromDistance( distance ); interval > 1; interval /= 2 ) {
+				++lod;
+			}
+			mBoneLods[ i * ROW_LEN + j ] = mEnableBoneLod ? lod : 0;
+		}
+	}
+	// Every LOD change resets the skeleton and invalidates its pose: pose the monsters LOD by LOD
+	std::stable_sort( mPoseOrder.begin(), mPoseOrder.end(), [this] ( int a, int b ) { return mBoneLods[ a ] < mBoneLods[ b ]; } );
+	if( mEnableAnimLod ) {
+		mLodScheduler.schedule();
+		mNumUpdates = mLodScheduler.getNumUpdates();
+	} else {
+		mNumUpdates = NUM_MONSTERS;
+	}
 }
 
 void ArmyDemoApp::draw()
@@ -152,21 +271,47 @@ void ArmyDemoApp::draw()
 	if ( mEnableWireframe )
 		gl::enableWireframe();
 	
-	for(int i=0; i < ROW_LEN; ++i) {
-		for(int j=0; j < ROW_LEN; ++j ) {
-			gl::pushModelView();
-			gl::translate(SPACING * (i - 0.5f * ROW_LEN), 0, SPACING * (j - 0.5f * ROW_LEN));
-			mSkinnedVboMesh->getSkeleton()->setPose( mTime + 2.0f*( i * j )/NUM_MONSTERS );
-			if( mDrawMesh ) {
+	Frustumf frustum( mMayaCam.getCamera() );
+	mNumCulled = 0;
+	// Draw order does not matter: the render queue sorts the draws by state
+	for( int index : mPoseOrder ) {
+		int i = index / ROW_LEN, j = index % ROW_LEN;
+		AnimLodState& lodState = mLodStates[ index ];
+		if( ! mEnableAnimLod || lodState.needsUpdate() || mDrawSkeleton || ! mHasBounds[ index ] ) {
+			mSkinnedVboMesh->getSkeleton()->setLod( mBoneLods[ index ] );
+			float time = mTime + 2.0f*( i * j )/NUM_MONSTERS;
+			if( mEnablePoseCache ) {
+				mPoseCache.setPose( mSkinnedVboMesh->getSkeleton(), time );
+			} else {
+				mSkinnedVboMesh->getSkeleton()->setPose( time );
+			}
+			mBounds[ index ] = mSkinnedVboMesh->getBounds();
+			mHasBounds[ index ] = true;
+		}
+		// Culled monsters are neither skinned nor drawn. A skipped LOD update stays due for the next frame.
+		if( mEnableCulling && ! frustum.intersects( mBounds[ index ].transformed( getMonsterTransform( i, j ) ) ) ) {
+			++mNumCulled;
+			continue;
+		}
+		
+		gl::pushModelView();
+		gl::translate(SPACING * (i - 0.5f * ROW_LEN), 0, SPACING * (j - 0.5f * ROW_LEN));
+		if( mDrawMesh ) {
+			if( mEnableAnimLod ) {
+				mSkinnedVboMesh->update( lodState );
+			} else {
 				mSkinnedVboMesh->update();
-				SkinningRenderer::draw( mSkinnedVboMesh );
 			}
-			if( mDrawSkeleton) {
-				SkinningRenderer::draw( mSkinnedVboMesh->getSkeleton(), mDrawAbsolute );
+			if( ! mEnableAnimLod || lodState.hasPalette() ) {
+				mRenderQueue.submit( mSkinnedVboMesh );
 			}
-			gl::popModelView();
 		}
+		if( mDrawSkeleton) {
+			SkinningRenderer::draw( mSkinnedVboMesh->getSkeleton(), mDrawAbsolute );
+		}
+		gl::popModelView();
 	}
+	SkinningRenderer::draw( mRenderQueue );
 	
 	if ( mEnableWireframe )
 		gl::disableWireframe();
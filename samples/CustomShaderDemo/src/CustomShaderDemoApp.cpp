@@ -45,8 +45,10 @@ void CustomShaderDemo::setup()
 	
 	/* Here we pass the custom shader to the skinned vbo mesh so that its
 	 * shader attributes (position, normal, texcoord, boneWeights & boneIndices)
-	 * are set as the asset is loaded. */
-	mSeymour = SkinnedVboMesh::create( loadModel( loadResource( RES_SEYMOUR ) ), nullptr, mCustomShader );
+	 * are set as the asset is loaded. custom_vert.glsl expects 4x4 bone matrices
+	 * along with their inverse transposes, hence the palette mode. */
+	mSeymour = SkinnedVboMesh::create( loadModel( loadResource( RES_SEYMOUR ) ), nullptr, mCustomShader,
+									   SkinnedVboMesh::Format().paletteMode( SkinnedVboMesh::Format::PALETTE_MATRIX44 ) );
 	mSeymour->getSkeleton()->loopAnim();
 }
 
@@ -111,11 +113,8 @@ void CustomShaderDemo::draw()
 	 * Furthermore, consult the SkinnedRenderer::drawSection() function to see how to use loaded material info. */
 	for( const SkinnedVboMesh::MeshVboSectionRef& section : mSeymour->getSections() ) {
 		mCustomShader->bind();
-		if( section->hasSkeleton() ) {
-			mCustomShader->uniform( "boneMatrices", section->boneMatrices->data(), SkinnedVboMesh::MAXBONES );
-			mCustomShader->uniform( "invTransposeMatrices", section->invTransposeMatrices->data(), SkinnedVboMesh::MAXBONES );
-		}
-		ci::gl::draw( section->getVboMesh() );
+		// Uploads the bone palette of each batch of the section before drawing it
+		section->draw( mCustomShader );
 		mCustomShader->unbind();
 	}
 }
@@ -10,6 +10,7 @@
 
 #include "Resources.h"
 #include "Node.h"
+#include "PoseEdit.h"
 #include "Skeleton.h"
 #include "SkinnedVboMesh.h"
 #include "ModelSourceAssimp.h"
@@ -41,6 +42,9 @@ private:
 	Vec3f				mLightPos;
 	
 	SkinnedVboMeshRef	mSkinnedVboBird;
+	PoseEdit			mPoseEdit;
+	//! Looked up once, getBone() would build a string per bone and frame.
+	NodeRef				mMidL, mMidR, mTipL, mTipR, mHead, mBody;
 	
 	params::InterfaceGl	mParams;
 	
@@ -65,6 +69,14 @@ void ProceduralAnimApp::setup()
 	
 	console() << *mSkinnedVboBird->getSkeleton();
 	
+	SkeletonRef skeleton = mSkinnedVboBird->getSkeleton();
+	mMidL = skeleton->getBone( "Gannet_Lwing_mid" );
+	mMidR = skeleton->getBone( "Gannet_Rwing_mid" );
+	mTipL = skeleton->getBone( "Gannet_Lwing_tip" );
+	mTipR = skeleton->getBone( "Gannet_Rwing_tip" );
+	mHead = skeleton->getBone( "Gannet_head" );
+	mBody = skeleton->getBone( "Gannet_body" );
+	
 	mParams = params::InterfaceGl( "Parameters", Vec2i( 200, 250 ) );
 	mDrawMesh = true;
 	mParams.addParam( "Draw Mesh", &mDrawMesh );
@@ -134,24 +146,19 @@ void ProceduralAnimApp::update()
 	float h = mAmplitude * 0.5f * math<float>::sin( mFlapAngle );
 	float t = mAmplitude * 0.5f * math<float>::sin( mFlapAngle - M_PI / 2 );
 
-	SkeletonRef skeleton = mSkinnedVboBird->getSkeleton();		
-	NodeRef midL = skeleton->getBone("Gannet_Lwing_mid");
-	NodeRef midR = skeleton->getBone("Gannet_Rwing_mid");
-	NodeRef tipL = skeleton->getBone("Gannet_Lwing_tip");
-	NodeRef tipR = skeleton->getBone("Gannet_Rwing_tip");
-	midL->setRelativeRotation( midL->getInitialRelativeRotation() * Quatf( Vec3f::xAxis(), t ) * Quatf( Vec3f::zAxis(), mShoulderAngle ) );
-	midR->setRelativeRotation( midR->getInitialRelativeRotation() * Quatf( Vec3f::xAxis(), t ) * Quatf( Vec3f::zAxis(), mShoulderAngle ) );
-	tipL->setRelativeRotation( Quatf( Vec3f::yAxis(), h ) );
-	tipR->setRelativeRotation( Quatf( Vec3f::yAxis(), h ) );
+	// The edits are applied at once by commit(), which recomputes each edited subtree a single time.
+	mPoseEdit.setRelativeRotation( mMidL, mMidL->getInitialRelativeRotation() * Quatf( Vec3f::xAxis(), t ) * Quatf( Vec3f::zAxis(), mShoulderAngle ) );
+	mPoseEdit.setRelativeRotation( mMidR, mMidR->getInitialRelativeRotation() * Quatf( Vec3f::xAxis(), t ) * Quatf( Vec3f::zAxis(), mShoulderAngle ) );
+	mPoseEdit.setRelativeRotation( mTipL, Quatf( Vec3f::yAxis(), h ) );
+	mPoseEdit.setRelativeRotation( mTipR, Quatf( Vec3f::yAxis(), h ) );
 	
-	NodeRef head = skeleton->getBone("Gannet_head");
-	head->setRelativeRotation( head->getInitialRelativeRotation().slerp(0.5f, mMayaCam.getCamera().getOrientation() )  );
+	mPoseEdit.setRelativeRotation( mHead, mHead->getInitialRelativeRotation().slerp(0.5f, mMayaCam.getCamera().getOrientation() )  );
 	
-	skeleton->getBone("Gannet_body")->setRelativePosition( Vec3f(0, -t, 0) );
+	mPoseEdit.setRelativePosition( mBody, Vec3f(0, -t, 0) );
+	mPoseEdit.commit();
 	
-	/* The mesh isn't automatically updated when the skeleton it contained is modified, so
-	 * an update call is necessary (for now). This may change since I don't find it very
-	 * intuitive... */
+	/* The mesh isn't automatically updated when the skeleton it contains is modified, so
+	 * an update call is necessary. It costs nothing on the frames where no bone was touched. */
 	mSkinnedVboBird->update();
 	
 	for( auto& d : mDust ) {
@@ -0,0 +1,199 @@
+#include "AMeshSection.h"
+#include "MorphTargets.h"
+#include "Node.h"
+#include "Skeleton.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <set>
+#include <unordered_map>
+
+namespace model {
+
+ci::AxisAlignedBox3f includeBounds( const ci::AxisAlignedBox3f& a, const ci::AxisAlignedBox3f& b )
+{
+	const ci::Vec3f& aMin = a.getMin();
+	const ci::Vec3f& aMax = a.getMax();
+	const ci::Vec3f& bMin = b.getMin();
+	const ci::Vec3f& bMax = b.getMax();
+	return ci::AxisAlignedBox3f( ci::Vec3f( std::min( aMin.x, bMin.x ), std::min( aMin.y, bMin.y ), std::min( aMin.z, bMin.z ) ),
+								 ci::Vec3f( std::max( aMax.x, bMax.x ), std::max( aMax.y, bMax.y ), std::max( aMax.z, bMax.z ) ) );
+}
+
+std::shared_ptr<Node> findRigidBone( const std::vector<BoneWeights>& boneWeights )
+{
+	// Weights below the threshold are rounding leftovers of the importer.
+	const float epsilon = 1e-4f;
+	std::shared_ptr<Node> rigidBone;
+	for( const BoneWeights& weights : boneWeights ) {
+		float total = 0.0f;
+		for( unsigned int i = 0; i < weights.mActiveNbWeights; ++i ) {
+			if( weights.getWeight( i ) <= epsilon )
+				continue;
+			const std::shared_ptr<Node>& bone = weights.getBone( i );
+			if( ! rigidBone ) {
+				rigidBone = bone;
+			} else if( bone != rigidBone ) {
+				return nullptr;
+			}
+			total += weights.getWeight( i );
+		}
+		if( std::abs( total - 1.0f ) > epsilon )
+			return nullptr;
+	}
+	return rigidBone;
+}
+
+void transformVertices( const ci::Matrix44f& transformation, std::vector<ci::Vec3f>* positions, std::vector<ci::Vec3f>* normals )
+{
+	for( ci::Vec3f& p : *positions ) {
+		p = transformation.transformPointAffine( p );
+	}
+	if( normals && ! normals->empty() ) {
+		// Inverse transpose, for non-uniformly scaled transformations
+		ci::Matrix33f normalMatrix = transformation.subMatrix33( 0, 0 ).inverted().transposed();
+		for( ci::Vec3f& n : *normals ) {
+			n = ( normalMatrix * n ).normalized();
+		}
+	}
+}
+
+namespace {
+	struct BoundsAccumulator {
+		BoundsAccumulator()
+		{
+			const float big = std::numeric_limits<float>::max();
+			mMin = ci::Vec3f( big, big, big );
+			mMax = ci::Vec3f( -big, -big, -big );
+		}
+		
+		void include( const ci::Vec3f& p )
+		{
+			mMin.x = std::min( mMin.x, p.x ); mMin.y = std::min( mMin.y, p.y ); mMin.z = std::min( mMin.z, p.z );
+			mMax.x = std::max( mMax.x, p.x ); mMax.y = std::max( mMax.y, p.y ); mMax.z = std::max( mMax.z, p.z );
+		}
+		ci::AxisAlignedBox3f getBounds() const { return ci::AxisAlignedBox3f( mMin, mMax ); }
+		
+		ci::Vec3f mMin, mMax;
+	};
+}
+
+void AMeshSection::computeBounds( const std::vector<ci::Vec3f>& positions, const std::vector<BoneWeights>& boneWeights )
+{
+	BoundsAccumulator bindPose;
+	for( const ci::Vec3f& p : positions ) {
+		bindPose.include( p );
+	}
+	mBindPoseBounds = positions.empty() ? ci::AxisAlignedBox3f() : bindPose.getBounds();
+	
+	mBoneBounds.clear();
+	if( boneWeights.empty() )
+		return;
+	
+	assert( boneWeights.size() == positions.size() );
+	std::unordered_map<Node*, size_t> boneIndices;
+	std::vector<BoundsAccumulator> accumulators;
+	for( size_t v = 0; v < boneWeights.size(); ++v ) {
+		const BoneWeights& weights = boneWeights[v];
+		for( unsigned int i = 0; i < weights.mActiveNbWeights; ++i ) {
+			const std::shared_ptr<Node>& bone = weights.getBone( i );
+			if( weights.getWeight( i ) <= 0.0f || ! bone || ! bone->getOffset() )
+				continue;
+			
+			auto it = boneIndices.find( bone.get() );
+			if( it == boneIndices.end() ) {
+				it = boneIndices.insert( std::make_pair( bone.get(), mBoneBounds.size() ) ).first;
+				BoneBounds boneBounds;
+				boneBounds.mBone = bone;
+				mBoneBounds.push_back( boneBounds );
+				accumulators.push_back( BoundsAccumulator() );
+			}
+			// The offset matrix brings a bind pose vertex into bone space.
+			accumulators[it->second].include( bone->getOffset()->transformPointAffine( positions[v] ) );
+		}
+	}
+	for( size_t b = 0; b < mBoneBounds.size(); ++b ) {
+		mBoneBounds[b].mBounds = accumulators[b].getBounds();
+	}
+}
+
+namespace {
+	//! Largest scale of the axes of \a m, the most a mesh space length grows in its space when \a m has no shear.
+	float getMaxAxisScale( const ci::Matrix44f& m )
+	{
+		float scale2 = 0.0f;
+		for( int i = 0; i < 3; ++i ) {
+			ci::Vec3f row( m.at( i, 0 ), m.at( i, 1 ), m.at( i, 2 ) ), column( m.at( 0, i ), m.at( 1, i ), m.at( 2, i ) );
+			scale2 = std::max( scale2, std::max( row.lengthSquared(), column.lengthSquared() ) );
+		}
+		return std::sqrt( scale2 );
+	}
+}
+
+void AMeshSection::inflateBounds( float margin )
+{
+	ci::Vec3f m( margin, margin, margin );
+	mBindPoseBounds = ci::AxisAlignedBox3f( mBindPoseBounds.getMin() - m, mBindPoseBounds.getMax() + m );
+	for( BoneBounds& boneBounds : mBoneBounds ) {
+		// Bone bounds are in bone space, where the offset matrix scales the mesh space displacements.
+		float boneMargin = margin * getMaxAxisScale( *boneBounds.mBone->getOffset() );
+		ci::Vec3f bm( boneMargin, boneMargin, boneMargin );
+		boneBounds.mBounds = ci::AxisAlignedBox3f( boneBounds.mBounds.getMin() - bm, boneBounds.mBounds.getMax() + bm );
+	}
+}
+
+ci::AxisAlignedBox3f AMeshSection::getAnimatedBounds() const
+{
+	if( mBoneBounds.empty() ) {
+		if( mHasDefaultTransformation )
+			return mBindPoseBounds.transformed( mDefaultTransformation );
+		return mBindPoseBounds;
+	}
+	
+	ci::AxisAlignedBox3f bounds = mBoneBounds.front().mBounds.transformed( mBoneBounds.front().mBone->getAbsoluteTransformation() );
+	for( size_t b = 1; b < mBoneBounds.size(); ++b ) {
+		const BoneBounds& boneBounds = mBoneBounds[b];
+		bounds = includeBounds( bounds, boneBounds.mBounds.transformed( boneBounds.mBone->getAbsoluteTransformation() ) );
+	}
+	return bounds;
+}
+
+MemoryStats AMeshSection::getMemoryStats() const
+{
+	MemoryStats stats;
+	stats.add( MemoryStats::SKINNING, memory::vectorBytes( mBoneWeights ) );
+	stats.add( MemoryStats::BOUNDS, memory::vectorBytes( mBoneBounds ) );
+	stats.add( MemoryStats::GPU_TEXTURES, getTextureBytes() );
+	if( mMorphTargets ) {
+		stats += mMorphTargets->getMemoryStats();
+	}
+	return stats;
+}
+
+size_t AMeshSection::getTextureBytes() const
+{
+	const ci::gl::Texture& texture = mMatInfo.mTexture;
+	return texture ? 4 * size_t( texture.getWidth() ) * size_t( texture.getHeight() ) : 0;
+}
+
+MemoryStats getSectionsMemoryStats( const std::vector<const AMeshSection*>& sections )
+{
+	MemoryStats stats;
+	std::set<GLuint> textures;
+	std::set<const Skeleton*> skeletons;
+	for( const AMeshSection* section : sections ) {
+		stats += section->getMemoryStats();
+		const ci::gl::Texture& texture = section->getMatInfo().mTexture;
+		if( texture && ! textures.insert( texture.getId() ).second ) {
+			stats.mBytes[MemoryStats::GPU_TEXTURES] -= section->getTextureBytes();
+		}
+		if( section->hasSkeleton() && skeletons.insert( section->getSkeleton().get() ).second ) {
+			stats += section->getSkeleton()->getMemoryStats();
+		}
+	}
+	return stats;
+}
+
+} //end namespace model
@@ -5,8 +5,9 @@
 namespace model {
 
 template< typename T >
-AnimCurve<T>::AnimCurve( const std::shared_ptr<AnimTrack>& parentTrack )
-: mParentTrack( parentTrack.get() )
+AnimCurve<T>::AnimCurve( AnimTrack* parentTrack, const ArenaRef& arena )
+: mParentTrack( parentTrack )
+, mKeyframes( std::less<float>(), typename KeyframeMap::allocator_type( arena ) )
 , mStartTime( std::numeric_limits<float>::max() )
 , mEndTime( -std::numeric_limits<float>::max() )
 , mAverageFrameDuration( 0.0f )
@@ -123,5 +124,6 @@ template class AnimCurve<ci::Vec3f>;
 template class AnimCurve<ci::Vec3d>;
 template class AnimCurve<ci::Quatd>;
 template class AnimCurve<ci::Quatf>;
+template class AnimCurve<float>;
 
 } //end namespace model
\ No newline at end of file
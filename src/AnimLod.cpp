@@ -0,0 +1,190 @@
+#include "AnimLod.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+namespace model {
+
+namespace {
+	void blendMatrices( const std::vector<ci::Matrix44f>& prev, const std::vector<ci::Matrix44f>& next, float t, ci::Matrix44f* out, size_t count )
+	{
+		count = std::min( count, next.size() );
+		if( t >= 1.0f || prev.size() != next.size() ) {
+			std::copy( next.begin(), next.begin() + count, out );
+			return;
+		}
+		// Linear matrix blending: exact at both ends and close enough in between since
+		// consecutive palettes are at most a few frames apart.
+		for( size_t i = 0; i < count; ++i ) {
+			out[i] = prev[i] * ( 1.0f - t ) + next[i] * t;
+		}
+	}
+}
+
+AnimLodPolicy::AnimLodPolicy()
+{
+	setDistances( 50.0f, 100.0f, 200.0f );
+	setScreenSizes( 200.0f, 100.0f, 50.0f );
+}
+
+AnimLodPolicy::AnimLodPolicy( float halfRateDistance, float quarterRateDistance, float eighthRateDistance )
+{
+	setDistances( halfRateDistance, quarterRateDistance, eighthRateDistance );
+	setScreenSizes( 200.0f, 100.0f, 50.0f );
+}
+
+void AnimLodPolicy::setDistances( float halfRateDistance, float quarterRateDistance, float eighthRateDistance )
+{
+	assert( halfRateDistance <= quarterRateDistance && quarterRateDistance <= eighthRateDistance );
+	mDistances[0] = halfRateDistance;
+	mDistances[1] = quarterRateDistance;
+	mDistances[2] = eighthRateDistance;
+}
+
+void AnimLodPolicy::setScreenSizes( float halfRateSize, float quarterRateSize, float eighthRateSize )
+{
+	assert( halfRateSize >= quarterRateSize && quarterRateSize >= eighthRateSize );
+	mScreenSizes[0] = halfRateSize;
+	mScreenSizes[1] = quarterRateSize;
+	mScreenSizes[2] = eighthRateSize;
+}
+
+int AnimLodPolicy::getIntervalFromDistance( float distance ) const
+{
+	int interval = 1;
+	for( float d : mDistances ) {
+		if( distance < d )
+			break;
+		interval *= 2;
+	}
+	return interval;
+}
+
+int AnimLodPolicy::getIntervalFromScreenSize( float screenSize ) const
+{
+	int interval = 1;
+	for( float s : mScreenSizes ) {
+		if( screenSize > s )
+			break;
+		interval *= 2;
+	}
+	return interval;
+}
+
+AnimLodState::AnimLodState()
+: mInterval( 1 )
+, mPhase( 0 )
+, mFrame( 0 )
+, mLastUpdateFrame( 0 )
+, mNeedsUpdate( true )
+, mHasPhase( false )
+{ }
+
+float AnimLodState::getBlendFactor() const
+{
+	if( mInterval <= 1 || ! hasPalette() )
+		return 1.0f;
+	return std::min( 1.0f, float( mFrame - mLastUpdateFrame + 1 ) / float( mInterval ) );
+}
+
+void AnimLodState::storePalette( const ci::Matrix44f* boneMatrices, const ci::Matrix44f* invTransposeMatrices, size_t nbBones )
+{
+	if( hasPalette() ) {
+		// Start interpolating from what is currently displayed to avoid popping.
+		float t = getBlendFactor();
+		mPrevBoneMatrices.resize( mNextBoneMatrices.size() );
+		mPrevInvTransposeMatrices.resize( mNextInvTransposeMatrices.size() );
+		blendMatrices( mPrevBoneMatrices, mNextBoneMatrices, t, mPrevBoneMatrices.data(), mPrevBoneMatrices.size() );
+		blendMatrices( mPrevInvTransposeMatrices, mNextInvTransposeMatrices, t, mPrevInvTransposeMatrices.data(), mPrevInvTransposeMatrices.size() );
+	}
+	mNextBoneMatrices.assign( boneMatrices, boneMatrices + nbBones );
+	if( invTransposeMatrices ) {
+		mNextInvTransposeMatrices.assign( invTransposeMatrices, invTransposeMatrices + nbBones );
+	} else {
+		mNextInvTransposeMatrices.clear();
+	}
+	if( mPrevBoneMatrices.size() != nbBones ) {
+		mPrevBoneMatrices = mNextBoneMatrices;
+		mPrevInvTransposeMatrices = mNextInvTransposeMatrices;
+	}
+	mLastUpdateFrame = mFrame;
+}
+
+void AnimLodState::blendPalette( ci::Matrix44f* boneMatrices, ci::Matrix44f* invTransposeMatrices, size_t nbBones ) const
+{
+	if( ! hasPalette() )
+		return;
+	float t = getBlendFactor();
+	blendMatrices( mPrevBoneMatrices, mNextBoneMatrices, t, boneMatrices, nbBones );
+	if( invTransposeMatrices ) {
+		blendMatrices( mPrevInvTransposeMatrices, mNextInvTransposeMatrices, t, invTransposeMatrices, nbBones );
+	}
+}
+
+AnimLodScheduler::AnimLodScheduler( size_t maxUpdatesPerFrame )
+: mMaxUpdatesPerFrame( maxUpdatesPerFrame )
+, mNumUpdates( 0 )
+, mFrame( 0 )
+, mNextPhase( 0 )
+{ }
+
+void AnimLodScheduler::beginFrame()
+{
+	++mFrame;
+	mDueStates.clear();
+	mNumUpdates = 0;
+}
+
+void AnimLodScheduler::submit( AnimLodState* state, float distance )
+{
+	submitInterval( state, mPolicy.getIntervalFromDistance( distance ) );
+}
+
+void AnimLodScheduler::submitScreenSize( AnimLodState* state, float screenSize )
+{
+	submitInterval( state, mPolicy.getIntervalFromScreenSize( screenSize ) );
+}
+
+void AnimLodScheduler::submitInterval( AnimLodState* state, int interval )
+{
+	assert( state );
+	if( ! state->mHasPhase ) {
+		// Successive instances get successive phases so that updates are spread across frames.
+		state->mPhase = mNextPhase++ % ( 1 << ( AnimLodPolicy::NB_LEVELS - 1 ) );
+		state->mHasPhase = true;
+	}
+	state->mFrame = mFrame;
+	state->mInterval = interval;
+	state->mNeedsUpdate = false;
+
+	uint32_t elapsed = mFrame - state->mLastUpdateFrame;
+	bool onSlot = ( mFrame + state->mPhase ) % interval == 0;
+	bool missedSlot = elapsed > (uint32_t) interval;
+	if( ! state->hasPalette() || ( elapsed > 0 && ( onSlot || missedSlot ) ) ) {
+		mDueStates.push_back( state );
+	}
+}
+
+void AnimLodScheduler::schedule()
+{
+	if( mMaxUpdatesPerFrame > 0 && mDueStates.size() > mMaxUpdatesPerFrame ) {
+		// Never evaluated instances first, then the stalest ones relative to their interval.
+		auto priority = [this] ( const AnimLodState* s ) {
+			if( ! s->hasPalette() )
+				return std::numeric_limits<float>::max();
+			return float( mFrame - s->mLastUpdateFrame ) / float( s->mInterval );
+		};
+		std::partial_sort( mDueStates.begin(), mDueStates.begin() + mMaxUpdatesPerFrame, mDueStates.end(),
+						  [&priority] ( const AnimLodState* a, const AnimLodState* b ) {
+							  return priority( a ) > priority( b );
+						  } );
+		mDueStates.resize( mMaxUpdatesPerFrame );
+	}
+	for( AnimLodState* state : mDueStates ) {
+		state->mNeedsUpdate = true;
+	}
+	mNumUpdates = mDueStates.size();
+}
+
+} //end namespace model
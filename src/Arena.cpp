@@ -0,0 +1,35 @@
+#include "Arena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace model {
+
+Arena::Arena( size_t blockSize )
+: mBlockSize( blockSize )
+, mCurrent( nullptr )
+, mRemaining( 0 )
+, mBytesAllocated( 0 )
+, mBytesReserved( 0 )
+{ }
+
+void* Arena::allocate( size_t bytes, size_t alignment )
+{
+	size_t padding = ( alignment - reinterpret_cast<uintptr_t>( mCurrent ) % alignment ) % alignment;
+	if( mCurrent == nullptr || padding + bytes > mRemaining ) {
+		// Oversized requests get a block of their own.
+		size_t size = std::max( mBlockSize, bytes + alignment );
+		mBlocks.push_back( std::unique_ptr<char[]>( new char[size] ) );
+		mCurrent = mBlocks.back().get();
+		mRemaining = size;
+		mBytesReserved += size;
+		padding = ( alignment - reinterpret_cast<uintptr_t>( mCurrent ) % alignment ) % alignment;
+	}
+	void* p = mCurrent + padding;
+	mCurrent += padding + bytes;
+	mRemaining -= padding + bytes;
+	mBytesAllocated += bytes;
+	return p;
+}
+
+} //end namespace model
@@ -0,0 +1,209 @@
+#include "BonePalette.h"
+#include "Profiling.h"
+#include "MemoryStats.h"
+
+#include "cinder/gl/gl.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+
+namespace model {
+
+namespace {
+	bool isNonUniformlyScaled( const ci::Matrix44f& m )
+	{
+		float l0 = ci::Vec3f( m.at( 0, 0 ), m.at( 1, 0 ), m.at( 2, 0 ) ).lengthSquared();
+		float l1 = ci::Vec3f( m.at( 0, 1 ), m.at( 1, 1 ), m.at( 2, 1 ) ).lengthSquared();
+		float l2 = ci::Vec3f( m.at( 0, 2 ), m.at( 1, 2 ), m.at( 2, 2 ) ).lengthSquared();
+		float lmin = std::min( l0, std::min( l1, l2 ) ), lmax = std::max( l0, std::max( l1, l2 ) );
+		return lmax - lmin > 1e-3f * lmax;
+	}
+}
+
+bool packAffinePalette( const std::vector<ci::Matrix44f>& boneMatrices, const std::vector<int>& bones, ci::Vec4f* boneRows, ci::Vec4f* normalRows )
+{
+	bool hasNonUniformScale = false;
+	for( size_t i = 0; i < bones.size(); ++i ) {
+		const ci::Matrix44f& m = boneMatrices[ bones[i] ];
+		for( int r = 0; r < 3; ++r ) {
+			boneRows[3 * i + r] = ci::Vec4f( m.at( r, 0 ), m.at( r, 1 ), m.at( r, 2 ), m.at( r, 3 ) );
+		}
+		
+		if( isNonUniformlyScaled( m ) ) {
+			// The inverse transpose is the cofactor matrix up to the determinant, which the shader normalizes away (but for its sign).
+			hasNonUniformScale = true;
+			ci::Vec3f c0( m.at( 0, 0 ), m.at( 1, 0 ), m.at( 2, 0 ) );
+			ci::Vec3f c1( m.at( 0, 1 ), m.at( 1, 1 ), m.at( 2, 1 ) );
+			ci::Vec3f c2( m.at( 0, 2 ), m.at( 1, 2 ), m.at( 2, 2 ) );
+			float sign = ( c0.dot( c1.cross( c2 ) ) < 0.0f ) ? -1.0f : 1.0f;
+			ci::Vec3f n0 = sign * c1.cross( c2 ), n1 = sign * c2.cross( c0 ), n2 = sign * c0.cross( c1 );
+			normalRows[3 * i] = ci::Vec4f( n0.x, n1.x, n2.x, 0.0f );
+			normalRows[3 * i + 1] = ci::Vec4f( n0.y, n1.y, n2.y, 0.0f );
+			normalRows[3 * i + 2] = ci::Vec4f( n0.z, n1.z, n2.z, 0.0f );
+		} else {
+			for( int r = 0; r < 3; ++r ) {
+				normalRows[3 * i + r] = ci::Vec4f( boneRows[3 * i + r].x, boneRows[3 * i + r].y, boneRows[3 * i + r].z, 0.0f );
+			}
+		}
+	}
+	return hasNonUniformScale;
+}
+
+bool hasNonUniformScale( const std::vector<ci::Matrix44f>& boneMatrices )
+{
+	return std::any_of( boneMatrices.begin(), boneMatrices.end(), isNonUniformlyScaled );
+}
+
+namespace {
+	struct CachedUniforms {
+		std::weak_ptr<ci::gl::GlslProg>	mShader;
+		PaletteUniforms					mUniforms;
+	};
+}
+
+const PaletteUniforms& PaletteUniforms::get( const ci::gl::GlslProgRef& shader )
+{
+	// Keyed by shader object, each entry valid only while its shader is alive: the GL names (and the
+	// addresses) of released programs get reused.
+	static std::map<const ci::gl::GlslProg*, CachedUniforms> sUniforms;
+	
+	auto it = sUniforms.find( shader.get() );
+	if( it != sUniforms.end() && ! it->second.mShader.expired() )
+		return it->second.mUniforms;
+	
+	// Drop the entries of released shaders
+	for( auto entry = sUniforms.begin(); entry != sUniforms.end(); ) {
+		if( entry->second.mShader.expired() ) {
+			entry = sUniforms.erase( entry );
+		} else {
+			++entry;
+		}
+	}
+	
+	PaletteUniforms uniforms;
+	uniforms.mBonePalette = shader->getUniformLocation( "bonePalette" );
+	uniforms.mNormalPalette = shader->getUniformLocation( "normalPalette" );
+	uniforms.mBoneMatrices = shader->getUniformLocation( "boneMatrices" );
+	uniforms.mInvTransposeMatrices = shader->getUniformLocation( "invTransposeMatrices" );
+	uniforms.mHasBlock = false;
+#if defined( GL_UNIFORM_BUFFER )
+	if( PaletteBuffer::isSupported() ) {
+		GLuint program = shader->getHandle();
+		GLuint blockIndex = glGetUniformBlockIndex( program, "BonePalette" );
+		if( blockIndex != GL_INVALID_INDEX ) {
+			glUniformBlockBinding( program, blockIndex, PaletteBuffer::BINDING );
+			uniforms.mHasBlock = true;
+		}
+	}
+#endif
+	CachedUniforms& cached = sUniforms[ shader.get() ];
+	cached.mShader = shader;
+	cached.mUniforms = uniforms;
+	return cached.mUniforms;
+}
+
+bool PaletteBuffer::isSupported()
+{
+#if defined( GL_UNIFORM_BUFFER )
+	static bool sSupported = ci::gl::isExtensionAvailable( "GL_ARB_uniform_buffer_object" );
+	return sSupported;
+#else
+	return false;
+#endif
+}
+
+bool PaletteBuffer::isSupported( size_t maxBones )
+{
+#if defined( GL_UNIFORM_BUFFER )
+	if( ! isSupported() )
+		return false;
+	// Sized for the NORMAL_PALETTE permutation, which declares both palettes.
+	static GLint sMaxBlockBytes = [] () -> GLint {
+		GLint bytes = 0;
+		glGetIntegerv( GL_MAX_UNIFORM_BLOCK_SIZE, &bytes );
+		return bytes;
+	}();
+	return 2 * 3 * maxBones * sizeof( ci::Vec4f ) <= size_t( sMaxBlockBytes );
+#else
+	return false;
+#endif
+}
+
+PaletteBuffer::PaletteBuffer( size_t maxBones )
+: mMaxBones( maxBones )
+, mSliceBytes( 2 * 3 * maxBones * sizeof( ci::Vec4f ) )
+, mSliceStride( mSliceBytes )
+, mPendingPalette( nullptr )
+, mPalette( 0 )
+, mNumPalettes( 0 )
+{
+#if defined( GL_UNIFORM_BUFFER )
+	// Bound ranges must start on the implementation's offset alignment.
+	GLint alignment = 0;
+	glGetIntegerv( GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment );
+	if( alignment > 0 ) {
+		mSliceStride = ( mSliceBytes + alignment - 1 ) / alignment * alignment;
+	}
+	mBuffer = ci::gl::Vbo( GL_UNIFORM_BUFFER );
+#endif
+}
+
+size_t PaletteBuffer::addBatch( const BoneBatch& batch )
+{
+	auto it = std::find( mSlices.begin(), mSlices.end(), batch.mBones );
+	if( it != mSlices.end() )
+		return it - mSlices.begin();
+	mSlices.push_back( batch.mBones );
+	return mSlices.size() - 1;
+}
+
+void PaletteBuffer::update( const std::vector<ci::Matrix44f>& boneMatrices )
+{
+	// Deferred to the draw: meshes updated once per instance and drawn from a render queue never upload it.
+	mPendingPalette = &boneMatrices;
+	mPalette = 0;
+}
+
+void PaletteBuffer::update( const std::vector<ci::Matrix44f>* const* palettes, size_t nbPalettes )
+{
+	mPendingPalette = nullptr;
+	mPalette = 0;
+	mNumPalettes = nbPalettes;
+	
+	const size_t vec4PerSlice = mSliceStride / sizeof( ci::Vec4f );
+	mStaging.resize( nbPalettes * mSlices.size() * vec4PerSlice );
+	for( size_t p = 0; p < nbPalettes; ++p ) {
+		for( size_t s = 0; s < mSlices.size(); ++s ) {
+			size_t index = p * mSlices.size() + s;
+			ci::Vec4f* slice = &mStaging[index * vec4PerSlice];
+			packAffinePalette( *palettes[p], mSlices[s], slice, slice + 3 * mMaxBones );
+		}
+	}
+	// Respecify the whole buffer so that the driver does not wait on draws still using the previous palettes.
+	mBuffer.bufferData( mStaging.size() * sizeof( ci::Vec4f ), mStaging.data(), GL_STREAM_DRAW );
+	mBuffer.unbind();
+	MODEL_PROFILE_COUNT( BYTES_UPLOADED, mStaging.size() * sizeof( ci::Vec4f ) );
+}
+
+void PaletteBuffer::bind( size_t slice )
+{
+	if( mPendingPalette ) {
+		const std::vector<ci::Matrix44f>* palette = mPendingPalette;
+		update( &palette, 1 );
+	}
+#if defined( GL_UNIFORM_BUFFER )
+	glBindBufferRange( GL_UNIFORM_BUFFER, BINDING, mBuffer.getId(), ( mPalette * mSlices.size() + slice ) * mSliceStride, mSliceBytes );
+#endif
+}
+
+size_t PaletteBuffer::getCpuBytes() const
+{
+	size_t bytes = memory::vectorBytes( mSlices ) + memory::vectorBytes( mStaging );
+	for( const std::vector<int>& bones : mSlices ) {
+		bytes += memory::vectorBytes( bones );
+	}
+	return bytes;
+}
+
+} //end namespace model
@@ -0,0 +1,115 @@
+#include "BonePartition.h"
+#include "Node.h"
+
+#include <algorithm>
+
+namespace model {
+
+BonePartition partitionBones( const std::vector<uint32_t>& indices, const std::vector<BoneWeights>& boneWeights, size_t maxBones )
+{
+	if( maxBones == 0 || maxBones > 256 )
+		throw ModelTargetException( "Batch palettes must hold between 1 and 256 bones." );
+	
+	int nbBones = 0;
+	for( const BoneWeights& bw : boneWeights ) {
+		for( size_t b = 0; b < bw.mActiveNbWeights; ++b ) {
+			nbBones = std::max( nbBones, bw.getBone( b )->getBoneIndex() + 1 );
+		}
+	}
+	
+	BonePartition partition;
+	partition.mIndices.reserve( indices.size() );
+	partition.mVertexRemap.reserve( boneWeights.size() );
+	partition.mPaletteIndices.reserve( boneWeights.size() );
+	
+	// Palette slot of each bone and partitioned copy of each vertex in the current batch, -1 if absent.
+	std::vector<int> paletteSlot( nbBones, -1 );
+	std::vector<int> vertexCopy( boneWeights.size(), -1 );
+	partition.mBatches.push_back( BoneBatch() );
+	
+	for( size_t t = 0; t + 2 < indices.size(); t += 3 ) {
+		std::vector<int> triangleBones;
+		for( size_t v = t; v < t + 3; ++v ) {
+			const BoneWeights& bw = boneWeights[indices[v]];
+			for( size_t b = 0; b < bw.mActiveNbWeights; ++b ) {
+				int bone = bw.getBone( b )->getBoneIndex();
+				if( paletteSlot[bone] < 0 && std::find( triangleBones.begin(), triangleBones.end(), bone ) == triangleBones.end() )
+					triangleBones.push_back( bone );
+			}
+		}
+		if( triangleBones.size() > maxBones )
+			throw ModelTargetException( "A triangle references more bones than a batch palette holds." );
+		
+		BoneBatch* batch = &partition.mBatches.back();
+		if( batch->mBones.size() + triangleBones.size() > maxBones ) {
+			// Close the batch; the new one starts with empty palette and vertex maps.
+			for( int bone : batch->mBones ) {
+				paletteSlot[bone] = -1;
+			}
+			std::fill( vertexCopy.begin(), vertexCopy.end(), -1 );
+			partition.mBatches.push_back( BoneBatch() );
+			batch = &partition.mBatches.back();
+			batch->mFirstIndex = partition.mIndices.size();
+			
+			triangleBones.clear();
+			for( size_t v = t; v < t + 3; ++v ) {
+				const BoneWeights& bw = boneWeights[indices[v]];
+				for( size_t b = 0; b < bw.mActiveNbWeights; ++b ) {
+					int bone = bw.getBone( b )->getBoneIndex();
+					if( std::find( triangleBones.begin(), triangleBones.end(), bone ) == triangleBones.end() )
+						triangleBones.push_back( bone );
+				}
+			}
+		}
+		for( int bone : triangleBones ) {
+			paletteSlot[bone] = (int) batch->mBones.size();
+			batch->mBones.push_back( bone );
+		}
+		
+		for( size_t v = t; v < t + 3; ++v ) {
+			uint32_t source = indices[v];
+			if( vertexCopy[source] < 0 ) {
+				vertexCopy[source] = (int) partition.mVertexRemap.size();
+				partition.mVertexRemap.push_back( source );
+				
+				const BoneWeights& bw = boneWeights[source];
+				PaletteIndices palette;
+				palette.fill( 0 );
+				for( size_t b = 0; b < bw.mActiveNbWeights; ++b ) {
+					palette[b] = uint8_t( paletteSlot[bw.getBone( b )->getBoneIndex()] );
+				}
+				partition.mPaletteIndices.push_back( palette );
+			}
+			partition.mIndices.push_back( uint32_t( vertexCopy[source] ) );
+		}
+		batch->mNumIndices += 3;
+	}
+	return partition;
+}
+
+std::vector<uint32_t> sortByInfluenceCount( std::vector<uint32_t>* indices, const std::vector<BoneWeights>& boneWeights, InfluenceRuns* runs )
+{
+	// Counting sort on the number of active weights
+	std::array<size_t, BoneWeights::NB_WEIGHTS + 2>& first = runs->mFirst;
+	first.fill( 0 );
+	for( const BoneWeights& bw : boneWeights ) {
+		++first[ bw.mActiveNbWeights + 1 ];
+	}
+	for( size_t n = 1; n < first.size(); ++n ) {
+		first[n] += first[n - 1];
+	}
+	
+	std::array<size_t, BoneWeights::NB_WEIGHTS + 2> next = first;
+	std::vector<uint32_t> remap( boneWeights.size() ), sortedIndex( boneWeights.size() );
+	for( uint32_t v = 0; v < boneWeights.size(); ++v ) {
+		size_t slot = next[ boneWeights[v].mActiveNbWeights ]++;
+		remap[slot] = v;
+		sortedIndex[v] = uint32_t( slot );
+	}
+	for( uint32_t& index : *indices ) {
+		index = sortedIndex[index];
+	}
+	return remap;
+}
+
+} //end namespace model
@@ -0,0 +1,79 @@
+#include "BoneQuery.h"
+#include "Profiling.h"
+
+#include <unordered_map>
+
+namespace model {
+
+BoneQueryRef BoneQuery::create( const SkeletonRef& skeleton, const std::vector<std::string>& boneNames )
+{
+	std::vector<NodeRef> bones;
+	for( const std::string& name : boneNames ) {
+		bones.push_back( skeleton->getBone( name ) );
+	}
+	return create( bones );
+}
+
+BoneQuery::BoneQuery( const std::vector<NodeRef>& bones )
+{
+	std::unordered_map<const Node*, size_t> links;
+	std::vector<NodeRef> ancestors;
+	for( const NodeRef& bone : bones ) {
+		// Walk up to the root or to the first node already in the chain, then append the path top down.
+		ancestors.clear();
+		NodeRef node = bone;
+		while( node && links.find( node.get() ) == links.end() ) {
+			ancestors.push_back( node );
+			node = node->getParent();
+		}
+		int parent = node ? (int) links[ node.get() ] : -1;
+		for( auto it = ancestors.rbegin(); it != ancestors.rend(); ++it ) {
+			Link link;
+			link.mNode = *it;
+			link.mParent = parent;
+			parent = (int) mChain.size();
+			links[ it->get() ] = mChain.size();
+			mChain.push_back( link );
+		}
+		mBoneLinks.push_back( links[ bone.get() ] );
+	}
+	mTransformations.resize( mChain.size() );
+}
+
+void BoneQuery::evaluateChain( size_t last, float time, int animId ) const
+{
+	for( size_t i = 0; i <= last; ++i ) {
+		const Link& link = mChain[i];
+		Transformation& t = mTransformations[i];
+		link.mNode->sampleRelative( time, animId, &t.mPosition, &t.mRotation, &t.mScale );
+		if( link.mParent >= 0 ) {
+			const Transformation& parent = mTransformations[ link.mParent ];
+			Node::composeTransformation( parent.mPosition, parent.mRotation, parent.mScale, &t.mPosition, &t.mRotation, &t.mScale );
+		}
+	}
+	MODEL_PROFILE_COUNT( BONES_EVALUATED, last + 1 );
+}
+
+void BoneQuery::evaluate( float time, int animId, ci::Matrix44f* transformations ) const
+{
+	if( mChain.empty() )
+		return;
+	
+	evaluateChain( mChain.size() - 1, time, animId );
+	for( size_t b = 0; b < mBoneLinks.size(); ++b ) {
+		const Transformation& t = mTransformations[ mBoneLinks[b] ];
+		Node::computeTransformation( t.mPosition, t.mRotation, t.mScale, &transformations[b] );
+	}
+}
+
+ci::Matrix44f BoneQuery::evaluate( size_t bone, float time, int animId ) const
+{
+	// The chain is ordered parents first: nothing after the bone's link is needed.
+	evaluateChain( mBoneLinks[bone], time, animId );
+	const Transformation& t = mTransformations[ mBoneLinks[bone] ];
+	ci::Matrix44f transformation;
+	Node::computeTransformation( t.mPosition, t.mRotation, t.mScale, &transformation );
+	return transformation;
+}
+
+} //end namespace model
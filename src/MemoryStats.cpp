@@ -0,0 +1,47 @@
+#include "MemoryStats.h"
+
+namespace model {
+
+size_t MemoryStats::getCpuBytes() const
+{
+	size_t bytes = 0;
+	for( int i = 0; i < GPU_BUFFERS; ++i ) {
+		bytes += mBytes[i];
+	}
+	return bytes;
+}
+
+MemoryStats& MemoryStats::operator+=( const MemoryStats& rhs )
+{
+	for( int i = 0; i < NB_CATEGORIES; ++i ) {
+		mBytes[i] += rhs.mBytes[i];
+	}
+	return *this;
+}
+
+const char* MemoryStats::getCategoryName( Category category )
+{
+	switch( category ) {
+		case GEOMETRY:		return "Geometry";
+		case SKINNING:		return "Skinning";
+		case BOUNDS:		return "Bounds";
+		case HIERARCHY:		return "Hierarchy";
+		case ANIMATION:		return "Animation";
+		case IMPORTER:		return "Importer";
+		case GPU_BUFFERS:	return "GPU buffers";
+		case GPU_TEXTURES:	return "GPU textures";
+		default:			return "Unknown";
+	}
+}
+
+std::ostream& operator<<( std::ostream& o, const MemoryStats& stats )
+{
+	for( int i = 0; i < MemoryStats::NB_CATEGORIES; ++i ) {
+		MemoryStats::Category category = MemoryStats::Category( i );
+		o << MemoryStats::getCategoryName( category ) << ": " << stats.get( category ) << " bytes" << std::endl;
+	}
+	o << "Total (cpu/gpu): " << stats.getCpuBytes() << " / " << stats.getGpuBytes() << " bytes" << std::endl;
+	return o;
+}
+
+} //end namespace model
@@ -1,7 +1,6 @@
 
 #include "ModelIo.h"
 #include "Node.h"
-#include "ModelSourceAssimp.h"
 
 namespace model {
 
@@ -45,21 +44,9 @@ void ModelTarget::loadSkeleton( const std::shared_ptr<Skeleton>& skeleton ) { }
 void ModelTarget::loadBoneWeights( const std::vector<BoneWeights>& boneWeights ) { }
 
 void ModelTarget::loadDefaultTransformation( const ci::Matrix44f& transformation ) { }
-	
-ModelSourceAssimpRef loadModel( const ci::DataSourceRef dataSource )
-{
-	ci::fs::path relativePath = dataSource->getFilePath();
-	if( relativePath.empty() )
-		relativePath = ci::fs::path( dataSource->getFilePathHint() );
-	return ModelSourceAssimp::create( relativePath );
-}
-
-ModelSourceAssimpRef loadModel( const ci::fs::path& modelPath, const ci::fs::path& rootAssetFolderPath )
-{
-
-	return ModelSourceAssimp::create( modelPath, rootAssetFolderPath );
-}
 
+void ModelTarget::loadMorphTargets( const std::shared_ptr<MorphTargets>& morphTargets ) { }
+	
 ModelIoException::ModelIoException( const std::string &message ) throw()
 //: ModelIoException() no constructor delegation in VS2012 :(
 {
@@ -1,13 +1,17 @@
 #include "ModelSourceAssimp.h"
 #include "CustomIOStream.h"
+#include "MorphTargets.h"
 #include "Skeleton.h"
 #include "Debug.h"
+#include "Profiling.h"
 
 #include "assimp/postprocess.h"
 #include "cinder/ImageIo.h"
+#include "cinder/Surface.h"
 #include "cinder/app/App.h"
 
 #include <boost/algorithm/string.hpp>
+#include <sstream>
 
 namespace ai {
 	unsigned int flags =
@@ -31,6 +35,35 @@ namespace ai {
 //	aiProcess_SplitLargeMeshes |
 //	aiProcess_FindInstances |
 	
+	const std::vector< std::pair<unsigned int, const char*> > postProcessSteps = {
+		{ aiProcess_ValidateDataStructure, "ValidateDataStructure" },
+		{ aiProcess_RemoveComponent, "RemoveComponent" },
+		{ aiProcess_RemoveRedundantMaterials, "RemoveRedundantMaterials" },
+		{ aiProcess_FindInstances, "FindInstances" },
+		{ aiProcess_OptimizeGraph, "OptimizeGraph" },
+		{ aiProcess_OptimizeMeshes, "OptimizeMeshes" },
+		{ aiProcess_FindDegenerates, "FindDegenerates" },
+		{ aiProcess_GenUVCoords, "GenUVCoords" },
+		{ aiProcess_TransformUVCoords, "TransformUVCoords" },
+		{ aiProcess_PreTransformVertices, "PreTransformVertices" },
+		{ aiProcess_Triangulate, "Triangulate" },
+		{ aiProcess_SortByPType, "SortByPType" },
+		{ aiProcess_FindInvalidData, "FindInvalidData" },
+		{ aiProcess_FixInfacingNormals, "FixInfacingNormals" },
+		{ aiProcess_SplitByBoneCount, "SplitByBoneCount" },
+		{ aiProcess_SplitLargeMeshes, "SplitLargeMeshes" },
+		{ aiProcess_GenNormals, "GenNormals" },
+		{ aiProcess_GenSmoothNormals, "GenSmoothNormals" },
+		{ aiProcess_CalcTangentSpace, "CalcTangentSpace" },
+		{ aiProcess_JoinIdenticalVertices, "JoinIdenticalVertices" },
+		{ aiProcess_MakeLeftHanded, "MakeLeftHanded" },
+		{ aiProcess_FlipUVs, "FlipUVs" },
+		{ aiProcess_FlipWindingOrder, "FlipWindingOrder" },
+		{ aiProcess_Debone, "Debone" },
+		{ aiProcess_LimitBoneWeights, "LimitBoneWeights" },
+		{ aiProcess_ImproveCacheLocality, "ImproveCacheLocality" }
+	};
+	
 	ci::Vec3f get( const aiVector3D &v )
 	{
 		return ci::Vec3f( v.x, v.y, v.z );
@@ -103,7 +136,8 @@ namespace ai {
 		return indices;
 	}
 	
-	model::MaterialInfo getTexture( const aiScene* aiscene, const aiMesh *aimesh, ci::fs::path modelPath, ci::fs::path rootPath )
+	model::MaterialInfo getTexture( const aiScene* aiscene, const aiMesh *aimesh, ci::fs::path modelPath, ci::fs::path rootPath,
+								    model::LoadObserver* observer, bool uploadTexture )
 	{
 		model::MaterialInfo matInfo;
 		// Handle material info
@@ -227,13 +261,29 @@ namespace ai {
 			std::string ext = realPath.extension().string();
 			boost::algorithm::to_lower( ext );
 			if ( ext == ".dds" ) {
-				// FIXME: loadDds does not seem to work with mipmaps in the latest cinder version
-				// fix based on the work of javi.agenjo, https://github.com/gaborpapp/Cinder/commit/3e7302
-				matInfo.mTexture = ci::gl::Texture::loadDds( ci::loadFile( realPath )->createStream(), format );
-				if ( !matInfo.mTexture )
-					LOG_M << "failed to laod dds..." << std::endl;
+				ci::DataSourceRef dataSource;
+				{
+					model::ScopedLoadPhase phase( observer, "TextureDecode" );
+					dataSource = ci::loadFile( realPath );
+				}
+				if( uploadTexture ) {
+					model::ScopedLoadPhase phase( observer, "TextureUpload" );
+					// FIXME: loadDds does not seem to work with mipmaps in the latest cinder version
+					// fix based on the work of javi.agenjo, https://github.com/gaborpapp/Cinder/commit/3e7302
+					matInfo.mTexture = ci::gl::Texture::loadDds( dataSource->createStream(), format );
+					if ( !matInfo.mTexture )
+						LOG_M << "failed to laod dds..." << std::endl;
+				}
 			} else {
-				matInfo.mTexture = ci::gl::Texture( ci::loadImage( realPath ), format );
+				ci::Surface8u surface;
+				{
+					model::ScopedLoadPhase phase( observer, "TextureDecode" );
+					surface = ci::Surface8u( ci::loadImage( realPath ) );
+				}
+				if( uploadTexture ) {
+					model::ScopedLoadPhase phase( observer, "TextureUpload" );
+					matInfo.mTexture = ci::gl::Texture( surface, format );
+				}
 			}
 		}
 		return matInfo;
@@ -264,6 +314,7 @@ namespace ai {
 				float weight = aibone->mWeights[w].mWeight;
 				int boneWeightIndex = int( aibone->mWeights[w].mVertexId );
 				boneWeights[boneWeightIndex].addWeight( bone, weight );
+				bone->addInfluence( weight );
 			}
 		}
 		return boneWeights;
@@ -301,7 +352,7 @@ namespace ai {
 		aiVector3D position, scaling;
 		aiQuaternion rotation;
 		ainode->mTransformation.Decompose( scaling, rotation, position );
-		model::NodeRef node = model::NodeRef( new model::Node( ai::get(position), ai::get(rotation), ai::get(scaling), name, parent, level ) );
+		model::NodeRef node = model::Node::create( ai::get(position), ai::get(rotation), ai::get(scaling), name, parent, level, skeleton->getArena() );
 		
 		if( skeleton->hasBone( name ) ) {
 			node->setBoneIndex( skeleton->findBoneIndex( name ) );
@@ -350,7 +401,58 @@ namespace ai {
 		}
 	}
 	
-	model::SkeletonRef getSkeleton( const aiScene* aiscene, bool hasAnimations, const aiNode* root )
+	/*!
+	 * Sparse targets of the anim meshes of \a aimesh, relative to its \a positions and \a normals. Assimp
+	 * has no morph weights: a mesh channel key selects the anim mesh replacing the vertices. The keys
+	 * become weight curves, 1 for the selected target and 0 for the others, crossfading between keys.
+	 */
+	model::MorphTargetsRef getMorphTargets( const aiScene* aiscene, const aiMesh* aimesh, const std::vector<ci::Vec3f>& positions,
+											const std::vector<ci::Vec3f>& normals )
+	{
+		model::MorphTargetsRef morphTargets = model::MorphTargets::create();
+		for( unsigned int m=0; m < aimesh->mNumAnimMeshes; ++m ) {
+			const aiAnimMesh* animMesh = aimesh->mAnimMeshes[m];
+			std::stringstream name;
+			name << get( aimesh->mName ) << "." << m;
+			if( animMesh->mNumVertices != aimesh->mNumVertices ) {
+				LOG_M << "Anim mesh " << name.str() << " does not match the vertices of its mesh." << std::endl;
+				morphTargets->addTarget( model::MorphTarget() );
+				continue;
+			}
+			std::vector<ci::Vec3f> targetPositions = positions, targetNormals;
+			if( animMesh->mVertices ) {
+				for( unsigned int i=0; i < animMesh->mNumVertices; ++i ) {
+					targetPositions[i] = ai::get( animMesh->mVertices[i] );
+				}
+			}
+			if( animMesh->mNormals && ! normals.empty() ) {
+				for( unsigned int i=0; i < animMesh->mNumVertices; ++i ) {
+					targetNormals.push_back( -ai::get( animMesh->mNormals[i] ) );
+				}
+			}
+			morphTargets->addTarget( model::createMorphTarget( name.str(), positions, targetPositions, normals, targetNormals ) );
+		}
+		
+		for( unsigned int a=0; a < aiscene->mNumAnimations; ++a ) {
+			const aiAnimation* anim = aiscene->mAnimations[a];
+			for( unsigned int c=0; c < anim->mNumMeshChannels; ++c ) {
+				const aiMeshAnim* meshAnim = anim->mMeshChannels[c];
+				if( get( meshAnim->mName ) != get( aimesh->mName ) )
+					continue;
+				float tsecs = ( anim->mTicksPerSecond != 0 ) ? (float) anim->mTicksPerSecond : 25.0f;
+				morphTargets->addWeightTrack( a, float( anim->mDuration ), tsecs );
+				for( unsigned int k=0; k < meshAnim->mNumKeys; ++k ) {
+					const aiMeshKey& key = meshAnim->mKeys[k];
+					for( unsigned int t=0; t < aimesh->mNumAnimMeshes; ++t ) {
+						morphTargets->addWeightKeyframe( a, t, (float) key.mTime, ( key.mValue == t ) ? 1.0f : 0.0f );
+					}
+				}
+			}
+		}
+		return morphTargets;
+	}
+	
+	model::SkeletonRef getSkeleton( const aiScene* aiscene, bool hasAnimations, const aiNode* root, model::LoadObserver* observer )
 	{
 		root = ( root ) ? root : aiscene->mRootNode;
 		
@@ -364,13 +466,76 @@ namespace ai {
 		}
 		
 		model::SkeletonRef skeleton = model::Skeleton::create( boneNames );
-		skeleton->setRootNode( generateNodeHierarchy( skeleton.get(), root ) );
+		// The nodes, tracks and keyframes of the model share one arena, released with the skeleton.
+		skeleton->setArena( model::Arena::create() );
+		{
+			model::ScopedLoadPhase phase( observer, "NodeHierarchy" );
+			skeleton->setRootNode( generateNodeHierarchy( skeleton.get(), root ) );
+		}
 		if( hasAnimations ) {
+			model::ScopedLoadPhase phase( observer, "AnimationCurves" );
 			generateAnimationCurves( skeleton, aiscene );
 		}
 		return skeleton;
 	}
 	
+	//! Heap size of a node subtree (the meshes and animations are counted separately).
+	size_t getNodeMemoryUsage( const aiNode* ainode )
+	{
+		size_t bytes = sizeof( aiNode ) + ainode->mNumMeshes * sizeof( unsigned int ) + ainode->mNumChildren * sizeof( aiNode* );
+		for( unsigned int c=0; c < ainode->mNumChildren; ++c ) {
+			bytes += getNodeMemoryUsage( ainode->mChildren[c] );
+		}
+		return bytes;
+	}
+	
+	size_t getSceneMemoryUsage( const aiScene* aiscene )
+	{
+		size_t bytes = sizeof( aiScene ) + getNodeMemoryUsage( aiscene->mRootNode );
+		for( unsigned int m=0; m < aiscene->mNumMeshes; ++m ) {
+			const aiMesh* aimesh = aiscene->mMeshes[m];
+			size_t nbVertexArrays = ( aimesh->mVertices ? 1 : 0 ) + ( aimesh->mNormals ? 1 : 0 )
+								  + ( aimesh->mTangents ? 1 : 0 ) + ( aimesh->mBitangents ? 1 : 0 );
+			for( unsigned int t=0; t < AI_MAX_NUMBER_OF_TEXTURECOORDS; ++t ) {
+				nbVertexArrays += aimesh->mTextureCoords[t] ? 1 : 0;
+			}
+			bytes += sizeof( aiMesh ) + aimesh->mNumVertices * nbVertexArrays * sizeof( aiVector3D );
+			for( unsigned int c=0; c < AI_MAX_NUMBER_OF_COLOR_SETS; ++c ) {
+				bytes += aimesh->mColors[c] ? aimesh->mNumVertices * sizeof( aiColor4D ) : 0;
+			}
+			bytes += aimesh->mNumFaces * sizeof( aiFace );
+			for( unsigned int f=0; f < aimesh->mNumFaces; ++f ) {
+				bytes += aimesh->mFaces[f].mNumIndices * sizeof( unsigned int );
+			}
+			for( unsigned int b=0; b < aimesh->mNumBones; ++b ) {
+				bytes += sizeof( aiBone ) + aimesh->mBones[b]->mNumWeights * sizeof( aiVertexWeight );
+			}
+			for( unsigned int m=0; m < aimesh->mNumAnimMeshes; ++m ) {
+				const aiAnimMesh* animMesh = aimesh->mAnimMeshes[m];
+				size_t nbAnimArrays = ( animMesh->mVertices ? 1 : 0 ) + ( animMesh->mNormals ? 1 : 0 );
+				bytes += sizeof( aiAnimMesh ) + animMesh->mNumVertices * nbAnimArrays * sizeof( aiVector3D );
+			}
+		}
+		for( unsigned int a=0; a < aiscene->mNumAnimations; ++a ) {
+			const aiAnimation* anim = aiscene->mAnimations[a];
+			bytes += sizeof( aiAnimation );
+			for( unsigned int c=0; c < anim->mNumChannels; ++c ) {
+				const aiNodeAnim* nodeAnim = anim->mChannels[c];
+				bytes += sizeof( aiNodeAnim ) + ( nodeAnim->mNumPositionKeys + nodeAnim->mNumScalingKeys ) * sizeof( aiVectorKey )
+					   + nodeAnim->mNumRotationKeys * sizeof( aiQuatKey );
+			}
+			for( unsigned int c=0; c < anim->mNumMeshChannels; ++c ) {
+				bytes += sizeof( aiMeshAnim ) + anim->mMeshChannels[c]->mNumKeys * sizeof( aiMeshKey );
+			}
+		}
+		for( unsigned int t=0; t < aiscene->mNumTextures; ++t ) {
+			const aiTexture* texture = aiscene->mTextures[t];
+			// Compressed embedded textures store their byte size in mWidth.
+			bytes += sizeof( aiTexture ) + ( texture->mHeight == 0 ? texture->mWidth : texture->mWidth * texture->mHeight * sizeof( aiTexel ) );
+		}
+		return bytes;
+	}
+	
 } //end namespace ai
 
 namespace model {
@@ -382,7 +547,12 @@ namespace model {
 				<< " Materials :" << mHasMaterials << std::endl;
 	}
 
-ModelSourceAssimp::ModelSourceAssimp( const ci::fs::path& modelPath, const ci::fs::path& rootAssetFolderPath )
+ModelSourceAssimp::ModelSourceAssimp( const ci::fs::path& modelPath, const ci::fs::path& rootAssetFolderPath, LoadObserver* observer )
+: mHasSkeleton( false )
+, mHasAnimations( false )
+, mObserver( observer )
+, mUploadTextures( true )
+, mCollapseStaticNodes( false )
 {
 	mModelPath = modelPath;
 	mRootAssetFolderPath = rootAssetFolderPath;
@@ -390,7 +560,20 @@ ModelSourceAssimp::ModelSourceAssimp( const ci::fs::path& modelPath, const ci::f
 	mImporter = std::unique_ptr<Assimp::Importer>( new Assimp::Importer() );
 	mImporter->SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_POINT | aiPrimitiveType_LINE);
 //	mImporter->SetIOHandler( new CustomIOSystem() );
-	mAiScene = mImporter->ReadFile( mModelPath.string(), ai::flags );
+	if( mObserver ) {
+		{
+			ScopedLoadPhase phase( mObserver, "ReadFile" );
+			mAiScene = mImporter->ReadFile( mModelPath.string(), 0 );
+		}
+		for( const auto& step : ai::postProcessSteps ) {
+			if( mAiScene && ( ai::flags & step.first ) ) {
+				ScopedLoadPhase phase( mObserver, std::string( "PostProcess:" ) + step.second );
+				mAiScene = mImporter->ApplyPostProcessing( step.first );
+			}
+		}
+	} else {
+		mAiScene = mImporter->ReadFile( mModelPath.string(), ai::flags );
+	}
 	
 	if( !mAiScene ) {
 		LOG_M << mImporter->GetErrorString() << std::endl;
@@ -416,16 +599,22 @@ ModelSourceAssimp::ModelSourceAssimp( const ci::fs::path& modelPath, const ci::f
 	}
 }
 
-ModelSourceAssimpRef ModelSourceAssimp::create( const ci::fs::path& modelPath, const ci::fs::path& rootAssetFolderPath )
+ModelSourceAssimpRef ModelSourceAssimp::create( const ci::fs::path& modelPath, const ci::fs::path& rootAssetFolderPath, LoadObserver* observer )
 {
-	return ModelSourceAssimpRef( new ModelSourceAssimp( modelPath, rootAssetFolderPath ) );
+	return ModelSourceAssimpRef( new ModelSourceAssimp( modelPath, rootAssetFolderPath, observer ) );
 }
 
 void ModelSourceAssimp::load( ModelTarget *target )
 {
+	MODEL_PROFILE_SCOPE( "ModelSourceAssimp::load" );
 	SkeletonRef skeleton = target->getSkeleton();
 	if( mHasSkeleton && skeleton == nullptr ) {
-		skeleton = ai::getSkeleton( mAiScene, mHasAnimations );
+		skeleton = ai::getSkeleton( mAiScene, mHasAnimations, nullptr, mObserver );
+		if( mCollapseStaticNodes ) {
+			ScopedLoadPhase phase( mObserver, "CollapseNodes" );
+			size_t removed = skeleton->collapseStaticNodes( mPinnedNodes );
+			LOG_M << "collapsed " << removed << " static nodes, " << skeleton->getNumNodes() << " left" << std::endl;
+		}
 	}
 	
 	for( unsigned int i=0; i< mAiScene->mNumMeshes; ++i ) {
@@ -438,23 +627,59 @@ void ModelSourceAssimp::load( ModelTarget *target )
 				<< " #faces:" << aimesh->mNumFaces
 				<< " #vertices:" << aimesh->mNumVertices << std::endl;
 		
+		std::vector<uint32_t> indices;
+		std::vector<ci::Vec3f> positions, normals;
+		std::vector<ci::Vec2f> texCoords;
+		{
+			ScopedLoadPhase phase( mObserver, "VertexExtraction" );
+			indices = ai::getIndices( aimesh );
+			positions = ai::getPositions( aimesh );
+			if( mSections[i].mHasNormals ) {
+				normals = ai::getNormals( aimesh );
+			}
+			if( mSections[i].mHasMaterials ) {
+				texCoords = ai::getTexCoords( aimesh );
+			}
+		}
+		
+		MaterialInfo matInfo;
+		if( mSections[i].mHasMaterials ) {
+			matInfo = ai::getTexture( mAiScene, aimesh, mModelPath, mRootAssetFolderPath, mObserver, mUploadTextures );
+		}
+		
+		MorphTargetsRef morphTargets;
+		if( aimesh->mNumAnimMeshes > 0 ) {
+			ScopedLoadPhase phase( mObserver, "MorphTargets" );
+			morphTargets = ai::getMorphTargets( mAiScene, aimesh, positions, normals );
+		}
+		
+		std::vector<BoneWeights> boneWeights;
+		if( mSections[i].mHasSkeleton && skeleton ) {
+			ScopedLoadPhase phase( mObserver, "BoneWeights" );
+			boneWeights = ai::getBoneWeights( aimesh, skeleton.get() );
+		}
+		
+		ScopedLoadPhase phase( mObserver, "Target" );
 		target->setActiveSection( i );
 		target->loadName( name );
-		target->loadIndices( ai::getIndices( aimesh ) );
-		target->loadVertexPositions( ai::getPositions( aimesh ) );
+		target->loadIndices( indices );
+		target->loadVertexPositions( positions );
 		
 		if( mSections[i].mHasNormals ) {
-			target->loadVertexNormals( ai::getNormals( aimesh ) );
+			target->loadVertexNormals( normals );
 		}
 		
 		if( mSections[i].mHasMaterials ) {
-			target->loadTex( ai::getTexCoords( aimesh ),
-							 ai::getTexture(mAiScene, aimesh, mModelPath, mRootAssetFolderPath ) );
+			target->loadTex( texCoords, matInfo );
+		}
+		
+		if( morphTargets ) {
+			target->loadMorphTargets( morphTargets );
 		}
 		
 		if( mSections[i].mHasSkeleton && skeleton ) {
 			target->loadSkeleton( skeleton );
-			target->loadBoneWeights( ai::getBoneWeights( aimesh, skeleton.get() ) );
+			target->loadBoneWeights( boneWeights );
 		} else {
 			const aiNode* ainode = ai::findMeshNode( name, mAiScene, mAiScene->mRootNode );
 			if( ainode ) {
@@ -464,4 +689,28 @@ void ModelSourceAssimp::load( ModelTarget *target )
 	}
 }
 
+MemoryStats ModelSourceAssimp::getMemoryStats() const
+{
+	MemoryStats stats;
+	stats.add( MemoryStats::IMPORTER, sizeof( ModelSourceAssimp ) + sizeof( Assimp::Importer ) + memory::vectorBytes( mSections ) );
+	if( mAiScene ) {
+		stats.add( MemoryStats::IMPORTER, ai::getSceneMemoryUsage( mAiScene ) );
+	}
+	return stats;
+}
+
+ModelSourceAssimpRef loadModel( const ci::DataSourceRef dataSource )
+{
+	ci::fs::path relativePath = dataSource->getFilePath();
+	if( relativePath.empty() )
+		relativePath = ci::fs::path( dataSource->getFilePathHint() );
+	return ModelSourceAssimp::create( relativePath );
+}
+
+ModelSourceAssimpRef loadModel( const ci::fs::path& modelPath, const ci::fs::path& rootAssetFolderPath )
+{
+
+	return ModelSourceAssimp::create( modelPath, rootAssetFolderPath );
+}
+
 } //end namespace model
@@ -1,7 +1,9 @@
 
 #include "ModelTargetSkinnedMesh.h"
 #include "SkinnedMesh.h"
+#include "MorphTargets.h"
 #include "Skeleton.h"
+#include "Node.h"
 
 namespace model {
 
@@ -28,6 +30,7 @@ void ModelTargetSkinnedMesh::loadVertexPositions( const std::vector<ci::Vec3f> &
 {
 	mSkinnedMesh->getActiveSection()->mInitialPositions = positions;
 	mSkinnedMesh->getActiveSection()->mTriMesh.appendVertices( positions.data(), positions.size() );
+	mSkinnedMesh->getActiveSection()->computeBounds( positions );
 }
 
 void ModelTargetSkinnedMesh::loadIndices( const std::vector<uint32_t>& indices )
@@ -57,6 +60,7 @@ void ModelTargetSkinnedMesh::loadSkeleton( const SkeletonRef& skeleton )
 void ModelTargetSkinnedMesh::loadBoneWeights( const std::vector<BoneWeights>& boneWeights )
 {
 	mSkinnedMesh->getActiveSection()->setBoneWeights( boneWeights );
+	mSkinnedMesh->getActiveSection()->computeBounds( mSkinnedMesh->getActiveSection()->mInitialPositions, boneWeights );
 }
 
 void ModelTargetSkinnedMesh::loadDefaultTransformation( const ci::Matrix44f& transformation )
@@ -64,4 +68,38 @@ void ModelTargetSkinnedMesh::loadDefaultTransformation( const ci::Matrix44f& tra
 	mSkinnedMesh->setDefaultTransformation( transformation );
 }
 
+void ModelTargetSkinnedMesh::loadMorphTargets( const MorphTargetsRef& morphTargets )
+{
+	mSkinnedMesh->getActiveSection()->setMorphTargets( morphTargets );
+}
+
+void ModelTargetSkinnedMesh::finishLoading()
+{
+	for( const SkinnedMesh::MeshSectionRef& section : mSkinnedMesh->getSections() ) {
+		if( ! section->getBoneWeights().empty() ) {
+			NodeRef rigidBone = findRigidBone( section->getBoneWeights() );
+			if( rigidBone ) {
+				// The per-bone bounds computed from the weights stay valid.
+				section->setKind( AMeshSection::KIND_RIGID, rigidBone );
+				std::vector<BoneWeights>().swap( section->getBoneWeights() );
+			} else {
+				section->setKind( AMeshSection::KIND_SKINNED );
+				section->sortVerticesByInfluence();
+			}
+		} else if( section->hasDefaultTransformation() ) {
+			transformVertices( section->getDefaultTranformation(), &section->mInitialPositions, &section->mInitialNormals );
+			if( section->hasMorphTargets() )
+				section->getMorphTargets()->transform( section->getDefaultTranformation() );
+			section->mTriMesh.getVertices() = section->mInitialPositions;
+			if( section->hasNormals() )
+				section->mTriMesh.getNormals() = section->mInitialNormals;
+			section->clearDefaultTransformation();
+			section->computeBounds( section->mInitialPositions );
+		}
+		if( section->hasMorphTargets() ) {
+			section->inflateBounds( section->getMorphTargets()->getMaxDisplacement() );
+		}
+	}
+}
+
 } //end namespace model
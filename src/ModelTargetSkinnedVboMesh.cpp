@@ -1,50 +1,344 @@
 #include "ModelTargetSkinnedVboMesh.h"
 
+#include "MorphTargets.h"
+#include "Node.h"
 #include "Skeleton.h"
 #include "SkinnedVboMesh.h"
+#include "Profiling.h"
+
+#include <algorithm>
+#include <cstddef>
 
 namespace model {
 
+namespace {
+	//! Largest atlas the merge builds, in texels.
+	const int MAX_ATLAS_SIZE = 4096;
+	const int ATLAS_PADDING = 2;
+}
+
 ModelTargetSkinnedVboMesh::ModelTargetSkinnedVboMesh( SkinnedVboMesh * mesh )
 : mSkinnedVboMesh( mesh )
-, mSubDataOffset(0)
-, mAttribLocation(0)
+, mShaderAttribs( ShaderAttribs::get( mesh->getShader() ) )
+, mActiveIndex( 0 )
+, mHasStagedSection( false )
+{ }
+
+void ModelTargetSkinnedVboMesh::addAttrib( std::vector<VertexAttrib>* attribs, VertexSemantic semantic, GLint size, GLenum type, GLboolean normalized, size_t offset,
+										   bool streamed ) const
 {
+	if( mShaderAttribs.mLocations[semantic] < 0 )
+		throw ModelTargetException( "Discrepancy between what the model target expects and what its shader attributes use." );
 	
+	VertexAttrib vertexAttrib;
+	vertexAttrib.mSemantic = semantic;
+	vertexAttrib.mLocation = mShaderAttribs.mLocations[semantic];
+	vertexAttrib.mSize = size;
+	vertexAttrib.mType = type;
+	vertexAttrib.mNormalized = normalized;
+	vertexAttrib.mOffset = offset;
+	vertexAttrib.mStreamed = streamed;
+	attribs->push_back( vertexAttrib );
 }
 
-void ModelTargetSkinnedVboMesh::incrementOffsets( size_t dataSize )
+void ModelTargetSkinnedVboMesh::finishSection()
 {
-	mSubDataOffset += dataSize;
-	mAttribLocation++;
+	if( ! mHasStagedSection )
+		return;
+	
+	const MeshVboSectionRef& section = mSkinnedVboMesh->getActiveSection();
+	if( mGeometry.mBoneWeights.empty() && section->hasDefaultTransformation() ) {
+		// Static sections are drawn in place, without a model view change of their own.
+		transformVertices( section->getDefaultTranformation(), &mGeometry.mPositions, &mGeometry.mNormals );
+		if( section->hasMorphTargets() )
+			section->getMorphTargets()->transform( section->getDefaultTranformation() );
+		section->clearDefaultTransformation();
+		section->computeBounds( mGeometry.mPositions );
+	}
+	
+	if( mSkinnedVboMesh->getFormat().isMergingSections() ) {
+		StagedSection staged;
+		staged.mIndex = mActiveIndex;
+		staged.mGeometry.mPositions.swap( mGeometry.mPositions );
+		staged.mGeometry.mNormals.swap( mGeometry.mNormals );
+		staged.mGeometry.mTexCoords.swap( mGeometry.mTexCoords );
+		staged.mGeometry.mBoneWeights.swap( mGeometry.mBoneWeights );
+		staged.mGeometry.mIndices.swap( mGeometry.mIndices );
+		mStagedSections.push_back( staged );
+	} else {
+		SubSection subSection;
+		subSection.mSourceIndex = mActiveIndex;
+		uploadSection( section, mGeometry, std::vector<SubSection>( 1, subSection ) );
+	}
+	mGeometry.clear();
+	mHasStagedSection = false;
 }
 
-template<class T>
-void ModelTargetSkinnedVboMesh::bufferSubData( const T& buffer, size_t dataSize )
+void ModelTargetSkinnedVboMesh::finishLoading()
 {
-	ci::gl::VboMesh& vboMesh = mSkinnedVboMesh->getActiveSection()->getVboMesh();
-	vboMesh.getStaticVbo().bufferSubData( mSubDataOffset, dataSize, buffer.data() );
-	vboMesh.getStaticVbo().unbind();
+	finishSection();
+	if( mSkinnedVboMesh->getFormat().isMergingSections() ) {
+		mergeSections();
+	}
 }
 
-void ModelTargetSkinnedVboMesh::setCustomAttribute( GLuint location, const std::string& name )
+void ModelTargetSkinnedVboMesh::mergeSections()
 {
-	MeshVboSectionRef sect = mSkinnedVboMesh->getActiveSection();
-	mSkinnedVboMesh->getShader()->bind();
-	GLint attribLocation = mSkinnedVboMesh->getShader()->getAttribLocation( name );
+	const std::vector<MeshVboSectionRef>& sections = mSkinnedVboMesh->getSections();
+	bool allowAtlas = mSkinnedVboMesh->getFormat().isBuildingAtlas();
+	
+	// Greedy grouping, in load order
+	std::vector< std::vector<size_t> > groups;
+	for( size_t s = 0; s < mStagedSections.size(); ++s ) {
+		const StagedSection& staged = mStagedSections[s];
+		auto compatible = [&] ( size_t other ) {
+			return canMergeSections( *sections[ mStagedSections[other].mIndex ], mStagedSections[other].mGeometry, *sections[ staged.mIndex ], staged.mGeometry, allowAtlas );
+		};
+		auto group = std::find_if( groups.begin(), groups.end(), [&] ( const std::vector<size_t>& g ) { return std::all_of( g.begin(), g.end(), compatible ); } );
+		if( group != groups.end() ) {
+			group->push_back( s );
+		} else {
+			groups.push_back( std::vector<size_t>( 1, s ) );
+		}
+	}
+	
+	std::vector<MeshVboSectionRef> merged;
+	for( const std::vector<size_t>& group : groups ) {
+		for( const std::vector<size_t>& g : splitByTexture( group ) ) {
+			uploadGroup( g );
+			merged.push_back( sections[ mStagedSections[ g.front() ].mIndex ] );
+		}
+	}
+	mStagedSections.clear();
+	mSkinnedVboMesh->setSections( merged );
+}
 
-	if( attribLocation < 0 )
-		throw ModelTargetException( "Discrepancy between what the model target expects and what its shader attributes use." );
+std::vector< std::vector<size_t> > ModelTargetSkinnedVboMesh::splitByTexture( const std::vector<size_t>& group ) const
+{
+	const std::vector<MeshVboSectionRef>& sections = mSkinnedVboMesh->getSections();
+	std::vector<ci::Vec2i> sizes;
+	std::vector<GLuint> ids;
+	std::vector< std::vector<size_t> > byTexture;
+	for( size_t s : group ) {
+		const ci::gl::Texture& texture = sections[ mStagedSections[s].mIndex ]->getMatInfo().mTexture;
+		GLuint id = texture ? texture.getId() : 0;
+		size_t t = std::find( ids.begin(), ids.end(), id ) - ids.begin();
+		if( t == ids.size() ) {
+			ids.push_back( id );
+			sizes.push_back( texture ? ci::Vec2i( texture.getWidth(), texture.getHeight() ) : ci::Vec2i( 1, 1 ) );
+			byTexture.push_back( std::vector<size_t>() );
+		}
+		byTexture[t].push_back( s );
+	}
+	
+	AtlasLayout layout;
+	if( ids.size() <= 1 || packAtlas( sizes, MAX_ATLAS_SIZE, ATLAS_PADDING, &layout ) ) {
+		return std::vector< std::vector<size_t> >( 1, group );
+	}
+	return byTexture;
+}
 
-	sect->getVboMesh().setCustomStaticLocation( location, attribLocation );
-	mSkinnedVboMesh->getShader()->unbind();
+void ModelTargetSkinnedVboMesh::uploadGroup( const std::vector<size_t>& group )
+{
+	const std::vector<MeshVboSectionRef>& sections = mSkinnedVboMesh->getSections();
+	MeshVboSectionRef head = sections[ mStagedSections[ group.front() ].mIndex ];
+	
+	// Textures of the group, packed in an atlas when they differ
+	std::vector<ci::gl::Texture> textures;
+	std::vector<size_t> textureIndices;
+	for( size_t s : group ) {
+		const ci::gl::Texture& texture = sections[ mStagedSections[s].mIndex ]->getMatInfo().mTexture;
+		size_t t = 0;
+		if( texture ) {
+			while( t < textures.size() && textures[t].getId() != texture.getId() ) {
+				++t;
+			}
+			if( t == textures.size() ) {
+				textures.push_back( texture );
+			}
+		}
+		textureIndices.push_back( t );
+	}
+	if( textures.size() > 1 ) {
+		std::vector<ci::Vec2i> sizes;
+		for( const ci::gl::Texture& texture : textures ) {
+			sizes.push_back( ci::Vec2i( texture.getWidth(), texture.getHeight() ) );
+		}
+		AtlasLayout layout;
+		packAtlas( sizes, MAX_ATLAS_SIZE, ATLAS_PADDING, &layout );
+		for( size_t i = 0; i < group.size(); ++i ) {
+			remapTexCoords( &mStagedSections[ group[i] ].mGeometry.mTexCoords, layout.mRects[ textureIndices[i] ], layout.mSize );
+		}
+		MaterialInfo matInfo = head->getMatInfo();
+		matInfo.mTexture = createAtlasTexture( textures, layout );
+		head->setMatInfo( matInfo );
+	}
+	
+	std::vector<const SectionGeometry*> parts;
+	std::vector<SubSection> subSections;
+	for( size_t s : group ) {
+		parts.push_back( &mStagedSections[s].mGeometry );
+		SubSection subSection;
+		subSection.mSourceIndex = mStagedSections[s].mIndex;
+		subSections.push_back( subSection );
+	}
+	SectionGeometry geometry = mergeGeometry( parts );
+	if( group.size() > 1 ) {
+		head->computeBounds( geometry.mPositions, geometry.mBoneWeights );
+	}
+	uploadSection( head, geometry, subSections );
+}
+
+void ModelTargetSkinnedVboMesh::uploadSection( const MeshVboSectionRef& section, SectionGeometry& geometry, const std::vector<SubSection>& subSections )
+{
+	if( ! geometry.mBoneWeights.empty() ) {
+		// Merged sections are classified as a whole: rigid parts bound to different bones make a skinned section.
+		NodeRef rigidBone = findRigidBone( geometry.mBoneWeights );
+		if( rigidBone ) {
+			// Drawn with the bone matrix as model transformation: no weights, batches nor skinning permutation.
+			section->setKind( AMeshSection::KIND_RIGID, rigidBone );
+			geometry.mBoneWeights.clear();
+		} else {
+			section->setKind( AMeshSection::KIND_SKINNED );
+		}
+	}
+	if( ! geometry.mBoneWeights.empty() ) {
+		// Regroup the triangles into batches fitting the shader palette, duplicating the vertices they share.
+		BonePartition partition = partitionBones( geometry.mIndices, geometry.mBoneWeights, mSkinnedVboMesh->getFormat().getMaxBonesPerBatch() );
+		geometry.mPositions = remapVertices( geometry.mPositions, partition.mVertexRemap );
+		geometry.mNormals = remapVertices( geometry.mNormals, partition.mVertexRemap );
+		geometry.mTexCoords = remapVertices( geometry.mTexCoords, partition.mVertexRemap );
+		geometry.mBoneWeights = remapVertices( geometry.mBoneWeights, partition.mVertexRemap );
+		geometry.mVertexSubSections = remapVertices( geometry.mVertexSubSections, partition.mVertexRemap );
+		if( section->hasMorphTargets() )
+			section->getMorphTargets()->remapVertices( partition.mVertexRemap );
+		geometry.mIndices.swap( partition.mIndices );
+		mPaletteIndices.swap( partition.mPaletteIndices );
+		section->setBatches( partition.mBatches );
+	}
+	// Triangles of a sub-section are kept contiguous within each batch, so that it can be hidden.
+	section->setSubSections( subSections, sortBySubSection( &geometry.mIndices, section->getBatches(), geometry.mVertexSubSections ) );
+	
+	// Morphed vertices are streamed as floats.
+	if( mSkinnedVboMesh->getFormat().isPackingVertices() && ! section->hasMorphTargets() ) {
+		finishPackedSection( section, geometry );
+	} else {
+		finishFloatSection( section, geometry );
+	}
+	section->setShaderFeatures( getShaderFeatures( section, geometry ) );
+	if( section->hasMorphTargets() ) {
+		section->inflateBounds( section->getMorphTargets()->getMaxDisplacement() );
+	}
+	mPaletteIndices.clear();
+}
+
+ShaderFeatures ModelTargetSkinnedVboMesh::getShaderFeatures( const MeshVboSectionRef& section, const SectionGeometry& geometry ) const
+{
+	ShaderFeatures features = 0;
+	if( ! geometry.mBoneWeights.empty() ) {
+		size_t maxInfluences = 1;
+		for( const BoneWeights& boneWeights : geometry.mBoneWeights ) {
+			maxInfluences = std::max( maxInfluences, boneWeights.mActiveNbWeights );
+		}
+		features = setMaxInfluences( features | SHADER_SKINNED, (int) maxInfluences );
+	}
+	if( ! geometry.mNormals.empty() )
+		features |= SHADER_NORMALS;
+	if( ! geometry.mTexCoords.empty() && section->getMatInfo().mTexture )
+		features |= SHADER_TEXTURE;
+	if( section->isPacked() )
+		features |= SHADER_PACKED_VERTICES;
+	return features;
+}
+
+void ModelTargetSkinnedVboMesh::finishFloatSection( const MeshVboSectionRef& section, const SectionGeometry& geometry )
+{
+	const std::vector<ci::Vec3f>& positions = geometry.mPositions;
+	const std::vector<ci::Vec3f>& normals = geometry.mNormals;
+	const std::vector<ci::Vec2f>& texCoords = geometry.mTexCoords;
+	const std::vector<BoneWeights>& boneWeights = geometry.mBoneWeights;
+	
+	// Positions and normals of morphed sections are tightly packed blocks of the streamed buffer.
+	bool streamed = section->hasMorphTargets();
+	std::vector<VertexAttrib> attribs;
+	size_t stride = 0;
+	if( streamed ) {
+		addAttrib( &attribs, ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, 0, true );
+		if( ! normals.empty() )
+			addAttrib( &attribs, ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, positions.size() * sizeof( ci::Vec3f ), true );
+	} else {
+		addAttrib( &attribs, ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, stride );
+		stride += sizeof( ci::Vec3f );
+		if( ! normals.empty() ) {
+			addAttrib( &attribs, ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, stride );
+			stride += sizeof( ci::Vec3f );
+		}
+	}
+	if( ! texCoords.empty() ) {
+		addAttrib( &attribs, ATTRIB_TEXCOORD, 2, GL_FLOAT, GL_FALSE, stride );
+		stride += sizeof( ci::Vec2f );
+	}
+	if( ! boneWeights.empty() ) {
+		addAttrib( &attribs, ATTRIB_BONE_WEIGHTS, 4, GL_FLOAT, GL_FALSE, stride );
+		stride += sizeof( ci::Vec4f );
+		addAttrib( &attribs, ATTRIB_BONE_INDICES, 4, GL_FLOAT, GL_FALSE, stride );
+		stride += sizeof( ci::Vec4f );
+	}
+	
+	const size_t nbFloats = stride / sizeof( float );
+	std::vector<float> vertices( positions.size() * nbFloats, 0.0f );
+	for( size_t i = 0; i < positions.size(); ++i ) {
+		float* v = vertices.data() + i * nbFloats;
+		if( ! streamed ) {
+			*v++ = positions[i].x; *v++ = positions[i].y; *v++ = positions[i].z;
+			if( ! normals.empty() ) {
+				*v++ = normals[i].x; *v++ = normals[i].y; *v++ = normals[i].z;
+			}
+		}
+		if( ! texCoords.empty() ) {
+			*v++ = texCoords[i].x; *v++ = texCoords[i].y;
+		}
+		if( ! boneWeights.empty() ) {
+			const BoneWeights& boneWeight = boneWeights[i];
+			for( int b = 0; b < (int) boneWeight.mActiveNbWeights; ++b ) {
+				v[b] = boneWeight.getWeight( b );
+				//FIXME: Maybe use ints on the desktop?
+				v[BoneWeights::NB_WEIGHTS + b] = float( mPaletteIndices[i][b] );
+			}
+		}
+	}
+	
+	section->setVertices( vertices.data(), positions.size(), stride, geometry.mIndices, attribs );
+	if( streamed ) {
+		section->setStreamedVertices( positions, normals );
+	}
+}
+
+void ModelTargetSkinnedVboMesh::finishPackedSection( const MeshVboSectionRef& section, const SectionGeometry& geometry )
+{
+	VertexQuantization quantization = computeQuantization( geometry.mPositions, geometry.mTexCoords );
+	std::vector<PackedVertex> vertices = packVertices( quantization, geometry.mPositions, geometry.mNormals, geometry.mTexCoords, geometry.mBoneWeights, mPaletteIndices );
+	
+	std::vector<VertexAttrib> attribs;
+	addAttrib( &attribs, ATTRIB_POSITION, 3, GL_SHORT, GL_TRUE, offsetof( PackedVertex, mPosition ) );
+	if( ! geometry.mNormals.empty() )
+		addAttrib( &attribs, ATTRIB_NORMAL, 2, GL_SHORT, GL_TRUE, offsetof( PackedVertex, mNormal ) );
+	if( ! geometry.mTexCoords.empty() )
+		addAttrib( &attribs, ATTRIB_TEXCOORD, 2, GL_UNSIGNED_SHORT, GL_TRUE, offsetof( PackedVertex, mTexCoord ) );
+	if( ! geometry.mBoneWeights.empty() ) {
+		addAttrib( &attribs, ATTRIB_BONE_WEIGHTS, 4, GL_UNSIGNED_BYTE, GL_TRUE, offsetof( PackedVertex, mBoneWeights ) );
+		// Not normalized: the shader reads the bone indices as floats
+		addAttrib( &attribs, ATTRIB_BONE_INDICES, 4, GL_UNSIGNED_BYTE, GL_FALSE, offsetof( PackedVertex, mBoneIndices ) );
+	}
+	
+	section->setPackedVertices( vertices, geometry.mIndices, attribs, quantization );
 }
 
 void ModelTargetSkinnedVboMesh::setActiveSection( int index )
 {
+	finishSection();
+	mActiveIndex = index;
 	mSkinnedVboMesh->setActiveSection( index );
-	mSubDataOffset = 0;
-	mAttribLocation = 0;
 }
 
 std::shared_ptr<Skeleton> ModelTargetSkinnedVboMesh::getSkeleton() const
@@ -54,77 +348,42 @@ std::shared_ptr<Skeleton> ModelTargetSkinnedVboMesh::getSkeleton() const
 
 void ModelTargetSkinnedVboMesh::loadIndices( const std::vector<uint32_t>& indices )
 {
-	ci::gl::VboMesh& vboMesh = mSkinnedVboMesh->getActiveSection()->getVboMesh();
-	vboMesh.bufferIndices( indices );
-	vboMesh.unbindBuffers();
+	mGeometry.mIndices = indices;
+	mHasStagedSection = true;
 }
 
 void ModelTargetSkinnedVboMesh::loadVertexPositions( const std::vector<ci::Vec3f>& positions )
 {
-	size_t dataSize = sizeof(GLfloat) * ci::Vec3f::DIM * positions.size();
-	bufferSubData< std::vector<ci::Vec3f> >( positions, dataSize );
-	setCustomAttribute( mAttribLocation, "position" );
-	incrementOffsets( dataSize );
+	mSkinnedVboMesh->getActiveSection()->computeBounds( positions );
+	mGeometry.mPositions = positions;
+	mHasStagedSection = true;
 }
 
 void ModelTargetSkinnedVboMesh::loadVertexNormals( const std::vector<ci::Vec3f>& normals )
 {
 	mSkinnedVboMesh->getActiveSection()->setHasNormals( true ); //FIXME: remove this
-	
-	size_t dataSize = sizeof(GLfloat) * ci::Vec3f::DIM * normals.size();
-	bufferSubData< std::vector<ci::Vec3f> >( normals, dataSize );
-	setCustomAttribute( mAttribLocation, "normal" );
-	incrementOffsets( dataSize );
+	mGeometry.mNormals = normals;
 }
 
 void ModelTargetSkinnedVboMesh::loadTex( const std::vector<ci::Vec2f>& texCoords, const MaterialInfo& matInfo )
 {
 	mSkinnedVboMesh->getActiveSection()->setMatInfo( matInfo );
-	
-	size_t dataSize = sizeof(GLfloat) * ci::Vec2f::DIM * texCoords.size();
-	bufferSubData< std::vector<ci::Vec2f> >( texCoords, dataSize);
-	setCustomAttribute( mAttribLocation, "texcoord" );
-	incrementOffsets( dataSize );
+	mGeometry.mTexCoords = texCoords;
 }
 
 void ModelTargetSkinnedVboMesh::loadSkeleton( const SkeletonRef& skeleton )
 {
-	if( skeleton->getNumBones() > SkinnedVboMesh::MAXBONES )
-		throw ModelTargetException( "Skeleton has more bones than maximal the number allowed." );
-	
 	mSkinnedVboMesh->setSkeleton( skeleton );
 }
 
 void ModelTargetSkinnedVboMesh::loadBoneWeights( const std::vector<BoneWeights>& boneWeights )
 {
-	std::vector<ci::Vec4f> boneWeightsBuffer;
-	std::vector<ci::Vec4f> boneIndicesBuffer;
-	
-	for( const auto& boneWeight : boneWeights ) {
-		ci::Vec4f vWeights = ci::Vec4f::zero();
-		ci::Vec4f vIndices = ci::Vec4i::zero();
-		for( unsigned int b =0; b < boneWeight.mActiveNbWeights; ++b ) {
-			NodeRef bone = boneWeight.getBone( b );
-			vWeights[b] = boneWeight.getWeight(b);
-			//FIXME: Maybe use ints on the desktop?
-			vIndices[b] = bone->getBoneIndex();
-		}
-		boneWeightsBuffer.push_back( vWeights );
-		boneIndicesBuffer.push_back( vIndices );
-	}
-	
-	size_t dataSize = sizeof(GLfloat) * ci::Vec4f::DIM * boneWeightsBuffer.size();
-	
-	bufferSubData< std::vector<ci::Vec4f> >( boneWeightsBuffer, dataSize );
-	setCustomAttribute( mAttribLocation, "boneWeights" );
-	incrementOffsets( dataSize );
-	
-	bufferSubData< std::vector<ci::Vec4f> >( boneIndicesBuffer, dataSize);
-	setCustomAttribute( mAttribLocation, "boneIndices" );
-	incrementOffsets( dataSize );
+	mGeometry.mBoneWeights = boneWeights;
 	
 	mSkinnedVboMesh->getActiveSection()->boneMatrices = &mSkinnedVboMesh->mBoneMatrices;
 	mSkinnedVboMesh->getActiveSection()->invTransposeMatrices = &mSkinnedVboMesh->mInvTransposeMatrices;
+	
+	mSkinnedVboMesh->getActiveSection()->computeBounds( mGeometry.mPositions, boneWeights );
 }
 	
 void ModelTargetSkinnedVboMesh::loadDefaultTransformation( const ci::Matrix44f& transformation )
@@ -132,4 +391,9 @@ void ModelTargetSkinnedVboMesh::loadDefaultTransformation( const ci::Matrix44f&
 	mSkinnedVboMesh->setDefaultTransformation( transformation );
 }
 
+void ModelTargetSkinnedVboMesh::loadMorphTargets( const MorphTargetsRef& morphTargets )
+{
+	mSkinnedVboMesh->getActiveSection()->setMorphTargets( morphTargets );
+}
+
 } //end namespace model
@@ -0,0 +1,305 @@
+#include "MorphTargets.h"
+#include "AnimTrack.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace model {
+
+namespace {
+	static_assert( sizeof( ci::Vec3f ) == 3 * sizeof( float ), "the deltas of a run are laid out as its vertices" );
+
+	/*!
+	 * \a out[i] += \a weight * \a deltas[i], 4 floats at a time. Each group loads before it stores, so
+	 * that compilers turn it into one 4-wide multiply-add (SSE, NEON) without checking whether the arrays
+	 * overlap, even where they do not vectorize loops of unknown length (e.g. gcc -O2).
+	 */
+	void addDeltas( float weight, const float* deltas, size_t nbFloats, float* out )
+	{
+		size_t i = 0;
+		for( ; i + 4 <= nbFloats; i += 4 ) {
+			float o0 = out[i] + weight * deltas[i];
+			float o1 = out[i + 1] + weight * deltas[i + 1];
+			float o2 = out[i + 2] + weight * deltas[i + 2];
+			float o3 = out[i + 3] + weight * deltas[i + 3];
+			out[i] = o0;
+			out[i + 1] = o1;
+			out[i + 2] = o2;
+			out[i + 3] = o3;
+		}
+		for( ; i < nbFloats; ++i ) {
+			out[i] += weight * deltas[i];
+		}
+	}
+
+	ci::Vec3f loadVec3f( const float* floats )
+	{
+		return ci::Vec3f( floats[0], floats[1], floats[2] );
+	}
+
+	void storeVec3f( const ci::Vec3f& v, float* floats )
+	{
+		floats[0] = v.x;
+		floats[1] = v.y;
+		floats[2] = v.z;
+	}
+
+	void appendVec3f( std::vector<float>* floats, const ci::Vec3f& v )
+	{
+		floats->push_back( v.x );
+		floats->push_back( v.y );
+		floats->push_back( v.z );
+	}
+
+	//! Add \a vertex to the last run when the gap allows it, to a new run otherwise. Returns the number of gap vertices to fill with zero deltas.
+	uint32_t appendVertex( std::vector<MorphTarget::Run>* runs, uint32_t vertex )
+	{
+		if( ! runs->empty() ) {
+			MorphTarget::Run& run = runs->back();
+			uint32_t end = run.mFirstVertex + run.mNumVertices;
+			assert( vertex >= end );
+			if( vertex - end <= MorphTarget::MAX_RUN_GAP ) {
+				run.mNumVertices = vertex - run.mFirstVertex + 1;
+				return vertex - end;
+			}
+		}
+		MorphTarget::Run run = { vertex, 1 };
+		runs->push_back( run );
+		return 0;
+	}
+}
+
+void MorphTarget::addDelta( uint32_t vertex, const ci::Vec3f& positionDelta )
+{
+	assert( mNormalDeltas.empty() );
+	uint32_t gap = appendVertex( &mRuns, vertex );
+	mPositionDeltas.resize( mPositionDeltas.size() + 3 * gap, 0.0f );
+	appendVec3f( &mPositionDeltas, positionDelta );
+}
+
+void MorphTarget::addDelta( uint32_t vertex, const ci::Vec3f& positionDelta, const ci::Vec3f& normalDelta )
+{
+	assert( mNormalDeltas.size() == mPositionDeltas.size() );
+	uint32_t gap = appendVertex( &mRuns, vertex );
+	mPositionDeltas.resize( mPositionDeltas.size() + 3 * gap, 0.0f );
+	mNormalDeltas.resize( mNormalDeltas.size() + 3 * gap, 0.0f );
+	appendVec3f( &mPositionDeltas, positionDelta );
+	appendVec3f( &mNormalDeltas, normalDelta );
+}
+
+MorphTarget createMorphTarget( const std::string& name, const std::vector<ci::Vec3f>& basePositions, const std::vector<ci::Vec3f>& targetPositions,
+							   const std::vector<ci::Vec3f>& baseNormals, const std::vector<ci::Vec3f>& targetNormals, float epsilon )
+{
+	assert( basePositions.size() == targetPositions.size() );
+	bool hasNormals = ! baseNormals.empty() && baseNormals.size() == targetNormals.size();
+	const float epsilon2 = epsilon * epsilon;
+
+	MorphTarget target;
+	target.mName = name;
+	for( size_t v = 0; v < basePositions.size(); ++v ) {
+		ci::Vec3f positionDelta = targetPositions[v] - basePositions[v];
+		ci::Vec3f normalDelta = hasNormals ? targetNormals[v] - baseNormals[v] : ci::Vec3f::zero();
+		if( positionDelta.lengthSquared() <= epsilon2 && normalDelta.lengthSquared() <= epsilon2 )
+			continue;
+		if( hasNormals ) {
+			target.addDelta( uint32_t( v ), positionDelta, normalDelta );
+		} else {
+			target.addDelta( uint32_t( v ), positionDelta );
+		}
+	}
+	return target;
+}
+
+void MorphTargets::addTarget( const MorphTarget& target )
+{
+	assert( target.mNormalDeltas.empty() || target.mNormalDeltas.size() == target.mPositionDeltas.size() );
+	mTargets.push_back( target );
+	mWeights.push_back( 0.0f );
+}
+
+int MorphTargets::findTarget( const std::string& name ) const
+{
+	for( size_t t = 0; t < mTargets.size(); ++t ) {
+		if( mTargets[t].mName == name )
+			return int( t );
+	}
+	return -1;
+}
+
+void MorphTargets::setWeight( size_t target, float weight )
+{
+	float& current = mWeights[target];
+	if( current == weight )
+		return;
+	if( current == 0.0f ) {
+		++mNumActiveTargets;
+	} else if( weight == 0.0f ) {
+		--mNumActiveTargets;
+	}
+	current = weight;
+	++mWeightVersion;
+}
+
+void MorphTargets::resetWeights()
+{
+	for( size_t t = 0; t < mWeights.size(); ++t ) {
+		setWeight( t, 0.0f );
+	}
+}
+
+void MorphTargets::addWeightTrack( int animId, float duration, float ticksPerSecond )
+{
+	WeightTrack& track = mWeightTracks[animId];
+	track.mTrack = AnimTrack::create( duration, ticksPerSecond );
+	track.mCurves.clear();
+}
+
+void MorphTargets::addWeightKeyframe( int animId, size_t target, float time, float weight )
+{
+	auto it = mWeightTracks.find( animId );
+	assert( it != mWeightTracks.end() && target < mTargets.size() );
+	WeightTrack& track = it->second;
+	auto curve = std::find_if( track.mCurves.begin(), track.mCurves.end(), [target] ( const WeightCurve& c ) { return c.mTarget == target; } );
+	if( curve == track.mCurves.end() ) {
+		WeightCurve weightCurve = { target, AnimCurve<float>( track.mTrack.get() ) };
+		track.mCurves.push_back( weightCurve );
+		curve = track.mCurves.end() - 1;
+	}
+	curve->mCurve.addKeyframe( time, weight );
+}
+
+void MorphTargets::animate( float time, int animId )
+{
+	auto it = mWeightTracks.find( animId );
+	if( it == mWeightTracks.end() )
+		return;
+	for( const WeightCurve& curve : it->second.mCurves ) {
+		setWeight( curve.mTarget, curve.mCurve.getValue( time ) );
+	}
+}
+
+void MorphTargets::apply( const ci::Vec3f* basePositions, const ci::Vec3f* baseNormals, ci::Vec3f* positions, ci::Vec3f* normals, size_t nbVertices ) const
+{
+	std::copy( basePositions, basePositions + nbVertices, positions );
+	if( normals ) {
+		std::copy( baseNormals, baseNormals + nbVertices, normals );
+	}
+	if( mNumActiveTargets == 0 )
+		return;
+
+	for( size_t t = 0; t < mTargets.size(); ++t ) {
+		float weight = mWeights[t];
+		if( weight == 0.0f )
+			continue;
+		const MorphTarget& target = mTargets[t];
+		bool hasNormals = normals && ! target.mNormalDeltas.empty();
+		size_t delta = 0;
+		for( const MorphTarget::Run& run : target.mRuns ) {
+			assert( run.mFirstVertex + run.mNumVertices <= nbVertices );
+			size_t nbFloats = 3 * run.mNumVertices;
+			addDeltas( weight, &target.mPositionDeltas[delta], nbFloats, &positions[run.mFirstVertex].x );
+			if( hasNormals ) {
+				addDeltas( weight, &target.mNormalDeltas[delta], nbFloats, &normals[run.mFirstVertex].x );
+			}
+			delta += nbFloats;
+		}
+	}
+}
+
+void MorphTargets::remapVertices( const std::vector<uint32_t>& remap )
+{
+	uint32_t nbSourceVertices = 0;
+	for( uint32_t v : remap ) {
+		nbSourceVertices = std::max( nbSourceVertices, v + 1 );
+	}
+
+	// First delta float of each source vertex, -1 for the vertices the target does not cover
+	std::vector<int> deltas;
+	for( MorphTarget& target : mTargets ) {
+		deltas.assign( nbSourceVertices, -1 );
+		size_t delta = 0;
+		for( const MorphTarget::Run& run : target.mRuns ) {
+			for( uint32_t v = run.mFirstVertex; v < run.mFirstVertex + run.mNumVertices; ++v, delta += 3 ) {
+				if( v < nbSourceVertices ) {
+					deltas[v] = int( delta );
+				}
+			}
+		}
+
+		bool hasNormals = ! target.mNormalDeltas.empty();
+		MorphTarget remapped;
+		for( size_t v = 0; v < remap.size(); ++v ) {
+			int d = deltas[ remap[v] ];
+			if( d < 0 )
+				continue;
+			ci::Vec3f positionDelta = loadVec3f( &target.mPositionDeltas[d] );
+			// Gap fillers are dropped, new gaps filled.
+			if( hasNormals ) {
+				ci::Vec3f normalDelta = loadVec3f( &target.mNormalDeltas[d] );
+				if( positionDelta != ci::Vec3f::zero() || normalDelta != ci::Vec3f::zero() ) {
+					remapped.addDelta( uint32_t( v ), positionDelta, normalDelta );
+				}
+			} else if( positionDelta != ci::Vec3f::zero() ) {
+				remapped.addDelta( uint32_t( v ), positionDelta );
+			}
+		}
+		target.mRuns.swap( remapped.mRuns );
+		target.mPositionDeltas.swap( remapped.mPositionDeltas );
+		target.mNormalDeltas.swap( remapped.mNormalDeltas );
+	}
+}
+
+void MorphTargets::transform( const ci::Matrix44f& transformation )
+{
+	// Deltas are directions: no translation. Normals use the inverse transpose, as transformVertices() does.
+	ci::Matrix33f normalMatrix = transformation.subMatrix33( 0, 0 ).inverted().transposed();
+	for( MorphTarget& target : mTargets ) {
+		for( size_t d = 0; d < target.mPositionDeltas.size(); d += 3 ) {
+			storeVec3f( transformation.transformVec( loadVec3f( &target.mPositionDeltas[d] ) ), &target.mPositionDeltas[d] );
+		}
+		for( size_t d = 0; d < target.mNormalDeltas.size(); d += 3 ) {
+			storeVec3f( normalMatrix * loadVec3f( &target.mNormalDeltas[d] ), &target.mNormalDeltas[d] );
+		}
+	}
+}
+
+float MorphTargets::getMaxDisplacement() const
+{
+	std::vector<float> displacements;
+	for( const MorphTarget& target : mTargets ) {
+		if( target.mRuns.empty() )
+			continue;
+		const MorphTarget::Run& last = target.mRuns.back();
+		if( last.mFirstVertex + last.mNumVertices > displacements.size() ) {
+			displacements.resize( last.mFirstVertex + last.mNumVertices, 0.0f );
+		}
+		size_t delta = 0;
+		for( const MorphTarget::Run& run : target.mRuns ) {
+			for( uint32_t v = run.mFirstVertex; v < run.mFirstVertex + run.mNumVertices; ++v, delta += 3 ) {
+				displacements[v] += loadVec3f( &target.mPositionDeltas[delta] ).length();
+			}
+		}
+	}
+	return displacements.empty() ? 0.0f : *std::max_element( displacements.begin(), displacements.end() );
+}
+
+MemoryStats MorphTargets::getMemoryStats() const
+{
+	MemoryStats stats;
+	stats.add( MemoryStats::GEOMETRY, sizeof( MorphTargets ) + memory::vectorBytes( mTargets ) + memory::vectorBytes( mWeights ) );
+	for( const MorphTarget& target : mTargets ) {
+		stats.add( MemoryStats::GEOMETRY, memory::stringBytes( target.mName ) + memory::vectorBytes( target.mRuns )
+				  + memory::vectorBytes( target.mPositionDeltas ) + memory::vectorBytes( target.mNormalDeltas ) );
+	}
+	for( const auto& kv : mWeightTracks ) {
+		const WeightTrack& track = kv.second;
+		stats.add( MemoryStats::ANIMATION, memory::MAP_NODE_BYTES + sizeof( std::pair<const int, WeightTrack> ) + track.mTrack->getMemoryUsage()
+				  + memory::vectorBytes( track.mCurves ) );
+		for( const WeightCurve& curve : track.mCurves ) {
+			stats.add( MemoryStats::ANIMATION, curve.mCurve.getKeyframeMemoryUsage() );
+		}
+	}
+	return stats;
+}
+
+} //end namespace model
@@ -8,10 +8,27 @@
 
 #include "Node.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
 namespace model {
 	
+	namespace {
+		std::atomic<uint64_t> sPoseVersion( 0 );
+		
+		uint64_t nextPoseVersion() { return ++sPoseVersion; }
+	}
+	
+	NodeRef Node::create( const ci::Vec3f& position, const ci::Quatf& rotation, const ci::Vec3f& scale,
+						  const std::string& name, NodeRef parent, int level, const ArenaRef& arena )
+	{
+		Node* node = new( allocateInArena<Node>( arena ) ) Node( position, rotation, scale, name, parent, level, arena );
+		return makeArenaShared( node, arena );
+	}
+	
 	Node::Node( const ci::Vec3f& position, const ci::Quatf& rotation, const ci::Vec3f& scale,
-			    const std::string& name, NodeRef parent, int level )
+			    const std::string& name, NodeRef parent, int level, const ArenaRef& arena )
 	: mInitialRelativePosition( position )
 	, mInitialRelativeRotation( rotation )
 	, mInitialRelativeScale( scale )
@@ -22,9 +39,13 @@ namespace model {
 	, mParent( parent )
 	, mLevel( level )
 	, mBoneIndex( -1 )
+	, mLodLevel( 0 )
+	, mInfluence( 0.0f )
 	, mTime( 0.0f )
 	, mIsAnimated( false )
 	, mNeedsUpdate( true )
+	, mPoseVersion( nextPoseVersion() )
+	, mAnimTracks( 0, std::hash<int>(), std::equal_to<int>(), AnimTrackMap::allocator_type( arena ) )
 	{
 		
 	}
@@ -41,6 +62,8 @@ namespace model {
 			clone->setOffsetMatrix( *mOffset );
 		clone->setBoneIndex( getBoneIndex() );
 		clone->mBoneIndex = mBoneIndex;
+		clone->mLodLevel = mLodLevel;
+		clone->mInfluence = mInfluence;
 		
 		//TODO: Copy animation data.
 		//	clone->mIsAnimated = mIsAnimated;
@@ -55,10 +78,70 @@ namespace model {
 		transformation->setTranslate( t );
 	}
 	
+	void Node::composeTransformation( const ci::Vec3f& parentPosition, const ci::Quatf& parentRotation, const ci::Vec3f& parentScale,
+									  ci::Vec3f* position, ci::Quatf* rotation, ci::Vec3f* scale )
+	{
+		*rotation = *rotation * parentRotation;
+		*scale = *scale * parentScale;
+		
+		// change position vector based on parent's rotation & scale
+		*position = ( parentScale * *position ) * parentRotation;
+		// add altered position vector to parent's
+		*position += parentPosition;
+	}
+	
+	void Node::foldParentTransformation( const ci::Vec3f& position, const ci::Quatf& rotation, const ci::Vec3f& scale )
+	{
+		composeTransformation( position, rotation, scale, &mRelativePosition, &mRelativeRotation, &mRelativeScale );
+		composeTransformation( position, rotation, scale, &mInitialRelativePosition, &mInitialRelativeRotation, &mInitialRelativeScale );
+		// Interpolation commutes with the composition (affine for positions and scales, an isometry for
+		// rotations), so composing the keyframes is the same as composing the sampled values.
+		for( const auto& kv : mAnimTracks ) {
+			kv.second->mTranslationCurve.transformKeyframes( [&] ( const ci::Vec3f& p ) { return ( scale * p ) * rotation + position; } );
+			kv.second->mRotationCurve.transformKeyframes( [&] ( const ci::Quatf& r ) { return r * rotation; } );
+			kv.second->mScalingCurve.transformKeyframes( [&] ( const ci::Vec3f& s ) { return s * scale; } );
+		}
+		requestSubtreeUpdate();
+	}
+	
+	namespace {
+		bool isUniformScale( const ci::Vec3f& scale )
+		{
+			float smin = std::min( scale.x, std::min( scale.y, scale.z ) ), smax = std::max( scale.x, std::max( scale.y, scale.z ) );
+			return smax - smin <= 1e-5f * std::max( std::abs( smin ), std::abs( smax ) );
+		}
+	}
+	
+	bool Node::hasUniformScale() const
+	{
+		if( ! isUniformScale( mRelativeScale ) || ! isUniformScale( mInitialRelativeScale ) )
+			return false;
+		for( const auto& kv : mAnimTracks ) {
+			if( ! kv.second->mScalingCurve.allKeyframes( isUniformScale ) )
+				return false;
+		}
+		return true;
+	}
+	
+	void Node::sampleRelative( float time, int trackId, ci::Vec3f* position, ci::Quatf* rotation, ci::Vec3f* scale ) const
+	{
+		auto it = mAnimTracks.find( trackId );
+		if( it != mAnimTracks.end() ) {
+			*position = it->second->getTranslation( time );
+			*rotation = it->second->getRotation( time );
+			*scale = it->second->getScaling( time );
+		} else {
+			*position = mRelativePosition;
+			*rotation = mRelativeRotation;
+			*scale = mRelativeScale;
+		}
+	}
+	
 	void Node::setParent( NodeRef parent )
 	{
 		mParent = parent;
 		requestSubtreeUpdate();
+		touchPose();
 	}
 	
 	ci::Matrix44f Node::getRelativeTransformation()
@@ -130,18 +213,21 @@ namespace model {
 	{
 		mRelativePosition = pos;
 		requestSubtreeUpdate();
+		touchPose();
 	}
 	
 	void Node::setRelativeRotation( const ci::Quatf& rotation )
 	{
 		mRelativeRotation = rotation;
 		requestSubtreeUpdate();
+		touchPose();
 	}
 	
 	void Node::setRelativeScale( const ci::Vec3f& scale )
 	{
 		mRelativeScale = scale;
 		requestSubtreeUpdate();
+		touchPose();
 	}
 	
 	void Node::resetToInitial()
@@ -149,6 +235,61 @@ namespace model {
 		mRelativePosition = mInitialRelativePosition;
 		mRelativeRotation = mInitialRelativeRotation;
 		mRelativeScale = mInitialRelativeScale;
+		requestSubtreeUpdate();
+		touchPose();
+	}
+	
+	uint64_t Node::getPoseVersion() const
+	{
+		const Node* root = this;
+		while( root->mParent ) {
+			root = root->mParent.get();
+		}
+		return root->mPoseVersion;
+	}
+	
+	void Node::touchPose()
+	{
+		Node* root = this;
+		while( root->mParent ) {
+			root = root->mParent.get();
+		}
+		root->mPoseVersion = nextPoseVersion();
+	}
+	
+	void Node::setPoseVersion( uint64_t poseVersion )
+	{
+		Node* root = this;
+		while( root->mParent ) {
+			root = root->mParent.get();
+		}
+		root->mPoseVersion = poseVersion;
+	}
+	
+	void Node::savePoseState( PoseState* state ) const
+	{
+		if( mNeedsUpdate ) {
+			update();
+		}
+		state->mRelativePosition = mRelativePosition;
+		state->mRelativeRotation = mRelativeRotation;
+		state->mRelativeScale = mRelativeScale;
+		state->mAbsolutePosition = mAbsolutePosition;
+		state->mAbsoluteRotation = mAbsoluteRotation;
+		state->mAbsoluteScale = mAbsoluteScale;
+		state->mIsAnimated = mIsAnimated;
+	}
+	
+	void Node::restorePoseState( const PoseState& state )
+	{
+		mRelativePosition = state.mRelativePosition;
+		mRelativeRotation = state.mRelativeRotation;
+		mRelativeScale = state.mRelativeScale;
+		mAbsolutePosition = state.mAbsolutePosition;
+		mAbsoluteRotation = state.mAbsoluteRotation;
+		mAbsoluteScale = state.mAbsoluteScale;
+		mIsAnimated = state.mIsAnimated;
+		mNeedsUpdate = false;
 	}
 	
 	void Node::addChild( NodeRef node )
@@ -158,54 +299,86 @@ namespace model {
 	
 	void Node::addAnimTrack( int trackId, float duration, float ticksPerSecond )
 	{
-		mAnimTracks[trackId] = AnimTrack::create( duration, ticksPerSecond );
+		mAnimTracks[trackId] = AnimTrack::create( duration, ticksPerSecond, getArena() );
 	}
 	
 	void Node::addPositionKeyframe( int trackId, float time, const ci::Vec3f& translation )
 	{
-		mAnimTracks[trackId]->mTranslationCurve->addKeyframe( time, translation );
+		mAnimTracks[trackId]->mTranslationCurve.addKeyframe( time, translation );
 	}
 	
 	void Node::addRotationKeyframe( int trackId, float time, const ci::Quatf& rotation )
 	{
-		mAnimTracks[trackId]->mRotationCurve->addKeyframe( time, rotation );
+		mAnimTracks[trackId]->mRotationCurve.addKeyframe( time, rotation );
 	}
 	
 	void Node::addScalingKeyframe( int trackId, float time, const ci::Vec3f& scaling )
 	{
-		mAnimTracks[trackId]->mScalingCurve->addKeyframe( time, scaling );
+		mAnimTracks[trackId]->mScalingCurve.addKeyframe( time, scaling );
 	}
 	
-	bool Node::hasAnimations( int trackId ) const
+	size_t Node::getMemoryUsage() const
 	{
-		try {
-			mAnimTracks.at( trackId );
-			return true;
-		} catch ( const std::out_of_range& ) {
-			return false;
+		size_t bytes = sizeof( Node ) + memory::SHARED_PTR_CONTROL_BYTES;
+		bytes += memory::stringBytes( mName ) + memory::vectorBytes( mChildren );
+		if( mOffset ) {
+			bytes += sizeof( ci::Matrix44f );
 		}
-	}	
+		return bytes;
+	}
+	
+	size_t Node::getAnimMemoryUsage() const
+	{
+		size_t bytes = memory::unorderedMapBytes( mAnimTracks );
+		for( const auto& kv : mAnimTracks ) {
+			bytes += kv.second->getMemoryUsage();
+		}
+		return bytes;
+	}
+	
+	size_t Node::getAnimMemoryUsage( int trackId ) const
+	{
+		auto it = mAnimTracks.find( trackId );
+		return ( it != mAnimTracks.end() ) ? it->second->getMemoryUsage() : 0;
+	}
+	
+	bool Node::hasAnimations( int trackId ) const
+	{
+		return mAnimTracks.find( trackId ) != mAnimTracks.end();
+	}
 	
 	void Node::update() const
 	{
 		// update orientation
 		if ( hasParent() ) {
-			const ci::Quatf& parentRotation = mParent->getAbsoluteRotation();
-			const ci::Vec3f& parentScale = mParent->getAbsoluteScale();
-			
-			mAbsoluteRotation = mRelativeRotation * parentRotation;
-			mAbsoluteScale = mRelativeScale * parentScale;
-			
-			// change position vector based on parent's rotation & scale
-			mAbsolutePosition = ( parentScale * mRelativePosition ) * parentRotation;
-			// add altered position vector to parent's
-			mAbsolutePosition += mParent->getAbsolutePosition();
+			mAbsolutePosition = mRelativePosition;
+			mAbsoluteRotation = mRelativeRotation;
+			mAbsoluteScale = mRelativeScale;
+			composeTransformation( mParent->getAbsolutePosition(), mParent->getAbsoluteRotation(), mParent->getAbsoluteScale(),
+								   &mAbsolutePosition, &mAbsoluteRotation, &mAbsoluteScale );
 		} else {
 			mAbsoluteRotation = mRelativeRotation;
 			mAbsoluteScale = mRelativeScale;
 		}
 		mNeedsUpdate = false;
 	}
+	
+	void Node::updateSubtree() const
+	{
+		if( mNeedsUpdate ) {
+			update();
+		}
+		// The node is up to date: compose the children directly from its absolute transformation.
+		for( const NodeRef& child : mChildren ) {
+			child->mAbsolutePosition = child->mRelativePosition;
+			child->mAbsoluteRotation = child->mRelativeRotation;
+			child->mAbsoluteScale = child->mRelativeScale;
+			composeTransformation( mAbsolutePosition, mAbsoluteRotation, mAbsoluteScale,
+								   &child->mAbsolutePosition, &child->mAbsoluteRotation, &child->mAbsoluteScale );
+			child->mNeedsUpdate = false;
+			child->updateSubtree();
+		}
+	}
 
 	
 	
@@ -213,11 +386,12 @@ namespace model {
 	{
 		mTime = time;
 		mIsAnimated = false;
-		if( hasAnimations( trackId ) ) {
-			mAnimTracks[trackId]->getValues( mTime,
-											 &mRelativePosition,
-											 &mRelativeRotation,
-											 &mRelativeScale);
+		auto it = mAnimTracks.find( trackId );
+		if( it != mAnimTracks.end() ) {
+			it->second->getValues( mTime,
+								   &mRelativePosition,
+								   &mRelativeRotation,
+								   &mRelativeScale);
 			mIsAnimated = true;
 		}
 		requestSubtreeUpdate();
@@ -235,13 +409,14 @@ namespace model {
 		ci::Vec3f weightedScale;
 		
 		float w;
-		for( auto kv : weights ) {
-			if( hasAnimations( kv.first ) ) {
+		for( const auto& kv : weights ) {
+			auto it = mAnimTracks.find( kv.first );
+			if( it != mAnimTracks.end() ) {
 				mIsAnimated = true;
 				w = kv.second;
-				weightedPosition += w * mAnimTracks[ kv.first ]->getTranslation( time );
-				weightedRotation = weightedRotation.slerp(w, mAnimTracks[ kv.first ]->getRotation( time ) );
-				weightedScale	 += w * mAnimTracks[ kv.first ]->getScaling( time );
+				weightedPosition += w * it->second->getTranslation( time );
+				weightedRotation = weightedRotation.slerp(w, it->second->getRotation( time ) );
+				weightedScale	 += w * it->second->getScaling( time );
 			}
 		}
 		if( mIsAnimated ) {
@@ -257,7 +432,7 @@ namespace model {
 	{
 		mNeedsUpdate = true;
 		
-		for( auto childNode : mChildren ) {
+		for( const NodeRef& childNode : mChildren ) {
 			/* 
 			 * We can prune out subsections of the tree which already need updates
 			 * because a node that already needs updating will have traversed all its
@@ -0,0 +1,206 @@
+#include "PoseCache.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace model {
+
+PoseCache::PoseCache( size_t capacity, float timeStep )
+: mCapacity( 0 )
+, mTimeStep( timeStep )
+, mHead( -1 )
+, mTail( -1 )
+{
+	setCapacity( capacity );
+}
+
+bool PoseCache::setPose( const SkeletonRef& skeleton, float time, int animId )
+{
+	Key key;
+	key.mDefinitionId = skeleton->getDefinitionId();
+	key.mAnimId = animId;
+	key.mLod = skeleton->getLod();
+	key.mTimeStep = int64_t( std::floor( time / mTimeStep + 0.5f ) );
+
+	int p = mBuckets[ findBucket( key ) ];
+	if( p >= 0 ) {
+		unlink( p );
+		pushFront( p );
+		const Pose& pose = mPoses[p];
+		// Nothing to restore when the skeleton is still in that pose.
+		if( skeleton->getPoseVersion() != pose.mPalette->mPoseVersion ) {
+			skeleton->restorePose( pose.mStates, pose.mPalette->mPoseVersion );
+		}
+		skeleton->setSharedPalette( pose.mPalette );
+		++mStats.mHits;
+		return true;
+	}
+
+	++mStats.mMisses;
+	if( mCapacity == 0 ) {
+		skeleton->setPose( time, animId );
+		return false;
+	}
+	// A full cache recycles its least recently used pose, buffers included.
+	if( mPoses.size() >= mCapacity ) {
+		p = mTail;
+		eraseBucket( findBucket( mPoses[p].mKey ) );
+		unlink( p );
+		++mStats.mEvictions;
+	} else {
+		p = (int) mPoses.size();
+		mPoses.push_back( Pose() );
+	}
+	pushFront( p );
+	Pose& pose = mPoses[p];
+	pose.mKey = key;
+
+	// Every instance sharing the pose gets the one at the quantized time, not the first one's.
+	skeleton->setPose( float( key.mTimeStep ) * mTimeStep, animId );
+	skeleton->savePose( &pose.mStates );
+
+	// Skeletons may still hold the recycled palette.
+	if( ! pose.mPalette || pose.mPalette.use_count() > 1 ) {
+		pose.mPalette = std::make_shared<PosePalette>();
+	}
+	size_t nbBones = skeleton->getNumBones();
+	pose.mPalette->mBoneMatrices.resize( nbBones );
+	pose.mPalette->mInvTransposeMatrices.resize( nbBones );
+	skeleton->setSharedPalette( nullptr );
+	skeleton->computeBonePalette( pose.mPalette->mBoneMatrices.data(), pose.mPalette->mInvTransposeMatrices.data(), nbBones );
+	pose.mPalette->mPoseVersion = skeleton->getPoseVersion();
+	skeleton->setSharedPalette( pose.mPalette );
+
+	// The eviction may have shifted the probe sequence of the key.
+	mBuckets[ findBucket( key ) ] = p;
+	return false;
+}
+
+void PoseCache::setCapacity( size_t capacity )
+{
+	// Keep the most recently used poses, in recency order.
+	std::vector<Pose> poses;
+	poses.reserve( capacity );
+	for( int p = mHead; p >= 0 && poses.size() < capacity; ) {
+		int next = mPoses[p].mNext;
+		poses.push_back( std::move( mPoses[p] ) );
+		p = next;
+	}
+	mStats.mEvictions += mPoses.size() - poses.size();
+	mPoses.swap( poses );
+	mCapacity = capacity;
+
+	mHead = mTail = -1;
+	for( int p = 0; p < (int) mPoses.size(); ++p ) {
+		mPoses[p].mPrev = p - 1;
+		mPoses[p].mNext = ( p + 1 < (int) mPoses.size() ) ? p + 1 : -1;
+	}
+	if( ! mPoses.empty() ) {
+		mHead = 0;
+		mTail = (int) mPoses.size() - 1;
+	}
+
+	size_t nbBuckets = 8;
+	while( nbBuckets < 2 * mCapacity ) {
+		nbBuckets *= 2;
+	}
+	mBuckets.assign( nbBuckets, -1 );
+	rebuildBuckets();
+}
+
+void PoseCache::clear()
+{
+	mPoses.clear();
+	mHead = mTail = -1;
+	std::fill( mBuckets.begin(), mBuckets.end(), -1 );
+}
+
+size_t PoseCache::getHomeBucket( const Key& key ) const
+{
+	uint64_t h = key.mDefinitionId;
+	h = h * 31 + uint64_t( key.mAnimId );
+	h = h * 31 + uint64_t( key.mLod );
+	h = h * 31 + uint64_t( key.mTimeStep );
+	// Consecutive time steps must not land in consecutive buckets.
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return size_t( h ) & ( mBuckets.size() - 1 );
+}
+
+size_t PoseCache::findBucket( const Key& key ) const
+{
+	size_t mask = mBuckets.size() - 1;
+	size_t b = getHomeBucket( key );
+	while( mBuckets[b] >= 0 && ! ( mPoses[ mBuckets[b] ].mKey == key ) ) {
+		b = ( b + 1 ) & mask;
+	}
+	return b;
+}
+
+void PoseCache::eraseBucket( size_t bucket )
+{
+	// Backward shift: pull back the following entries which probed past the hole.
+	size_t mask = mBuckets.size() - 1;
+	size_t hole = bucket;
+	for( size_t b = ( bucket + 1 ) & mask; mBuckets[b] >= 0; b = ( b + 1 ) & mask ) {
+		size_t home = getHomeBucket( mPoses[ mBuckets[b] ].mKey );
+		if( ( ( b - home ) & mask ) >= ( ( b - hole ) & mask ) ) {
+			mBuckets[hole] = mBuckets[b];
+			hole = b;
+		}
+	}
+	mBuckets[hole] = -1;
+}
+
+void PoseCache::rebuildBuckets()
+{
+	std::fill( mBuckets.begin(), mBuckets.end(), -1 );
+	for( int p = 0; p < (int) mPoses.size(); ++p ) {
+		mBuckets[ findBucket( mPoses[p].mKey ) ] = p;
+	}
+}
+
+void PoseCache::unlink( int pose )
+{
+	Pose& p = mPoses[pose];
+	if( p.mPrev >= 0 ) {
+		mPoses[p.mPrev].mNext = p.mNext;
+	} else {
+		mHead = p.mNext;
+	}
+	if( p.mNext >= 0 ) {
+		mPoses[p.mNext].mPrev = p.mPrev;
+	} else {
+		mTail = p.mPrev;
+	}
+}
+
+void PoseCache::pushFront( int pose )
+{
+	Pose& p = mPoses[pose];
+	p.mPrev = -1;
+	p.mNext = mHead;
+	if( mHead >= 0 ) {
+		mPoses[mHead].mPrev = pose;
+	} else {
+		mTail = pose;
+	}
+	mHead = pose;
+}
+
+MemoryStats PoseCache::getMemoryStats() const
+{
+	MemoryStats stats;
+	stats.add( MemoryStats::ANIMATION, sizeof( PoseCache ) + memory::vectorBytes( mPoses ) + memory::vectorBytes( mBuckets ) );
+	for( const Pose& pose : mPoses ) {
+		stats.add( MemoryStats::ANIMATION, memory::vectorBytes( pose.mStates ) );
+		if( pose.mPalette ) {
+			stats.add( MemoryStats::SKINNING, sizeof( PosePalette ) + memory::SHARED_PTR_CONTROL_BYTES
+					   + memory::vectorBytes( pose.mPalette->mBoneMatrices ) + memory::vectorBytes( pose.mPalette->mInvTransposeMatrices ) );
+		}
+	}
+	return stats;
+}
+
+} //end namespace model
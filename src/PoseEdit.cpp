@@ -0,0 +1,72 @@
+#include "PoseEdit.h"
+
+#include <algorithm>
+
+namespace model {
+
+void PoseEdit::setRelativePosition( const NodeRef& node, const ci::Vec3f& position )
+{
+	Edit edit;
+	edit.mNode = node;
+	edit.mField = POSITION;
+	edit.mVector = position;
+	mEdits.push_back( edit );
+}
+
+void PoseEdit::setRelativeRotation( const NodeRef& node, const ci::Quatf& rotation )
+{
+	Edit edit;
+	edit.mNode = node;
+	edit.mField = ROTATION;
+	edit.mRotation = rotation;
+	mEdits.push_back( edit );
+}
+
+void PoseEdit::setRelativeScale( const NodeRef& node, const ci::Vec3f& scale )
+{
+	Edit edit;
+	edit.mNode = node;
+	edit.mField = SCALE;
+	edit.mVector = scale;
+	mEdits.push_back( edit );
+}
+
+void PoseEdit::commit()
+{
+	if( mEdits.empty() )
+		return;
+	
+	// Apply in recording order, so that the last edit of a field wins, and flag only the edited nodes.
+	for( const Edit& edit : mEdits ) {
+		Node* node = edit.mNode.get();
+		switch( edit.mField ) {
+			case POSITION: node->mRelativePosition = edit.mVector; break;
+			case ROTATION: node->mRelativeRotation = edit.mRotation; break;
+			case SCALE: node->mRelativeScale = edit.mVector; break;
+		}
+		node->mNeedsUpdate = true;
+	}
+	
+	// Parents first: the walk of an edited node refreshes its edited descendants, which are then skipped.
+	std::sort( mEdits.begin(), mEdits.end(), [] ( const Edit& a, const Edit& b ) {
+		return a.mNode->getLevel() < b.mNode->getLevel();
+	} );
+	const Node* touchedRoot = nullptr;
+	for( const Edit& edit : mEdits ) {
+		if( ! edit.mNode->mNeedsUpdate )
+			continue;
+		edit.mNode->updateSubtree();
+		// One new pose version per hierarchy
+		const Node* root = edit.mNode.get();
+		while( root->mParent ) {
+			root = root->mParent.get();
+		}
+		if( root != touchedRoot ) {
+			edit.mNode->touchPose();
+			touchedRoot = root;
+		}
+	}
+	mEdits.clear();
+}
+
+} //end namespace model
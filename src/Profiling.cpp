@@ -0,0 +1,166 @@
+#include "Profiling.h"
+#include "ModelIo.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+
+namespace model {
+
+std::unique_ptr<Profiler> Profiler::mInstance = nullptr;
+
+std::once_flag Profiler::mOnceFlag;
+
+Profiler& Profiler::instance()
+{
+	std::call_once(mOnceFlag,
+				   [] {
+					   mInstance.reset( new Profiler );
+				   });
+	return *mInstance.get();
+}
+
+bool Profiler::isCompiledIn()
+{
+#ifdef MODEL_PROFILING
+	return true;
+#else
+	return false;
+#endif
+}
+
+Profiler::Profiler()
+: mCaptureEnabled( false )
+, mMaxEvents( 0 )
+, mEpoch( std::chrono::steady_clock::now() )
+{
+	for( auto& counter : mCounters ) {
+		counter.store( 0 );
+	}
+}
+
+double Profiler::toMicroseconds( std::chrono::steady_clock::time_point time ) const
+{
+	return std::chrono::duration<double, std::micro>( time - mEpoch ).count();
+}
+
+uint32_t Profiler::getThreadIndex()
+{
+	std::thread::id id = std::this_thread::get_id();
+	auto it = std::find( mThreads.begin(), mThreads.end(), id );
+	if( it != mThreads.end() )
+		return uint32_t( it - mThreads.begin() );
+	mThreads.push_back( id );
+	return uint32_t( mThreads.size() - 1 );
+}
+
+void Profiler::recordZone( const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end )
+{
+	double durationUs = std::chrono::duration<double, std::micro>( end - start ).count();
+
+	std::lock_guard<std::mutex> lock( mMutex );
+	// Zone names are literals, so comparing pointers first is usually enough.
+	auto it = std::find_if( mZoneTimes.begin(), mZoneTimes.end(),
+						   [name] ( const ProfileZoneTime& zone ) {
+							   return zone.mName == name || std::strcmp( zone.mName, name ) == 0;
+						   } );
+	if( it == mZoneTimes.end() ) {
+		ProfileZoneTime zone = { name, 0.0, 0 };
+		mZoneTimes.push_back( zone );
+		it = mZoneTimes.end() - 1;
+	}
+	it->mMilliseconds += 0.001 * durationUs;
+	++it->mCalls;
+
+	if( mCaptureEnabled && mTraceEvents.size() < mMaxEvents ) {
+		TraceEvent event = { name, toMicroseconds( start ), durationUs, getThreadIndex() };
+		mTraceEvents.push_back( event );
+	}
+}
+
+void Profiler::beginFrame()
+{
+	ProfileCounters counters;
+	counters.mBonesEvaluated = mCounters[BONES_EVALUATED].exchange( 0 );
+	counters.mVerticesSkinned = mCounters[VERTICES_SKINNED].exchange( 0 );
+	counters.mDrawCalls = mCounters[DRAW_CALLS].exchange( 0 );
+	counters.mBytesUploaded = mCounters[BYTES_UPLOADED].exchange( 0 );
+	counters.mStateChanges = mCounters[STATE_CHANGES].exchange( 0 );
+
+	std::lock_guard<std::mutex> lock( mMutex );
+	mFrameCounters = counters;
+	mFrameZoneTimes.swap( mZoneTimes );
+	mZoneTimes.clear();
+
+	if( mCaptureEnabled && mCounterSamples.size() < mMaxEvents ) {
+		CounterSample sample = { toMicroseconds( std::chrono::steady_clock::now() ), counters };
+		mCounterSamples.push_back( sample );
+	}
+}
+
+ProfileCounters Profiler::getFrameCounters() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mFrameCounters;
+}
+
+std::vector<ProfileZoneTime> Profiler::getFrameZoneTimes() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mFrameZoneTimes;
+}
+
+void Profiler::setCaptureEnabled( bool enabled, size_t maxEvents )
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	mMaxEvents = maxEvents;
+	if( enabled && ! mCaptureEnabled ) {
+		mTraceEvents.reserve( std::min<size_t>( maxEvents, 1 << 16 ) );
+	}
+	mCaptureEnabled = enabled;
+}
+
+size_t Profiler::getNumTraceEvents() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mTraceEvents.size();
+}
+
+void Profiler::clearTrace()
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	mTraceEvents.clear();
+	mCounterSamples.clear();
+}
+
+void Profiler::writeChromeTrace( const ci::fs::path& path ) const
+{
+	std::ofstream out( path.string().c_str() );
+	if( ! out ) {
+		throw ModelIoException( "Unable to write the profiling trace to " + path.string() );
+	}
+
+	std::lock_guard<std::mutex> lock( mMutex );
+	out << std::fixed << std::setprecision( 3 );
+	out << "{\"traceEvents\":[";
+	bool first = true;
+	for( const TraceEvent& event : mTraceEvents ) {
+		out << ( first ? "\n" : ",\n" );
+		out << "{\"name\":\"" << event.mName << "\",\"cat\":\"model\",\"ph\":\"X\",\"pid\":0"
+			<< ",\"tid\":" << event.mThread << ",\"ts\":" << event.mStartUs << ",\"dur\":" << event.mDurationUs << "}";
+		first = false;
+	}
+	for( const CounterSample& sample : mCounterSamples ) {
+		const ProfileCounters& c = sample.mCounters;
+		out << ( first ? "\n" : ",\n" );
+		out << "{\"name\":\"Frame\",\"cat\":\"model\",\"ph\":\"C\",\"pid\":0,\"tid\":0,\"ts\":" << sample.mTimeUs
+			<< ",\"args\":{\"bones\":" << c.mBonesEvaluated << ",\"vertices\":" << c.mVerticesSkinned
+			<< ",\"drawCalls\":" << c.mDrawCalls << ",\"bytesUploaded\":" << c.mBytesUploaded
+			<< ",\"stateChanges\":" << c.mStateChanges << "}}";
+		first = false;
+	}
+	out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+} //end namespace model
@@ -0,0 +1,119 @@
+#include "RenderQueue.h"
+
+#include "BonePalette.h"
+#include "Profiling.h"
+
+#include "cinder/gl/gl.h"
+
+#include <algorithm>
+
+namespace model {
+
+RenderQueue::RenderQueue()
+: mNumPalettes( 0 )
+{ }
+
+void RenderQueue::submit( const SkinnedVboMeshRef& mesh )
+{
+	submit( mesh, ci::gl::getModelView() );
+}
+
+void RenderQueue::submit( const SkinnedVboMeshRef& mesh, const ci::Matrix44f& modelView )
+{
+	int palette = -1;
+	for( const SkinnedVboMesh::MeshVboSectionRef& section : mesh->getSections() ) {
+		const MaterialInfo& matInfo = section->getMatInfo();
+		RenderState state;
+		state.mFeatures = section->getDrawShaderFeatures();
+		state.mTexture = matInfo.mTexture ? internTexture( matInfo.mTexture ) : 0;
+		state.mMaterial = internMaterial( &matInfo.mMaterial );
+		state.mCullFace = ! matInfo.mTwoSided;
+		
+		if( ( state.mFeatures & SHADER_SKINNED ) && palette < 0 ) {
+			// One copy of the mesh palette for all its sections
+			if( mNumPalettes == mPalettes.size() ) {
+				mPalettes.push_back( Palette() );
+			}
+			Palette& copy = mPalettes[ mNumPalettes ];
+			copy.mBoneMatrices.assign( mesh->mBoneMatrices.begin(), mesh->mBoneMatrices.end() );
+			copy.mInvTransposeMatrices.assign( mesh->mInvTransposeMatrices.begin(), mesh->mInvTransposeMatrices.end() );
+			copy.mBuffer = section->paletteBuffer;
+			copy.mBufferPalette = 0;
+			palette = (int) mNumPalettes++;
+		}
+		
+		ci::Matrix44f sectionModelView = section->hasDefaultTransformation() ? modelView * section->getDefaultTranformation() : modelView;
+		if( section->getKind() == AMeshSection::KIND_RIGID && section->isAnimated() ) {
+			// Rigid sections need no palette, only their bone matrix.
+			sectionModelView *= section->getRigidTransformation( mesh->mBoneMatrices );
+		}
+		submit( state, section.get(), sectionModelView, ( state.mFeatures & SHADER_SKINNED ) ? palette : -1 );
+	}
+}
+
+void RenderQueue::submit( const RenderState& state, const SkinnedVboMesh::MeshSection* section, const ci::Matrix44f& modelView, int palette )
+{
+	Item item;
+	item.mSection = section;
+	item.mModelView = modelView;
+	item.mPalette = palette;
+	mItems.push_back( item );
+	mOrder.add( state );
+}
+
+void RenderQueue::sort()
+{
+	mOrder.sort();
+}
+
+void RenderQueue::uploadPalettes()
+{
+	mBuffers.clear();
+	for( size_t p = 0; p < mNumPalettes; ++p ) {
+		PaletteBuffer* buffer = mPalettes[p].mBuffer;
+		if( buffer && std::find( mBuffers.begin(), mBuffers.end(), buffer ) == mBuffers.end() ) {
+			mBuffers.push_back( buffer );
+		}
+	}
+	for( PaletteBuffer* buffer : mBuffers ) {
+		mBufferPalettes.clear();
+		for( size_t p = 0; p < mNumPalettes; ++p ) {
+			Palette& palette = mPalettes[p];
+			if( palette.mBuffer == buffer ) {
+				palette.mBufferPalette = mBufferPalettes.size();
+				mBufferPalettes.push_back( &palette.mBoneMatrices );
+			}
+		}
+		buffer->update( mBufferPalettes.data(), mBufferPalettes.size() );
+	}
+}
+
+void RenderQueue::clear()
+{
+	mItems.clear();
+	mOrder.clear();
+	mNumPalettes = 0;
+	mTextures.clear();
+	mMaterials.clear();
+}
+
+uint32_t RenderQueue::internTexture( const ci::gl::Texture& texture )
+{
+	for( size_t i = 0; i < mTextures.size(); ++i ) {
+		if( mTextures[i].getId() == texture.getId() )
+			return uint32_t( i + 1 );
+	}
+	mTextures.push_back( texture );
+	return uint32_t( mTextures.size() );
+}
+
+uint32_t RenderQueue::internMaterial( const ci::gl::Material* material )
+{
+	auto it = std::find( mMaterials.begin(), mMaterials.end(), material );
+	if( it != mMaterials.end() )
+		return uint32_t( it - mMaterials.begin() + 1 );
+	mMaterials.push_back( material );
+	return uint32_t( mMaterials.size() );
+}
+
+} //end namespace model
@@ -0,0 +1,74 @@
+#include "RenderState.h"
+
+#include <algorithm>
+
+namespace model {
+
+uint64_t RenderState::getSortKey() const
+{
+	// 16 bits of program, 24 bits of texture, 23 bits of material and the cull mode.
+	return ( uint64_t( mFeatures & 0xffff ) << 48 ) | ( uint64_t( mTexture & 0xffffff ) << 24 ) | ( uint64_t( mMaterial & 0x7fffff ) << 1 )
+		 | ( mCullFace ? 1 : 0 );
+}
+
+uint32_t getStateChanges( const RenderState* previous, const RenderState& next )
+{
+	if( ! previous )
+		return CHANGE_ALL;
+
+	uint32_t changes = 0;
+	if( previous->mFeatures != next.mFeatures )
+		changes |= CHANGE_PROGRAM;
+	if( previous->mTexture != next.mTexture )
+		changes |= CHANGE_TEXTURE;
+	if( previous->mMaterial != next.mMaterial )
+		changes |= CHANGE_MATERIAL;
+	if( previous->mCullFace != next.mCullFace )
+		changes |= CHANGE_CULL_FACE;
+	return changes;
+}
+
+size_t countStateChanges( uint32_t changes )
+{
+	size_t count = 0;
+	for( ; changes; changes &= changes - 1 ) {
+		++count;
+	}
+	return count;
+}
+
+uint32_t RenderOrder::add( const RenderState& state )
+{
+	mStates.push_back( state );
+	return uint32_t( mStates.size() - 1 );
+}
+
+void RenderOrder::sort()
+{
+	mOrder.resize( mStates.size() );
+	for( size_t i = 0; i < mStates.size(); ++i ) {
+		mOrder[i] = std::make_pair( mStates[i].getSortKey(), uint32_t( i ) );
+	}
+	// The submission index breaks ties in submission order.
+	std::sort( mOrder.begin(), mOrder.end() );
+}
+
+void RenderOrder::clear()
+{
+	mStates.clear();
+	mOrder.clear();
+}
+
+size_t RenderOrder::getNumStateChanges() const
+{
+	size_t numChanges = 0;
+	const RenderState* previous = nullptr;
+	for( size_t i = 0; i < mOrder.size(); ++i ) {
+		const RenderState& state = getSortedState( i );
+		numChanges += countStateChanges( getStateChanges( previous, state ) );
+		previous = &state;
+	}
+	return numChanges;
+}
+
+} //end namespace model
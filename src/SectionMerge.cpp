@@ -0,0 +1,209 @@
+#include "SectionMerge.h"
+
+#include "AMeshSection.h"
+
+#include "cinder/Area.h"
+#include "cinder/Surface.h"
+
+#include <algorithm>
+
+namespace model {
+
+namespace {
+	bool equals( const ci::ColorAf& a, const ci::ColorAf& b ) { return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a; }
+	
+	bool equals( const ci::gl::Material& a, const ci::gl::Material& b )
+	{
+		return equals( a.getAmbient(), b.getAmbient() ) && equals( a.getDiffuse(), b.getDiffuse() ) && equals( a.getSpecular(), b.getSpecular() )
+			&& equals( a.getEmission(), b.getEmission() ) && a.getShininess() == b.getShininess() && a.getFace() == b.getFace();
+	}
+	
+	bool equals( const ci::Matrix44f& a, const ci::Matrix44f& b )
+	{
+		return std::equal( a.m, a.m + 16, b.m );
+	}
+	
+	int nextPowerOfTwo( int n )
+	{
+		int p = 1;
+		while( p < n ) {
+			p *= 2;
+		}
+		return p;
+	}
+}
+
+void SectionGeometry::clear()
+{
+	mPositions.clear();
+	mNormals.clear();
+	mTexCoords.clear();
+	mBoneWeights.clear();
+	mIndices.clear();
+	mVertexSubSections.clear();
+}
+
+bool hasNormalizedTexCoords( const std::vector<ci::Vec2f>& texCoords )
+{
+	for( const ci::Vec2f& t : texCoords ) {
+		if( t.x < 0.0f || t.x > 1.0f || t.y < 0.0f || t.y > 1.0f )
+			return false;
+	}
+	return true;
+}
+
+bool canMergeSections( const AMeshSection& a, const SectionGeometry& geometryA, const AMeshSection& b, const SectionGeometry& geometryB, bool allowAtlas )
+{
+	if( geometryA.mBoneWeights.empty() != geometryB.mBoneWeights.empty() || a.getSkeleton() != b.getSkeleton() )
+		return false;
+	// Morphed vertices are streamed per section.
+	if( a.hasMorphTargets() || b.hasMorphTargets() )
+		return false;
+	if( geometryA.mNormals.empty() != geometryB.mNormals.empty() || geometryA.mTexCoords.empty() != geometryB.mTexCoords.empty() )
+		return false;
+	if( a.hasDefaultTransformation() != b.hasDefaultTransformation()
+	   || ( a.hasDefaultTransformation() && ! equals( a.getDefaultTranformation(), b.getDefaultTranformation() ) ) )
+		return false;
+	
+	const MaterialInfo& matA = a.getMatInfo();
+	const MaterialInfo& matB = b.getMatInfo();
+	if( matA.mHasMaterial != matB.mHasMaterial || matA.mTwoSided != matB.mTwoSided || matA.mUseAlpha != matB.mUseAlpha )
+		return false;
+	if( matA.mHasMaterial && ! equals( matA.mMaterial, matB.mMaterial ) )
+		return false;
+	
+	bool texturedA = matA.mTexture, texturedB = matB.mTexture;
+	if( texturedA != texturedB )
+		return false;
+	if( texturedA && matA.mTexture.getId() != matB.mTexture.getId() ) {
+		// Different textures can share an atlas, as long as they are not tiled.
+		return allowAtlas && hasNormalizedTexCoords( geometryA.mTexCoords ) && hasNormalizedTexCoords( geometryB.mTexCoords );
+	}
+	return true;
+}
+
+SectionGeometry mergeGeometry( const std::vector<const SectionGeometry*>& parts )
+{
+	SectionGeometry merged;
+	for( size_t p = 0; p < parts.size(); ++p ) {
+		const SectionGeometry& part = *parts[p];
+		uint32_t offset = (uint32_t) merged.mPositions.size();
+		merged.mPositions.insert( merged.mPositions.end(), part.mPositions.begin(), part.mPositions.end() );
+		merged.mNormals.insert( merged.mNormals.end(), part.mNormals.begin(), part.mNormals.end() );
+		merged.mTexCoords.insert( merged.mTexCoords.end(), part.mTexCoords.begin(), part.mTexCoords.end() );
+		merged.mBoneWeights.insert( merged.mBoneWeights.end(), part.mBoneWeights.begin(), part.mBoneWeights.end() );
+		for( uint32_t index : part.mIndices ) {
+			merged.mIndices.push_back( offset + index );
+		}
+		merged.mVertexSubSections.resize( merged.mPositions.size(), uint32_t( p ) );
+	}
+	return merged;
+}
+
+std::vector<SubSectionRange> sortBySubSection( std::vector<uint32_t>* indices, const std::vector<BoneBatch>& batches, const std::vector<uint32_t>& vertexSubSections )
+{
+	std::vector<BoneBatch> spans = batches;
+	if( spans.empty() ) {
+		BoneBatch all;
+		all.mNumIndices = indices->size();
+		spans.push_back( all );
+	}
+	
+	std::vector<SubSectionRange> ranges;
+	std::vector<uint32_t> triangle( 3 );
+	for( const BoneBatch& span : spans ) {
+		if( vertexSubSections.empty() ) {
+			SubSectionRange range = { span.mFirstIndex, span.mNumIndices, 0 };
+			ranges.push_back( range );
+			continue;
+		}
+		
+		// Stable sort of the batch triangles by sub-section
+		size_t numTriangles = span.mNumIndices / 3;
+		std::vector< std::pair<uint32_t, size_t> > order( numTriangles );
+		for( size_t t = 0; t < numTriangles; ++t ) {
+			order[t] = std::make_pair( vertexSubSections[ (*indices)[ span.mFirstIndex + 3 * t ] ], t );
+		}
+		std::sort( order.begin(), order.end() );
+		std::vector<uint32_t> sorted( span.mNumIndices );
+		for( size_t t = 0; t < numTriangles; ++t ) {
+			std::copy_n( indices->begin() + span.mFirstIndex + 3 * order[t].second, 3, sorted.begin() + 3 * t );
+		}
+		std::copy( sorted.begin(), sorted.end(), indices->begin() + span.mFirstIndex );
+		
+		for( size_t t = 0; t < numTriangles; ++t ) {
+			if( ranges.empty() || t == 0 || ranges.back().mSubSection != order[t].first ) {
+				SubSectionRange range = { span.mFirstIndex + 3 * t, 0, order[t].first };
+				ranges.push_back( range );
+			}
+			ranges.back().mNumIndices += 3;
+		}
+	}
+	return ranges;
+}
+
+namespace {
+	//! Shelves of \a width, tallest textures first. Returns the height used.
+	int shelvePack( const std::vector<ci::Vec2i>& sizes, const std::vector<size_t>& order, int width, int padding, std::vector<AtlasRect>* rects )
+	{
+		int x = 0, y = 0, shelfHeight = 0;
+		for( size_t i : order ) {
+			if( x + sizes[i].x + padding > width ) {
+				x = 0;
+				y += shelfHeight;
+				shelfHeight = 0;
+			}
+			AtlasRect rect = { x, y, sizes[i].x, sizes[i].y };
+			(*rects)[i] = rect;
+			x += sizes[i].x + padding;
+			shelfHeight = std::max( shelfHeight, sizes[i].y + padding );
+		}
+		return y + shelfHeight;
+	}
+}
+
+bool packAtlas( const std::vector<ci::Vec2i>& sizes, int maxSize, int padding, AtlasLayout* layout )
+{
+	std::vector<size_t> order( sizes.size() );
+	int widest = 1;
+	for( size_t i = 0; i < sizes.size(); ++i ) {
+		order[i] = i;
+		widest = std::max( widest, sizes[i].x + padding );
+	}
+	std::sort( order.begin(), order.end(), [&sizes] ( size_t a, size_t b ) { return sizes[a].y > sizes[b].y; } );
+	
+	// Narrowest atlas that is no taller than wide, or that fits at all at the largest width
+	layout->mRects.resize( sizes.size() );
+	for( int width = nextPowerOfTwo( widest ); width <= maxSize; width *= 2 ) {
+		int height = nextPowerOfTwo( shelvePack( sizes, order, width, padding, &layout->mRects ) );
+		if( height <= width || ( width * 2 > maxSize && height <= maxSize ) ) {
+			layout->mSize = ci::Vec2i( width, height );
+			return true;
+		}
+	}
+	return false;
+}
+
+void remapTexCoords( std::vector<ci::Vec2f>* texCoords, const AtlasRect& rect, const ci::Vec2i& atlasSize )
+{
+	ci::Vec2f offset( float( rect.mX ) / atlasSize.x, float( rect.mY ) / atlasSize.y );
+	ci::Vec2f scale( float( rect.mWidth ) / atlasSize.x, float( rect.mHeight ) / atlasSize.y );
+	for( ci::Vec2f& t : *texCoords ) {
+		t = offset + ci::Vec2f( t.x * scale.x, t.y * scale.y );
+	}
+}
+
+ci::gl::Texture createAtlasTexture( const std::vector<ci::gl::Texture>& textures, const AtlasLayout& layout )
+{
+	ci::Surface8u atlas( layout.mSize.x, layout.mSize.y, true );
+	for( size_t i = 0; i < textures.size(); ++i ) {
+		ci::Surface8u surface( (ci::ImageSourceRef) textures[i] );
+		const AtlasRect& rect = layout.mRects[i];
+		atlas.copyFrom( surface, ci::Area( 0, 0, rect.mWidth, rect.mHeight ), ci::Vec2i( rect.mX, rect.mY ) );
+	}
+	ci::gl::Texture::Format format;
+	format.enableMipmapping();
+	return ci::gl::Texture( atlas, format );
+}
+
+} //end namespace model
@@ -0,0 +1,94 @@
+#include "ShaderPermutation.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <sstream>
+
+namespace model {
+
+namespace {
+	const int INFLUENCES_SHIFT = 8;
+	const ShaderFeatures INFLUENCES_MASK = 0x7 << INFLUENCES_SHIFT;
+}
+
+ShaderFeatures setMaxInfluences( ShaderFeatures features, int maxInfluences )
+{
+	maxInfluences = std::min( std::max( maxInfluences, 1 ), 4 );
+	return ( features & ~INFLUENCES_MASK ) | ( ShaderFeatures( maxInfluences ) << INFLUENCES_SHIFT );
+}
+
+int getMaxInfluences( ShaderFeatures features )
+{
+	int maxInfluences = int( ( features & INFLUENCES_MASK ) >> INFLUENCES_SHIFT );
+	return ( maxInfluences > 0 ) ? maxInfluences : 4;
+}
+
+std::string getShaderDefines( ShaderFeatures features )
+{
+	std::stringstream defines;
+	// Extension directives must precede any other token.
+	if( features & SHADER_PALETTE_BUFFER ) {
+		defines << "#extension GL_ARB_uniform_buffer_object : require\n";
+		defines << "#define BONE_PALETTE_UBO\n";
+	}
+	defines << "#define SHADER_PERMUTATION\n";
+	if( features & SHADER_SKINNED ) {
+		defines << "#define SKINNED\n";
+		defines << "#define MAX_INFLUENCES " << getMaxInfluences( features ) << "\n";
+	}
+	if( features & SHADER_NORMALS ) {
+		defines << "#define HAS_NORMALS\n";
+	}
+	if( features & SHADER_TEXTURE ) {
+		defines << "#define HAS_TEXTURE\n";
+	}
+	if( features & SHADER_PACKED_VERTICES ) {
+		defines << "#define PACKED_VERTICES\n";
+	}
+	if( features & SHADER_NORMAL_PALETTE ) {
+		defines << "#define NORMAL_PALETTE\n";
+	}
+	return defines.str();
+}
+
+const char* getAttribName( VertexSemantic semantic )
+{
+	static const char* names[NB_VERTEX_SEMANTICS] = { "position", "normal", "texcoord", "boneWeights", "boneIndices" };
+	return names[semantic];
+}
+
+namespace {
+	struct CachedAttribs {
+		std::weak_ptr<ci::gl::GlslProg>	mShader;
+		ShaderAttribs					mAttribs;
+	};
+}
+
+const ShaderAttribs& ShaderAttribs::get( const ci::gl::GlslProgRef& shader )
+{
+	// As PaletteUniforms: keyed by shader object, as released program names get reused
+	static std::map<const ci::gl::GlslProg*, CachedAttribs> sAttribs;
+	
+	auto it = sAttribs.find( shader.get() );
+	if( it != sAttribs.end() && ! it->second.mShader.expired() )
+		return it->second.mAttribs;
+	
+	// Drop the entries of released shaders
+	for( auto entry = sAttribs.begin(); entry != sAttribs.end(); ) {
+		if( entry->second.mShader.expired() ) {
+			entry = sAttribs.erase( entry );
+		} else {
+			++entry;
+		}
+	}
+	
+	CachedAttribs& cached = sAttribs[ shader.get() ];
+	cached.mShader = shader;
+	for( int i = 0; i < NB_VERTEX_SEMANTICS; ++i ) {
+		cached.mAttribs.mLocations[i] = shader->getAttribLocation( getAttribName( VertexSemantic( i ) ) );
+	}
+	return cached.mAttribs;
+}
+
+} //end namespace model
@@ -8,12 +8,24 @@
 
 #include "Skeleton.h"
 
+#include "Debug.h"
+#include "Profiling.h"
+
 #include <assert.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 
 namespace model {
 
 Skeleton::RenderMode Skeleton::mRenderMode = Skeleton::RenderMode::FULL;
 
+namespace {
+	std::atomic<uint64_t> sDefinitionId( 0 );
+	
+	uint64_t nextDefinitionId() { return ++sDefinitionId; }
+}
+
 SkeletonRef Skeleton::create( const std::unordered_set<std::string>& boneNames )
 {
 	SkeletonRef inst( new Skeleton() );
@@ -23,9 +35,24 @@ SkeletonRef Skeleton::create( const std::unordered_set<std::string>& boneNames )
 	return inst;
 }
 
+Skeleton::Skeleton()
+: mLod( 0 )
+, mNumLods( 1 )
+, mPosedTime( 0.0f )
+, mPosedAnimId( -1 )
+, mPosedVersion( 0 )
+, mDefinitionId( nextDefinitionId() )
+{ }
+
 Skeleton::Skeleton( NodeRef root, std::map<std::string, NodeRef> boneNames )
 : mRootNode( root )
 , mBoneNames( boneNames )
+, mLod( 0 )
+, mNumLods( 1 )
+, mPosedTime( 0.0f )
+, mPosedAnimId( -1 )
+, mPosedVersion( 0 )
+, mDefinitionId( nextDefinitionId() )
 { }
 
 void cloneTraversal( const NodeRef& origin, NodeRef& copy )
@@ -39,6 +66,12 @@ void cloneTraversal( const NodeRef& origin, NodeRef& copy )
 }
 
 Skeleton::Skeleton( const Skeleton &rhs )
+: mLod( rhs.mLod )
+, mNumLods( rhs.mNumLods )
+, mPosedTime( 0.0f )
+, mPosedAnimId( -1 )
+, mPosedVersion( 0 )
+, mDefinitionId( nextDefinitionId() )
 {
 	mRootNode = rhs.getRootNode()->clone();
 	cloneTraversal( rhs.getRootNode(), mRootNode );
@@ -49,6 +82,17 @@ Skeleton::Skeleton( const Skeleton &rhs )
 	}
 }
 
+Skeleton::~Skeleton()
+{
+	// Children hold their parents, so the hierarchy would otherwise keep itself (and the arena) alive.
+	if( mArena && mRootNode ) {
+		traverseNodes( mRootNode,
+					  [] ( const NodeRef& n ) {
+						  n->getParent() = nullptr;
+					  } );
+	}
+}
+
 SkeletonRef Skeleton::clone() const
 {
 	return SkeletonRef( new Skeleton( *this ) );
@@ -57,7 +101,7 @@ SkeletonRef Skeleton::clone() const
 void Skeleton::setPoseDefault()
 {
 	traverseNodes( mRootNode,
-				  [] ( NodeRef n ) {
+				  [] ( const NodeRef& n ) {
 					  n->resetToInitial();
 				  } );
 	
@@ -65,18 +109,28 @@ void Skeleton::setPoseDefault()
 
 void Skeleton::setPose( float time, int animId )
 {
-	traverseNodes( mRootNode,
-				  [&time, &animId] ( NodeRef n ) {
-					  n->animate( time, animId );
-				  } );
+	if( time == mPosedTime && animId == mPosedAnimId && getPoseVersion() == mPosedVersion )
+		return;
+	
+	MODEL_PROFILE_SCOPE( "Skeleton::setPose" );
+	animateLodNodes( mRootNode, time, animId );
+	mRootNode->touchPose();
+	mPosedTime = time;
+	mPosedAnimId = animId;
+	mPosedVersion = getPoseVersion();
 }
 	
 void Skeleton::setBlendedPose( float time, const std::unordered_map<int, float>& weights )
 {
-	traverseNodes( mRootNode,
-				  [=] ( NodeRef n ) {
-					  n->blendAnimate( time, weights );
-				  } );
+	MODEL_PROFILE_SCOPE( "Skeleton::setBlendedPose" );
+	blendLodNodes( mRootNode, time, weights );
+	mRootNode->touchPose();
+}
+
+void Skeleton::setRootNode( const NodeRef& root )
+{
+	mRootNode = root;
+	mDefinitionId = nextDefinitionId();
 }
 
 int Skeleton::findBoneIndex( const std::string& name ) const
@@ -119,14 +173,289 @@ NodeRef Skeleton::findNode( const std::string& name, const NodeRef& node ) const
 	return nullptr;
 }
 
-void Skeleton::traverseNodes( const NodeRef& node, std::function<void(NodeRef)> visit ) const
+void Skeleton::traverseNodes( const NodeRef& node, const std::function<void(const NodeRef&)>& visit ) const
 {
 	visit( node );
-	for( NodeRef child : node->getChildren() ) {
+	for( const NodeRef& child : node->getChildren() ) {
 		traverseNodes(child, visit);
 	}
 }
 
+size_t Skeleton::getNumNodes() const
+{
+	size_t count = 0;
+	if( mRootNode ) {
+		traverseNodes( mRootNode,
+					  [&count] ( const NodeRef& n ) {
+						  ++count;
+					  } );
+	}
+	return count;
+}
+
+namespace {
+	bool isIdentityRotation( const ci::Quatf& rotation )
+	{
+		return rotation.v.lengthSquared() <= 1e-10f;
+	}
+	
+	//! Whether \a node's absolute scale is uniform in every pose: neither it nor any ancestor is ever non-uniformly scaled.
+	bool hasUniformAbsoluteScale( const NodeRef& node )
+	{
+		for( const Node* n = node.get(); n; n = n->getParent().get() ) {
+			if( ! n->hasUniformScale() )
+				return false;
+		}
+		return true;
+	}
+	
+	bool isStaticHelper( const Skeleton& skeleton, const NodeRef& parent, const NodeRef& node, const std::unordered_set<std::string>& pinnedNodes )
+	{
+		if( skeleton.hasBone( node->getName() ) || node->hasAnimTracks() || pinnedNodes.count( node->getName() ) > 0 )
+			return false;
+		// Scales apply componentwise before rotations, so a rotated helper only folds exactly under a uniformly scaled parent.
+		bool rotated = ! isIdentityRotation( node->getRelativeRotation() ) || ! isIdentityRotation( node->getInitialRelativeRotation() );
+		return ! rotated || hasUniformAbsoluteScale( parent );
+	}
+}
+
+size_t Skeleton::collapseStaticNodes( const std::unordered_set<std::string>& pinnedNodes )
+{
+	if( ! mRootNode )
+		return 0;
+	
+	size_t removed = 0;
+	std::vector<NodeRef> nodes( 1, mRootNode );
+	while( ! nodes.empty() ) {
+		NodeRef node = nodes.back();
+		nodes.pop_back();
+		
+		// Children of folded helpers are examined in turn, in their original order, since helpers often come in chains.
+		std::vector<NodeRef> pending( node->getChildren().rbegin(), node->getChildren().rend() );
+		std::vector<NodeRef> children;
+		while( ! pending.empty() ) {
+			NodeRef child = pending.back();
+			pending.pop_back();
+			if( isStaticHelper( *this, node, child, pinnedNodes ) ) {
+				for( auto it = child->getChildren().rbegin(); it != child->getChildren().rend(); ++it ) {
+					(*it)->foldParentTransformation( child->getRelativePosition(), child->getRelativeRotation(), child->getRelativeScale() );
+					pending.push_back( *it );
+				}
+				child->getChildren().clear();
+				++removed;
+			} else {
+				children.push_back( child );
+			}
+		}
+		
+		for( const NodeRef& child : children ) {
+			if( child->getParent() != node ) {
+				child->setParent( node );
+			}
+			child->setLevel( node->getLevel() + 1 );
+			nodes.push_back( child );
+		}
+		node->getChildren() = children;
+	}
+	if( removed > 0 ) {
+		mRootNode->touchPose();
+		mDefinitionId = nextDefinitionId();
+	}
+	return removed;
+}
+
+void Skeleton::computeBonePalette( ci::Matrix44f* boneMatrices, ci::Matrix44f* invTransposeMatrices, size_t maxBones ) const
+{
+	if( mSharedPalette && mSharedPalette->mPoseVersion == getPoseVersion() ) {
+		size_t nbBones = std::min( maxBones, mSharedPalette->mBoneMatrices.size() );
+		std::copy( mSharedPalette->mBoneMatrices.begin(), mSharedPalette->mBoneMatrices.begin() + nbBones, boneMatrices );
+		if( invTransposeMatrices ) {
+			std::copy( mSharedPalette->mInvTransposeMatrices.begin(), mSharedPalette->mInvTransposeMatrices.begin() + nbBones, invTransposeMatrices );
+		}
+		return;
+	}
+	
+	size_t i = 0;
+	for( const auto& entry : mBoneNames ) {
+		if( i >= maxBones )
+			break;
+		const NodeRef& bone = entry.second;
+		boneMatrices[i] = bone->getAbsoluteTransformation() * *bone->getOffset();
+		if( invTransposeMatrices ) {
+			invTransposeMatrices[i] = boneMatrices[i].orthonormalInverted();
+			invTransposeMatrices[i].transpose();
+		}
+		++i;
+	}
+}
+
+namespace {
+	void savePoseStates( const NodeRef& node, std::vector<Node::PoseState>* states )
+	{
+		states->push_back( Node::PoseState() );
+		node->savePoseState( &states->back() );
+		for( const NodeRef& child : node->getChildren() ) {
+			savePoseStates( child, states );
+		}
+	}
+	
+	void restorePoseStates( const NodeRef& node, const Node::PoseState*& state )
+	{
+		node->restorePoseState( *state++ );
+		for( const NodeRef& child : node->getChildren() ) {
+			restorePoseStates( child, state );
+		}
+	}
+}
+
+void Skeleton::savePose( std::vector<Node::PoseState>* states ) const
+{
+	states->clear();
+	savePoseStates( mRootNode, states );
+}
+
+void Skeleton::restorePose( const std::vector<Node::PoseState>& states, uint64_t poseVersion )
+{
+	assert( states.size() == getNumNodes() );
+	const Node::PoseState* state = states.data();
+	restorePoseStates( mRootNode, state );
+	mRootNode->setPoseVersion( poseVersion );
+	// The restored pose is not the one last evaluated by setPose().
+	mPosedAnimId = -1;
+}
+
+void Skeleton::traverseLodNodes( const NodeRef& node, const std::function<void(const NodeRef&)>& visit ) const
+{
+	// Lod levels are closed over descendants, so the whole subtree can be skipped.
+	if( node->getLodLevel() < mLod )
+		return;
+	visit( node );
+	for( const NodeRef& child : node->getChildren() ) {
+		traverseLodNodes(child, visit);
+	}
+}
+
+void Skeleton::animateLodNodes( const NodeRef& node, float time, int animId )
+{
+	if( node->getLodLevel() < mLod )
+		return;
+	node->animate( time, animId );
+	MODEL_PROFILE_COUNT( BONES_EVALUATED, 1 );
+	for( const NodeRef& child : node->getChildren() ) {
+		animateLodNodes( child, time, animId );
+	}
+}
+
+void Skeleton::blendLodNodes( const NodeRef& node, float time, const std::unordered_map<int, float>& weights )
+{
+	if( node->getLodLevel() < mLod )
+		return;
+	node->blendAnimate( time, weights );
+	MODEL_PROFILE_COUNT( BONES_EVALUATED, 1 );
+	for( const NodeRef& child : node->getChildren() ) {
+		blendLodNodes( child, time, weights );
+	}
+}
+
+//! Raise every node's lod level to the maximum of its descendants'.
+int closeLodLevels( const NodeRef& node )
+{
+	int lodLevel = node->getLodLevel();
+	for( const auto& child : node->getChildren() ) {
+		lodLevel = std::max( lodLevel, closeLodLevels( child ) );
+	}
+	node->setLodLevel( lodLevel );
+	return lodLevel;
+}
+
+void Skeleton::setLodBoneSets( const std::vector< std::unordered_set<std::string> >& lodBoneSets )
+{
+	traverseNodes( mRootNode,
+				  [] ( const NodeRef& n ) {
+					  n->setLodLevel( 0 );
+				  } );
+	
+	mNumLods = lodBoneSets.size() + 1;
+	for( int lod = 1; lod < mNumLods; ++lod ) {
+		for( const std::string& name : lodBoneSets[lod - 1] ) {
+			auto it = mBoneNames.find( name );
+			NodeRef node = ( it != mBoneNames.end() ) ? it->second : getNode( name );
+			if( ! node ) {
+				LOG_M << "lod bone " << name << " not found in skeleton" << std::endl;
+				continue;
+			}
+			node->setLodLevel( std::max( node->getLodLevel(), lod ) );
+		}
+	}
+	closeLodLevels( mRootNode );
+	mRootNode->setLodLevel( mNumLods - 1 );
+	
+	int lod = std::min( mLod, mNumLods - 1 );
+	mLod = 0;
+	setLod( lod );
+	// The bones evaluated at the current LOD may have changed even if the LOD did not.
+	mPosedAnimId = -1;
+}
+
+void Skeleton::generateLodBoneSets( const std::vector<float>& keepRatios, LodCriterion criterion )
+{
+	std::vector<NodeRef> bones;
+	for( const auto& entry : mBoneNames ) {
+		if( entry.second ) {
+			bones.push_back( entry.second );
+		}
+	}
+	
+	std::stable_sort( bones.begin(), bones.end(), [criterion] ( const NodeRef& a, const NodeRef& b ) {
+		if( criterion == LOD_INFLUENCE && a->getInfluence() != b->getInfluence() ) {
+			return a->getInfluence() > b->getInfluence();
+		}
+		return a->getLevel() < b->getLevel();
+	} );
+	
+	std::vector< std::unordered_set<std::string> > lodBoneSets;
+	for( float ratio : keepRatios ) {
+		size_t count = std::min( bones.size(), size_t( std::ceil( ratio * bones.size() ) ) );
+		std::unordered_set<std::string> boneSet;
+		for( size_t i = 0; i < count; ++i ) {
+			boneSet.insert( bones[i]->getName() );
+		}
+		lodBoneSets.push_back( boneSet );
+	}
+	setLodBoneSets( lodBoneSets );
+}
+
+void Skeleton::setLod( int lod )
+{
+	lod = std::max( 0, std::min( lod, mNumLods - 1 ) );
+	if( lod == mLod )
+		return;
+	
+	mLod = lod;
+	// Bones rejoining a finer LOD are at rest until sampled: the next setPose() must not be skipped,
+	// even at the time and clip of the last one.
+	mPosedAnimId = -1;
+	// Excluded nodes are no longer animated: bring them back to their rest pose.
+	// Their absolute transformation then simply follows their parent's.
+	traverseNodes( mRootNode,
+				  [lod] ( const NodeRef& n ) {
+					  if( n->getLodLevel() < lod ) {
+						  n->resetToInitial();
+					  }
+				  } );
+}
+
+int Skeleton::getNumLodBones( int lod ) const
+{
+	int count = 0;
+	for( const auto& entry : mBoneNames ) {
+		if( entry.second && entry.second->getLodLevel() >= lod ) {
+			++count;
+		}
+	}
+	return count;
+}
+
 
 std::ostream& operator<<( std::ostream& o, const Skeleton& skeleton )
 {	
@@ -144,4 +473,29 @@ std::ostream& operator<<( std::ostream& o, const Skeleton& skeleton )
 	return o;
 }
 
+MemoryStats Skeleton::getMemoryStats() const
+{
+	MemoryStats stats;
+	stats.add( MemoryStats::HIERARCHY, sizeof( Skeleton ) + memory::mapBytes( mBoneNames ) + memory::unorderedMapBytes( mAnimInfoMap ) );
+	for( const auto& entry : mBoneNames ) {
+		stats.add( MemoryStats::HIERARCHY, memory::stringBytes( entry.first ) );
+	}
+	traverseNodes( mRootNode,
+				  [&stats] ( const NodeRef& n ) {
+					  stats.add( MemoryStats::HIERARCHY, n->getMemoryUsage() );
+					  stats.add( MemoryStats::ANIMATION, n->getAnimMemoryUsage() );
+				  } );
+	return stats;
+}
+
+MemoryStats Skeleton::getAnimMemoryStats( int animId ) const
+{
+	MemoryStats stats;
+	traverseNodes( mRootNode,
+				  [&stats, animId] ( const NodeRef& n ) {
+					  stats.add( MemoryStats::ANIMATION, n->getAnimMemoryUsage( animId ) );
+				  } );
+	return stats;
+}
+
 } //end namespace model
@@ -7,46 +7,153 @@
 //
 
 #include "SkinnedMesh.h"
+#include "AnimLod.h"
 #include "ModelTargetSkinnedMesh.h"
+#include "MorphTargets.h"
 #include "Node.h"
 #include "Skeleton.h"
+#include "Profiling.h"
+
+#include <algorithm>
 
 namespace model {
 
+namespace {
+	/*!
+	 * Skin the vertices [first, last), which all blend \a NbInfluences bones: the influence loop has a
+	 * compile time trip count, and nothing is tested per vertex.
+	 */
+	template<int NbInfluences, bool HasNormals>
+	void skinVertices( size_t first, size_t last, const BoneWeights* boneWeights, const ci::Matrix44f* palette,
+					   const ci::Vec3f* srcPositions, const ci::Vec3f* srcNormals, ci::Vec3f* positions, ci::Vec3f* normals )
+	{
+		for( size_t v = first; v < last; ++v ) {
+			const BoneWeights& weights = boneWeights[v];
+			ci::Vec3f position = ci::Vec3f::zero(), normal = ci::Vec3f::zero();
+			for( int i = 0; i < NbInfluences; ++i ) {
+				const ci::Matrix44f& transformation = palette[ weights.getBone( i )->getBoneIndex() ];
+				float weight = weights.getWeight( i );
+				position += weight * transformation.transformPointAffine( srcPositions[v] );
+				if( HasNormals )
+					normal += weight * transformation.transformVec( srcNormals[v] );
+			}
+			positions[v] = position;
+			if( HasNormals )
+				normals[v] = normal;
+		}
+	}
+	
+	template<bool HasNormals>
+	void skinRuns( const InfluenceRuns& runs, const BoneWeights* boneWeights, const ci::Matrix44f* palette,
+				   const ci::Vec3f* srcPositions, const ci::Vec3f* srcNormals, ci::Vec3f* positions, ci::Vec3f* normals )
+	{
+		static_assert( BoneWeights::NB_WEIGHTS == 4, "One kernel per influence count" );
+		const std::array<size_t, BoneWeights::NB_WEIGHTS + 2>& first = runs.mFirst;
+		skinVertices<0, HasNormals>( first[0], first[1], boneWeights, palette, srcPositions, srcNormals, positions, normals );
+		skinVertices<1, HasNormals>( first[1], first[2], boneWeights, palette, srcPositions, srcNormals, positions, normals );
+		skinVertices<2, HasNormals>( first[2], first[3], boneWeights, palette, srcPositions, srcNormals, positions, normals );
+		skinVertices<3, HasNormals>( first[3], first[4], boneWeights, palette, srcPositions, srcNormals, positions, normals );
+		skinVertices<4, HasNormals>( first[4], first[5], boneWeights, palette, srcPositions, srcNormals, positions, normals );
+	}
+}
+
+void SkinnedMesh::MeshSection::sortVerticesByInfluence()
+{
+	std::vector<uint32_t> remap = sortByInfluenceCount( &mTriMesh.getIndices(), mBoneWeights, &mInfluenceRuns );
+	mBoneWeights = remapVertices( mBoneWeights, remap );
+	mInitialPositions = remapVertices( mInitialPositions, remap );
+	mInitialNormals = remapVertices( mInitialNormals, remap );
+	mTriMesh.getVertices() = remapVertices( mTriMesh.getVertices(), remap );
+	mTriMesh.getNormals() = remapVertices( mTriMesh.getNormals(), remap );
+	mTriMesh.getTexCoords() = remapVertices( mTriMesh.getTexCoords(), remap );
+	if( mMorphTargets ) {
+		mMorphTargets->remapVertices( remap );
+		// The morphed vertices are in the previous order
+		mMorphVersion = 0;
+	}
+}
+
 void SkinnedMesh::MeshSection::updateMesh( bool enableSkinning )
 {
-	if( enableSkinning ) {
-		int vertexId = 0;
-		for( const BoneWeights& boneWeights : getBoneWeights() ) {
-			mTriMesh.getVertices()[vertexId] = ci::Vec3f::zero();
-			if( hasNormals() )
-				mTriMesh.getNormals()[vertexId] = ci::Vec3f::zero();
-			
-			for(  unsigned int i=0; i < boneWeights.mActiveNbWeights; ++i ) {
-				const ci::Vec3f& srcPos = mInitialPositions[vertexId];
-				ci::Vec3f srcNorm;
-				if( hasNormals() )
-					srcNorm = mInitialNormals[vertexId];
-				NodeRef bone = boneWeights.getBone(i);
-				ci::Matrix44f skinningTransfo = bone->getAbsoluteTransformation() * *bone->getOffset();
-				float weight = boneWeights.getWeight(i);
-				
-				mTriMesh.getVertices()[vertexId] += weight * (skinningTransfo * srcPos);
-				
-				if( hasNormals() )
-					mTriMesh.getNormals()[vertexId] += weight * (skinningTransfo.subMatrix33(0, 0) * srcNorm);
+	if( enableSkinning && mKind != KIND_RIGID && ! mBoneWeights.empty() && mInfluenceRuns.mFirst.back() != mBoneWeights.size() ) {
+		sortVerticesByInfluence();
+	}
+	uint64_t morphVersion = mMorphTargets ? mMorphTargets->getWeightVersion() : 0;
+	bool morphChanged = morphVersion != mMorphVersion;
+	if( enableSkinning && mSkeleton ) {
+		// Nothing to do until the skeleton is posed again, or the morph weights change
+		uint64_t poseVersion = mSkeleton->getPoseVersion();
+		if( mIsAnimated && poseVersion == mPoseVersion && ! morphChanged )
+			return;
+		mPoseVersion = poseVersion;
+	}
+	mMorphVersion = morphVersion;
+	
+	// The morph targets are applied to the bind pose vertices, before skinning.
+	const ci::Vec3f* srcPositions = mInitialPositions.data();
+	const ci::Vec3f* srcNormals = hasNormals() ? mInitialNormals.data() : nullptr;
+	if( mMorphTargets && mMorphTargets->hasActiveTargets() && ( morphChanged || ! mBoneWeights.empty() ) ) {
+		mMorphedPositions.resize( mInitialPositions.size() );
+		mMorphedNormals.resize( srcNormals ? mInitialNormals.size() : 0 );
+		if( morphChanged ) {
+			mMorphTargets->apply( mInitialPositions.data(), srcNormals, mMorphedPositions.data(), srcNormals ? mMorphedNormals.data() : nullptr, mInitialPositions.size() );
+		}
+		srcPositions = mMorphedPositions.data();
+		srcNormals = srcNormals ? mMorphedNormals.data() : nullptr;
+	}
+	
+	if( enableSkinning && mKind == KIND_RIGID ) {
+		// The vertices stay in bind pose, the renderer moves the whole section.
+		mRigidTransformation = mRigidBone->getAbsoluteTransformation() * *mRigidBone->getOffset();
+		if( morphChanged ) {
+			copyVertices( srcPositions, srcNormals );
+		}
+		mIsAnimated = true;
+	} else if( enableSkinning ) {
+		if( ! mBoneWeights.empty() ) {
+			size_t nbBones = mSkeleton->getNumBones();
+			mSkinningMatrices.resize( nbBones );
+			mSkeleton->computeBonePalette( mSkinningMatrices.data(), nullptr, nbBones );
+			if( srcNormals ) {
+				skinRuns<true>( mInfluenceRuns, mBoneWeights.data(), mSkinningMatrices.data(), srcPositions, srcNormals,
+							   mTriMesh.getVertices().data(), mTriMesh.getNormals().data() );
+			} else {
+				skinRuns<false>( mInfluenceRuns, mBoneWeights.data(), mSkinningMatrices.data(), srcPositions, nullptr,
+								mTriMesh.getVertices().data(), nullptr );
 			}
-			++vertexId;
+		} else if( morphChanged ) {
+			copyVertices( srcPositions, srcNormals );
 		}
+		MODEL_PROFILE_COUNT( VERTICES_SKINNED, mBoneWeights.size() );
 		mIsAnimated = true;
-	} else if( mIsAnimated ) {
-		mTriMesh.getVertices() = mInitialPositions;
-		if( hasNormals() )
-			mTriMesh.getNormals() = mInitialNormals;
+	} else if( mIsAnimated || morphChanged ) {
+		if( ! mBoneWeights.empty() || morphChanged ) {
+			copyVertices( srcPositions, srcNormals );
+		}
 		mIsAnimated = false;
 	}
 }
 
+void SkinnedMesh::MeshSection::copyVertices( const ci::Vec3f* positions, const ci::Vec3f* normals )
+{
+	std::copy( positions, positions + mInitialPositions.size(), mTriMesh.getVertices().begin() );
+	if( normals ) {
+		std::copy( normals, normals + mInitialNormals.size(), mTriMesh.getNormals().begin() );
+	}
+}
+
+MemoryStats SkinnedMesh::MeshSection::getMemoryStats() const
+{
+	MemoryStats stats = AMeshSection::getMemoryStats();
+	stats.add( MemoryStats::GEOMETRY, sizeof( MeshSection ) + memory::stringBytes( mName ) );
+	stats.add( MemoryStats::GEOMETRY, memory::vectorBytes( mTriMesh.getVertices() ) + memory::vectorBytes( mTriMesh.getNormals() )
+			  + memory::vectorBytes( mTriMesh.getTexCoords() ) + memory::vectorBytes( mTriMesh.getIndices() ) );
+	stats.add( MemoryStats::GEOMETRY, memory::vectorBytes( mInitialPositions ) + memory::vectorBytes( mInitialNormals ) );
+	stats.add( MemoryStats::GEOMETRY, memory::vectorBytes( mMorphedPositions ) + memory::vectorBytes( mMorphedNormals ) );
+	stats.add( MemoryStats::SKINNING, memory::vectorBytes( mSkinningMatrices ) );
+	return stats;
+}
+
 SkinnedMeshRef SkinnedMesh::create( ModelSourceRef modelSource, SkeletonRef skeleton )
 {
 	return SkinnedMeshRef( new SkinnedMesh( modelSource, skeleton ) );
@@ -66,15 +173,45 @@ SkinnedMesh::SkinnedMesh( ModelSourceRef modelSource, SkeletonRef skeleton )
 	
 	ModelTargetSkinnedMesh target( this );
 	modelSource->load( &target );
+	target.finishLoading();
 }
 
 void SkinnedMesh::update()
 {
-	for( MeshSectionRef section : mMeshSections ) {
+	MODEL_PROFILE_SCOPE( "SkinnedMesh::update" );
+	for( const MeshSectionRef& section : mMeshSections ) {
 		section->updateMesh( mEnableSkinning );
 	}
 }
 
+void SkinnedMesh::update( const AnimLodState& lodState )
+{
+	if( lodState.needsUpdate() ) {
+		update();
+	}
+}
+
+void SkinnedMesh::setMorphWeight( const std::string& name, float weight )
+{
+	for( const MeshSectionRef& section : mMeshSections ) {
+		if( ! section->hasMorphTargets() )
+			continue;
+		int target = section->getMorphTargets()->findTarget( name );
+		if( target >= 0 ) {
+			section->getMorphTargets()->setWeight( target, weight );
+		}
+	}
+}
+
+void SkinnedMesh::setMorphPose( float time, int animId )
+{
+	for( const MeshSectionRef& section : mMeshSections ) {
+		if( section->hasMorphTargets() ) {
+			section->getMorphTargets()->animate( time, animId );
+		}
+	}
+}
+
 MeshSectionRef& SkinnedMesh::setActiveSection( int index )
 {
 	assert( index >= 0 && index < (int) mMeshSections.size() );
@@ -88,4 +225,29 @@ void SkinnedMesh::appendSection( const MeshSectionRef& meshSection )
 	mActiveSection = meshSection;
 }
 
+ci::AxisAlignedBox3f SkinnedMesh::getBounds() const
+{
+	ci::AxisAlignedBox3f bounds = mMeshSections.front()->getAnimatedBounds();
+	for( size_t i = 1; i < mMeshSections.size(); ++i ) {
+		bounds = includeBounds( bounds, mMeshSections[i]->getAnimatedBounds() );
+	}
+	return bounds;
+}
+
+bool SkinnedMesh::isVisible( const ci::Frustumf& frustum, const ci::Matrix44f& transform ) const
+{
+	return frustum.intersects( getBounds().transformed( transform ) );
+}
+
+MemoryStats SkinnedMesh::getMemoryStats() const
+{
+	std::vector<const AMeshSection*> sections;
+	for( const MeshSectionRef& section : mMeshSections ) {
+		sections.push_back( section.get() );
+	}
+	MemoryStats stats = getSectionsMemoryStats( sections );
+	stats.add( MemoryStats::GEOMETRY, sizeof( SkinnedMesh ) + memory::vectorBytes( mMeshSections ) );
+	return stats;
+}
+
 } //end namespace model
\ No newline at end of file
@@ -7,90 +7,366 @@
 //
 
 #include "SkinnedVboMesh.h"
+#include "AnimLod.h"
 #include "ModelTargetSkinnedVboMesh.h"
+#include "MorphTargets.h"
 
+#include "Node.h"
 #include "Skeleton.h"
 #include "SkinningRenderer.h"
+#include "Profiling.h"
+#include "BonePalette.h"
 #include "Resources.h"
 
+#include <algorithm>
+#include <limits>
+
 namespace model {
 
 SkinnedVboMesh::MeshSection::MeshSection()
 : AMeshSection()
+, boneMatrices( nullptr )
+, invTransposeMatrices( nullptr )
+, paletteBuffer( nullptr )
+, mIsPacked( false )
+, mNumVertices( 0 )
+, mNumIndices( 0 )
+, mStride( 0 )
+, mIndexType( GL_UNSIGNED_INT )
+, mShaderFeatures( 0 )
+, mNumHiddenSubSections( 0 )
+, mPaletteMode( Format::PALETTE_AFFINE )
+, mNeedsNormalPalette( false )
 { }
 
-void SkinnedVboMesh::MeshSection::setVboMesh( size_t numVertices, size_t numIndices, ci::gl::VboMesh::Layout layout, GLenum primitiveType )
+void SkinnedVboMesh::MeshSection::setVertices( const void* vertices, size_t numVertices, size_t stride, const std::vector<uint32_t>& indices,
+											   const std::vector<VertexAttrib>& attribs )
+{
+	mVertexBuffer = ci::gl::Vbo( GL_ARRAY_BUFFER );
+	mVertexBuffer.bufferData( numVertices * stride, vertices, GL_STATIC_DRAW );
+	mVertexBuffer.unbind();
+	
+	mIndexBuffer = ci::gl::Vbo( GL_ELEMENT_ARRAY_BUFFER );
+	if( numVertices <= std::numeric_limits<uint16_t>::max() + size_t( 1 ) ) {
+		std::vector<uint16_t> shortIndices( indices.begin(), indices.end() );
+		mIndexBuffer.bufferData( shortIndices.size() * sizeof( uint16_t ), shortIndices.data(), GL_STATIC_DRAW );
+		mIndexType = GL_UNSIGNED_SHORT;
+	} else {
+		mIndexBuffer.bufferData( indices.size() * sizeof( uint32_t ), indices.data(), GL_STATIC_DRAW );
+		mIndexType = GL_UNSIGNED_INT;
+	}
+	mIndexBuffer.unbind();
+	MODEL_PROFILE_COUNT( BYTES_UPLOADED, numVertices * stride + indices.size() * getIndexSize() );
+	
+	mAttribs = attribs;
+	mQuantization = VertexQuantization();
+	mNumVertices = numVertices;
+	mNumIndices = indices.size();
+	mStride = stride;
+	mIsPacked = false;
+}
+
+void SkinnedVboMesh::MeshSection::setPackedVertices( const std::vector<PackedVertex>& vertices, const std::vector<uint32_t>& indices,
+													 const std::vector<VertexAttrib>& attribs, const VertexQuantization& quantization )
 {
-	mVboMesh = ci::gl::VboMesh( numVertices, numIndices, layout, primitiveType );
+	setVertices( vertices.data(), vertices.size(), sizeof( PackedVertex ), indices, attribs );
+	mQuantization = quantization;
+	mIsPacked = true;
 }
 
-void SkinnedVboMesh::MeshSection::updateMesh( bool enableSkinning )
+void SkinnedVboMesh::MeshSection::setStreamedVertices( const std::vector<ci::Vec3f>& positions, const std::vector<ci::Vec3f>& normals )
+{
+	mBaseVertices = positions;
+	mBaseVertices.insert( mBaseVertices.end(), normals.begin(), normals.end() );
+	mStreamVertices = mBaseVertices;
+	
+	mStreamBuffer = ci::gl::Vbo( GL_ARRAY_BUFFER );
+	mStreamBuffer.bufferData( mStreamVertices.size() * sizeof( ci::Vec3f ), mStreamVertices.data(), GL_STREAM_DRAW );
+	mStreamBuffer.unbind();
+	MODEL_PROFILE_COUNT( BYTES_UPLOADED, mStreamVertices.size() * sizeof( ci::Vec3f ) );
+	mMorphVersion = 0;
+	updateMorphTargets();
+}
+
+void SkinnedVboMesh::MeshSection::updateMorphTargets()
+{
+	if( ! mMorphTargets || ! mStreamBuffer || mMorphTargets->getWeightVersion() == mMorphVersion )
+		return;
+	mMorphVersion = mMorphTargets->getWeightVersion();
+	
+	bool hasNormals = mStreamVertices.size() > mNumVertices;
+	mMorphTargets->apply( mBaseVertices.data(), hasNormals ? mBaseVertices.data() + mNumVertices : nullptr,
+						  mStreamVertices.data(), hasNormals ? mStreamVertices.data() + mNumVertices : nullptr, mNumVertices );
+	// Respecifying the whole buffer lets the driver hand out fresh storage instead of waiting for pending draws.
+	mStreamBuffer.bufferData( mStreamVertices.size() * sizeof( ci::Vec3f ), mStreamVertices.data(), GL_STREAM_DRAW );
+	mStreamBuffer.unbind();
+	MODEL_PROFILE_COUNT( BYTES_UPLOADED, mStreamVertices.size() * sizeof( ci::Vec3f ) );
+}
+
+size_t SkinnedVboMesh::MeshSection::getIndexSize() const
+{
+	return ( mIndexType == GL_UNSIGNED_SHORT ) ? sizeof( uint16_t ) : sizeof( uint32_t );
+}
+
+void SkinnedVboMesh::MeshSection::bindBuffers( const GLint* locations ) const
+{
+	ci::gl::Vbo vertexBuffer = mVertexBuffer, streamBuffer = mStreamBuffer, indexBuffer = mIndexBuffer;
+	for( const VertexAttrib& attrib : mAttribs ) {
+		GLint location = locations ? locations[attrib.mSemantic] : attrib.mLocation;
+		if( location < 0 )
+			continue;
+		// Streamed attributes are tightly packed in their own block.
+		if( attrib.mStreamed ) {
+			streamBuffer.bind();
+		} else {
+			vertexBuffer.bind();
+		}
+		GLsizei stride = attrib.mStreamed ? (GLsizei) sizeof( ci::Vec3f ) : (GLsizei) mStride;
+		glEnableVertexAttribArray( location );
+		glVertexAttribPointer( location, attrib.mSize, attrib.mType, attrib.mNormalized, stride, (const GLvoid*) attrib.mOffset );
+	}
+	indexBuffer.bind();
+}
+
+void SkinnedVboMesh::MeshSection::unbindBuffers( const GLint* locations ) const
+{
+	ci::gl::Vbo vertexBuffer = mVertexBuffer, indexBuffer = mIndexBuffer;
+	indexBuffer.unbind();
+	for( const VertexAttrib& attrib : mAttribs ) {
+		GLint location = locations ? locations[attrib.mSemantic] : attrib.mLocation;
+		if( location >= 0 )
+			glDisableVertexAttribArray( location );
+	}
+	vertexBuffer.unbind();
+}
+
+void SkinnedVboMesh::MeshSection::drawIndices( size_t first, size_t count ) const
+{
+	if( mNumHiddenSubSections == 0 ) {
+		glDrawElements( GL_TRIANGLES, (GLsizei) count, mIndexType, (const GLvoid*) ( first * getIndexSize() ) );
+		MODEL_PROFILE_COUNT( DRAW_CALLS, 1 );
+		return;
+	}
+	
+	// Runs of consecutive visible ranges are drawn at once
+	size_t end = first + count, runFirst = first, runEnd = first;
+	for( const SubSectionRange& range : mSubSectionRanges ) {
+		size_t rangeFirst = std::max( first, range.mFirstIndex ), rangeEnd = std::min( end, range.mFirstIndex + range.mNumIndices );
+		if( rangeFirst >= rangeEnd )
+			continue;
+		if( ! mSubSections[ range.mSubSection ].mVisible )
+			continue;
+		if( rangeFirst != runEnd ) {
+			if( runEnd > runFirst ) {
+				glDrawElements( GL_TRIANGLES, (GLsizei) ( runEnd - runFirst ), mIndexType, (const GLvoid*) ( runFirst * getIndexSize() ) );
+				MODEL_PROFILE_COUNT( DRAW_CALLS, 1 );
+			}
+			runFirst = rangeFirst;
+		}
+		runEnd = rangeEnd;
+	}
+	if( runEnd > runFirst ) {
+		glDrawElements( GL_TRIANGLES, (GLsizei) ( runEnd - runFirst ), mIndexType, (const GLvoid*) ( runFirst * getIndexSize() ) );
+		MODEL_PROFILE_COUNT( DRAW_CALLS, 1 );
+	}
+}
+
+void SkinnedVboMesh::MeshSection::setSubSections( const std::vector<SubSection>& subSections, const std::vector<SubSectionRange>& ranges )
+{
+	mSubSections = subSections;
+	mSubSectionRanges = ranges;
+	mNumHiddenSubSections = std::count_if( mSubSections.begin(), mSubSections.end(), [] ( const SubSection& s ) { return ! s.mVisible; } );
+}
+
+void SkinnedVboMesh::MeshSection::setSubSectionVisible( size_t index, bool visible )
+{
+	if( mSubSections[index].mVisible != visible ) {
+		mSubSections[index].mVisible = visible;
+		mNumHiddenSubSections += visible ? -1 : 1;
+	}
+}
+
+void SkinnedVboMesh::MeshSection::draw() const
+{
+	if( mNumIndices == 0 )
+		return;
+	
+	bindBuffers( nullptr );
+	drawIndices( 0, mNumIndices );
+	unbindBuffers( nullptr );
+}
+
+void SkinnedVboMesh::MeshSection::draw( const ci::gl::GlslProgRef& shader ) const
+{
+	if( mIsAnimated && boneMatrices ) {
+		draw( shader, *boneMatrices, *invTransposeMatrices );
+	} else {
+		draw( shader, std::vector<ci::Matrix44f>(), std::vector<ci::Matrix44f>() );
+	}
+}
+
+void SkinnedVboMesh::MeshSection::draw( const ci::gl::GlslProgRef& shader, const std::vector<ci::Matrix44f>& boneMatrices,
+										const std::vector<ci::Matrix44f>& invTransposeMatrices ) const
+{
+	if( mNumIndices == 0 )
+		return;
+	
+	const GLint* locations = ShaderAttribs::get( shader ).mLocations;
+	if( mBatches.empty() || ! hasSkeleton() || boneMatrices.empty() ) {
+		// Bind pose: the whole section at once, without palette
+		bindBuffers( locations );
+		drawIndices( 0, mNumIndices );
+		unbindBuffers( locations );
+		return;
+	}
+	
+	const PaletteUniforms& uniforms = PaletteUniforms::get( shader );
+	bool useBuffer = mPaletteMode == Format::PALETTE_AFFINE && paletteBuffer && uniforms.mHasBlock;
+	
+	bindBuffers( locations );
+	for( size_t b = 0; b < mBatches.size(); ++b ) {
+		const BoneBatch& batch = mBatches[b];
+		if( useBuffer ) {
+			paletteBuffer->bind( mBatchSlices[b] );
+		} else if( mPaletteMode == Format::PALETTE_AFFINE ) {
+			uploadAffinePalette( shader, uniforms, batch, boneMatrices );
+		} else {
+			uploadMatrixPalette( shader, uniforms, batch, boneMatrices, invTransposeMatrices );
+		}
+		drawIndices( batch.mFirstIndex, batch.mNumIndices );
+	}
+	unbindBuffers( locations );
+}
+
+ci::Matrix44f SkinnedVboMesh::MeshSection::getRigidTransformation() const
+{
+	if( mIsAnimated && boneMatrices ) {
+		return getRigidTransformation( *boneMatrices );
+	}
+	return ci::Matrix44f::identity();
+}
+
+ci::Matrix44f SkinnedVboMesh::MeshSection::getRigidTransformation( const std::vector<ci::Matrix44f>& boneMatrices ) const
+{
+	int bone = mRigidBone ? mRigidBone->getBoneIndex() : -1;
+	if( bone < 0 || bone >= (int) boneMatrices.size() )
+		return ci::Matrix44f::identity();
+	return boneMatrices[bone];
+}
+
+ShaderFeatures SkinnedVboMesh::MeshSection::getDrawShaderFeatures() const
+{
+	ShaderFeatures features = mShaderFeatures;
+	if( ! mIsAnimated ) {
+		features &= ~SHADER_SKINNED;
+	} else if( features & SHADER_SKINNED ) {
+		if( paletteBuffer ) {
+			features |= SHADER_PALETTE_BUFFER;
+		}
+		if( mNeedsNormalPalette && ( features & SHADER_NORMALS ) ) {
+			features |= SHADER_NORMAL_PALETTE;
+		}
+	}
+	return features;
+}
+
+void SkinnedVboMesh::MeshSection::uploadMatrixPalette( const ci::gl::GlslProgRef& shader, const PaletteUniforms& uniforms, const BoneBatch& batch,
+													   const std::vector<ci::Matrix44f>& boneMatrices, const std::vector<ci::Matrix44f>& invTransposeMatrices ) const
+{
+	mBatchBoneMatrices.resize( batch.mBones.size() );
+	mBatchInvTransposeMatrices.resize( batch.mBones.size() );
+	for( size_t i = 0; i < batch.mBones.size(); ++i ) {
+		mBatchBoneMatrices[i] = boneMatrices[ batch.mBones[i] ];
+		mBatchInvTransposeMatrices[i] = invTransposeMatrices[ batch.mBones[i] ];
+	}
+	shader->uniform( uniforms.mBoneMatrices, mBatchBoneMatrices.data(), (int) batch.mBones.size() );
+	shader->uniform( uniforms.mInvTransposeMatrices, mBatchInvTransposeMatrices.data(), (int) batch.mBones.size() );
+	MODEL_PROFILE_COUNT( BYTES_UPLOADED, 2 * batch.mBones.size() * sizeof( ci::Matrix44f ) );
+}
+
+void SkinnedVboMesh::MeshSection::uploadAffinePalette( const ci::gl::GlslProgRef& shader, const PaletteUniforms& uniforms, const BoneBatch& batch,
+													   const std::vector<ci::Matrix44f>& boneMatrices ) const
+{
+	mBatchBoneRows.resize( 3 * batch.mBones.size() );
+	mBatchNormalRows.resize( 3 * batch.mBones.size() );
+	packAffinePalette( boneMatrices, batch.mBones, mBatchBoneRows.data(), mBatchNormalRows.data() );
+	shader->uniform( uniforms.mBonePalette, mBatchBoneRows.data(), (int) mBatchBoneRows.size() );
+	MODEL_PROFILE_COUNT( BYTES_UPLOADED, mBatchBoneRows.size() * sizeof( ci::Vec4f ) );
+	// Only the NORMAL_PALETTE permutation (or a shader compiled with every feature) declares it.
+	if( uniforms.mNormalPalette >= 0 ) {
+		shader->uniform( uniforms.mNormalPalette, mBatchNormalRows.data(), (int) mBatchNormalRows.size() );
+		MODEL_PROFILE_COUNT( BYTES_UPLOADED, mBatchNormalRows.size() * sizeof( ci::Vec4f ) );
+	}
+}
+
+void SkinnedVboMesh::MeshSection::setPaletteBuffer( PaletteBuffer* buffer )
 {
-	if( enableSkinning ) {
-		int i = 0;
-		for( const auto& entry : mSkeleton->getBoneNames() ) {
-			if( i >= MAXBONES )
-				break;
-			NodeRef bone = entry.second;
-			(*boneMatrices)[i] = bone->getAbsoluteTransformation() * *bone->getOffset();
-			(*invTransposeMatrices)[i] = (*boneMatrices)[i].orthonormalInverted();
-			(*invTransposeMatrices)[i].transpose();
-			++i;
+	paletteBuffer = buffer;
+	mBatchSlices.clear();
+	if( buffer ) {
+		for( const BoneBatch& batch : mBatches ) {
+			mBatchSlices.push_back( buffer->addBatch( batch ) );
 		}
-		mIsAnimated = true;
-	} else if( mIsAnimated ) {
-		mIsAnimated = false;
 	}
 }
 
-SkinnedVboMeshRef SkinnedVboMesh::create( ModelSourceRef modelSource, SkeletonRef skeleton, ci::gl::GlslProgRef skinningShader )
+void SkinnedVboMesh::MeshSection::updateMesh( bool enableSkinning )
+{
+	// The palette itself is shared by the sections: the mesh computes it once.
+	mIsAnimated = enableSkinning && hasSkeleton();
+}
+
+MemoryStats SkinnedVboMesh::MeshSection::getMemoryStats() const
+{
+	MemoryStats stats = AMeshSection::getMemoryStats();
+	stats.add( MemoryStats::GEOMETRY, sizeof( MeshSection ) );
+	stats.add( MemoryStats::GPU_BUFFERS, mNumVertices * mStride + mNumIndices * getIndexSize() + mStreamVertices.size() * sizeof( ci::Vec3f ) );
+	stats.add( MemoryStats::GEOMETRY, memory::vectorBytes( mBaseVertices ) + memory::vectorBytes( mStreamVertices ) );
+	stats.add( MemoryStats::GEOMETRY, memory::vectorBytes( mSubSections ) + memory::vectorBytes( mSubSectionRanges ) );
+	stats.add( MemoryStats::SKINNING, memory::vectorBytes( mBatches ) + memory::vectorBytes( mBatchBoneMatrices ) + memory::vectorBytes( mBatchInvTransposeMatrices )
+			  + memory::vectorBytes( mBatchBoneRows ) + memory::vectorBytes( mBatchNormalRows ) + memory::vectorBytes( mBatchSlices ) );
+	for( const BoneBatch& batch : mBatches ) {
+		stats.add( MemoryStats::SKINNING, memory::vectorBytes( batch.mBones ) );
+	}
+	return stats;
+}
+
+SkinnedVboMeshRef SkinnedVboMesh::create( ModelSourceRef modelSource, SkeletonRef skeleton, ci::gl::GlslProgRef skinningShader, const Format& format )
 {
 	if( skinningShader ) {
-		return SkinnedVboMeshRef( new SkinnedVboMesh( modelSource, skinningShader, skeleton ) );
+		return SkinnedVboMeshRef( new SkinnedVboMesh( modelSource, skinningShader, skeleton, format ) );
 	} else {
-		return SkinnedVboMeshRef( new SkinnedVboMesh( modelSource, SkinningRenderer::instance().getShader(), skeleton ) );
+		return SkinnedVboMeshRef( new SkinnedVboMesh( modelSource, SkinningRenderer::instance().getShader(), skeleton, format ) );
 	}
 }
 
-SkinnedVboMesh::SkinnedVboMesh( ModelSourceRef modelSource, ci::gl::GlslProgRef skinningShader, SkeletonRef skeleton )
+SkinnedVboMesh::SkinnedVboMesh( ModelSourceRef modelSource, ci::gl::GlslProgRef skinningShader, SkeletonRef skeleton, const Format& format )
 : mEnableSkinning( true )
+, mFormat( format )
+, mPaletteVersion( 0 )
 , mSkinningShader( skinningShader )
 {
 	assert( modelSource->getNumSections() > 0 );
 	
 	for( unsigned int i = 0; i< modelSource->getNumSections(); ++i ) {
+		// The buffers are created by the target once the whole section is known.
 		MeshVboSectionRef section = std::make_shared<SkinnedVboMesh::MeshSection>();
-		ci::gl::VboMesh::Layout layout;
-		layout.setStaticIndices();
-		//positions
-		layout.mCustomStatic.push_back(std::make_pair(ci::gl::VboMesh::Layout::CUSTOM_ATTR_FLOAT3, 0 ));
-		
-		if( modelSource->hasNormals(i) ) {
-			//normals
-			layout.mCustomStatic.push_back(std::make_pair(ci::gl::VboMesh::Layout::CUSTOM_ATTR_FLOAT3, 0 ));
-		}
-		
-		if( modelSource->hasMaterials(i) ) {
-			//texcoords
-			layout.mCustomStatic.push_back(std::make_pair(ci::gl::VboMesh::Layout::CUSTOM_ATTR_FLOAT2, 0 ));
-		}
-		
-		if( modelSource->hasSkeleton(i) ) {
-			//boneweights
-			layout.mCustomStatic.push_back(std::make_pair(ci::gl::VboMesh::Layout::CUSTOM_ATTR_FLOAT4, 0 ));
-			//boneindices
-			layout.mCustomStatic.push_back(std::make_pair(ci::gl::VboMesh::Layout::CUSTOM_ATTR_FLOAT4, 0 ));
-		}
-		
-		section->setVboMesh( modelSource->getNumVertices(i), modelSource->getNumIndices(i), layout, GL_TRIANGLES );
-		
 		section->setSkeleton( skeleton );
+		section->setPaletteMode( mFormat.getPaletteMode() );
 		mMeshSections.push_back( section );
 	}
 	mActiveSection = mMeshSections[0];
 	
 	ModelTargetSkinnedVboMesh target( this );
 	modelSource->load( &target );
+	target.finishLoading();
+	
+	if( mFormat.getPaletteMode() == Format::PALETTE_AFFINE && PaletteBuffer::isSupported( MAXBONES ) && PaletteUniforms::get( mSkinningShader ).mHasBlock ) {
+		mPaletteBuffer.reset( new PaletteBuffer( MAXBONES ) );
+		for( MeshVboSectionRef section : mMeshSections ) {
+			section->setPaletteBuffer( mPaletteBuffer.get() );
+		}
+	}
 }
 
 MeshVboSectionRef& SkinnedVboMesh::setActiveSection( int index )
@@ -100,11 +376,146 @@ MeshVboSectionRef& SkinnedVboMesh::setActiveSection( int index )
 	return mActiveSection;
 }
 
-void SkinnedVboMesh::update()
+void SkinnedVboMesh::setSectionVisible( int sourceIndex, bool visible )
 {
 	for( MeshVboSectionRef section : mMeshSections ) {
+		const std::vector<SubSection>& subSections = section->getSubSections();
+		for( size_t i = 0; i < subSections.size(); ++i ) {
+			if( subSections[i].mSourceIndex == sourceIndex ) {
+				section->setSubSectionVisible( i, visible );
+			}
+		}
+	}
+}
+
+void SkinnedVboMesh::setMorphWeight( const std::string& name, float weight )
+{
+	for( const MeshVboSectionRef& section : mMeshSections ) {
+		if( ! section->hasMorphTargets() )
+			continue;
+		int target = section->getMorphTargets()->findTarget( name );
+		if( target >= 0 ) {
+			section->getMorphTargets()->setWeight( target, weight );
+		}
+	}
+}
+
+void SkinnedVboMesh::setMorphPose( float time, int animId )
+{
+	for( const MeshVboSectionRef& section : mMeshSections ) {
+		if( section->hasMorphTargets() ) {
+			section->getMorphTargets()->animate( time, animId );
+		}
+	}
+}
+
+void SkinnedVboMesh::updateMorphTargets()
+{
+	for( const MeshVboSectionRef& section : mMeshSections ) {
+		section->updateMorphTargets();
+	}
+}
+
+void SkinnedVboMesh::update()
+{
+	MODEL_PROFILE_SCOPE( "SkinnedVboMesh::update" );
+	updateMorphTargets();
+	if( updateSections() ) {
+		uploadPalette();
+	}
+}
+
+void SkinnedVboMesh::update( AnimLodState& lodState )
+{
+	MODEL_PROFILE_SCOPE( "SkinnedVboMesh::update(lod)" );
+	if( ! mEnableSkinning || ! hasSkeleton() ) {
+		update();
+		return;
+	}
+	
+	updateMorphTargets();
+	if( lodState.needsUpdate() ) {
+		updateSections();
+		lodState.storePalette( mBoneMatrices.data(), mInvTransposeMatrices.empty() ? nullptr : mInvTransposeMatrices.data(), mBoneMatrices.size() );
+	}
+	lodState.blendPalette( mBoneMatrices.data(), mInvTransposeMatrices.empty() ? nullptr : mInvTransposeMatrices.data(), mBoneMatrices.size() );
+	mPaletteVersion = 0;
+	uploadPalette();
+}
+
+bool SkinnedVboMesh::updateSections()
+{
+	SkeletonRef skeleton;
+	for( const MeshVboSectionRef& section : mMeshSections ) {
+		if( section->hasSkeleton() ) {
+			skeleton = section->getSkeleton();
+			break;
+		}
+	}
+	
+	uint64_t poseVersion = ( mEnableSkinning && skeleton ) ? skeleton->getPoseVersion() : 0;
+	if( poseVersion != 0 && poseVersion == mPaletteVersion )
+		return false;
+	
+	if( poseVersion != 0 ) {
+		size_t nbBones = skeleton->getNumBones();
+		mBoneMatrices.resize( nbBones );
+		if( mFormat.getPaletteMode() == Format::PALETTE_AFFINE ) {
+			// Normals are transformed in the shader: no inversion needed.
+			mInvTransposeMatrices.clear();
+			skeleton->computeBonePalette( mBoneMatrices.data(), nullptr, nbBones );
+		} else {
+			mInvTransposeMatrices.resize( nbBones );
+			skeleton->computeBonePalette( mBoneMatrices.data(), mInvTransposeMatrices.data(), nbBones );
+		}
+	}
+	mPaletteVersion = poseVersion;
+	
+	for( const MeshVboSectionRef& section : mMeshSections ) {
 		section->updateMesh( mEnableSkinning );
 	}
+	return true;
+}
+
+void SkinnedVboMesh::uploadPalette()
+{
+	bool needsNormalPalette = mFormat.getPaletteMode() == Format::PALETTE_AFFINE && mEnableSkinning && hasNonUniformScale( mBoneMatrices );
+	for( const MeshVboSectionRef& section : mMeshSections ) {
+		section->setNeedsNormalPalette( needsNormalPalette );
+	}
+	if( mPaletteBuffer && mEnableSkinning && ! mBoneMatrices.empty() ) {
+		mPaletteBuffer->update( mBoneMatrices );
+	}
+}
+
+ci::AxisAlignedBox3f SkinnedVboMesh::getBounds() const
+{
+	ci::AxisAlignedBox3f bounds = mMeshSections.front()->getAnimatedBounds();
+	for( size_t i = 1; i < mMeshSections.size(); ++i ) {
+		bounds = includeBounds( bounds, mMeshSections[i]->getAnimatedBounds() );
+	}
+	return bounds;
+}
+
+bool SkinnedVboMesh::isVisible( const ci::Frustumf& frustum, const ci::Matrix44f& transform ) const
+{
+	return frustum.intersects( getBounds().transformed( transform ) );
+}
+
+MemoryStats SkinnedVboMesh::getMemoryStats() const
+{
+	std::vector<const AMeshSection*> sections;
+	for( const MeshVboSectionRef& section : mMeshSections ) {
+		sections.push_back( section.get() );
+	}
+	MemoryStats stats = getSectionsMemoryStats( sections );
+	stats.add( MemoryStats::SKINNING, memory::vectorBytes( mBoneMatrices ) + memory::vectorBytes( mInvTransposeMatrices ) );
+	if( mPaletteBuffer ) {
+		stats.add( MemoryStats::SKINNING, sizeof( PaletteBuffer ) + mPaletteBuffer->getCpuBytes() );
+		stats.add( MemoryStats::GPU_BUFFERS, mPaletteBuffer->getBytes() );
+	}
+	stats.add( MemoryStats::GEOMETRY, sizeof( SkinnedVboMesh ) + memory::vectorBytes( mMeshSections ) );
+	return stats;
 }
 
-} //end namespace model
+} //end namespace model
\ No newline at end of file
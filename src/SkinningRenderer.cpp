@@ -5,6 +5,7 @@
 #include "cinder/gl/TextureFont.h"
 #include "cinder/Camera.h"
 #include "cinder/app/AppNative.h"
+#include "cinder/Utilities.h"
 
 #include "SkinningRenderer.h"
 #include "Resources.h"
@@ -12,6 +13,9 @@
 #include "Skeleton.h"
 #include "Node.h"
 #include "SkinnedVboMesh.h"
+#include "Profiling.h"
+#include "BonePalette.h"
+#include "RenderQueue.h"
 
 namespace model {
 	
@@ -30,13 +34,48 @@ namespace model {
 	
 	SkinningRenderer::SkinningRenderer()
 	{
+		mVertexSource = ci::loadString( ci::app::loadResource(RES_SKINNING_VERT) );
+		mFragmentSource = ci::loadString( ci::app::loadResource(RES_SKINNING_FRAG) );
+		ShaderFeatures features = setMaxInfluences( SHADER_SKINNED | SHADER_NORMALS | SHADER_TEXTURE, 4 );
+		if( PaletteBuffer::isSupported( SkinnedVboMesh::MAXBONES ) ) {
+			// Bone palettes are read from a uniform buffer by the meshes loaded with this permutation.
+			mSkinningShader = getShader( features | SHADER_PALETTE_BUFFER );
+			if( ! mSkinningShader ) {
+				ci::app::console() << "Falling back to uniform palettes." << std::endl;
+			}
+		}
+		if( ! mSkinningShader ) {
+			mSkinningShader = getShader( features );
+		}
+	}
+	
+	const SkinningRenderer::Permutation& SkinningRenderer::getPermutation( ShaderFeatures features ) const
+	{
+		auto it = mPermutations.find( features );
+		if( it != mPermutations.end() )
+			return it->second;
+		
+		MODEL_PROFILE_SCOPE( "SkinningRenderer::compilePermutation" );
+		Permutation permutation;
 		try {
-			mSkinningShader = ci::gl::GlslProg::create( ci::app::loadResource(RES_SKINNING_VERT), ci::app::loadResource(RES_SKINNING_FRAG) );
+			std::string vertexShader = getShaderDefines( features ) + mVertexSource;
+			// The fragment stage has no use for the palette extension.
+			std::string fragmentShader = getShaderDefines( features & ~SHADER_PALETTE_BUFFER ) + mFragmentSource;
+			permutation.mShader = ci::gl::GlslProg::create( vertexShader.c_str(), fragmentShader.c_str() );
 		}
 		catch( ci::gl::GlslProgCompileExc &exc ) {
-			ci::app::console() << "Shader compile error: " << std::endl;
+			ci::app::console() << "Shader compile error (features " << features << "): " << std::endl;
 			ci::app::console() << exc.what();
 		}
+		if( permutation.mShader ) {
+			permutation.mTexture = permutation.mShader->getUniformLocation( "texture" );
+			permutation.mPositionScale = permutation.mShader->getUniformLocation( "positionScale" );
+			permutation.mPositionOffset = permutation.mShader->getUniformLocation( "positionOffset" );
+			permutation.mTexcoordScale = permutation.mShader->getUniformLocation( "texcoordScale" );
+			permutation.mTexcoordOffset = permutation.mShader->getUniformLocation( "texcoordOffset" );
+		}
+		// Failures are cached as well, so that they are only reported once.
+		return mPermutations.insert( std::make_pair( features, permutation ) ).first->second;
 	}
 	
 	void SkinningRenderer::draw( std::shared_ptr<SkinnedMesh> skinnedMesh )
@@ -49,6 +88,11 @@ namespace model {
 		instance().privateDraw( skinnedVboMesh );
 	}
 	
+	void SkinningRenderer::draw( RenderQueue& renderQueue )
+	{
+		instance().privateDraw( renderQueue );
+	}
+	
 	void SkinningRenderer::draw( std::shared_ptr<Skeleton> skeleton, bool absolute, const std::string& name )
 	{
 		instance().privateDraw( skeleton, absolute, name );
@@ -61,10 +105,18 @@ namespace model {
 	
 	void SkinningRenderer::drawSection( const AMeshSection& section, std::function<void()> drawMesh ) const
 	{
-		if( section.hasDefaultTransformation() ) {
+		// Rigid sections are moved by their bone as a whole.
+		bool isRigid = section.getKind() == AMeshSection::KIND_RIGID && section.isAnimated();
+		bool hasTransformation = section.hasDefaultTransformation() || isRigid;
+		if( hasTransformation ) {
 			ci::gl::pushModelView();
+		}
+		if( section.hasDefaultTransformation() ) {
 			ci::gl::multModelView( section.getDefaultTranformation() );
 		}
+		if( isRigid ) {
+			ci::gl::multModelView( section.getRigidTransformation() );
+		}
 		
 		if ( section.getMatInfo().mTexture ) {
 			section.getMatInfo().mTexture.enableAndBind();
@@ -85,17 +137,23 @@ namespace model {
 			section.getMatInfo().mTexture.unbind();
 		}
 		
-		if( section.hasDefaultTransformation() ) {
+		if( hasTransformation ) {
 			ci::gl::popModelView();
 		}
 	}
 	
 	void SkinningRenderer::privateDraw( std::shared_ptr<SkinnedMesh> skinnedMesh ) const
 	{
-		
+		MODEL_PROFILE_SCOPE( "SkinningRenderer::draw(SkinnedMesh)" );
 		for( const SkinnedMesh::MeshSectionRef& section : skinnedMesh->getSections() ) {
 			auto drawMesh = [section] {
 				ci::gl::draw( section->mTriMesh );
+				// The trimesh is drawn from client-side arrays, so all of it is sent every draw.
+				MODEL_PROFILE_COUNT( DRAW_CALLS, 1 );
+				MODEL_PROFILE_COUNT( BYTES_UPLOADED, section->mTriMesh.getVertices().size() * sizeof( ci::Vec3f )
+									+ section->mTriMesh.getNormals().size() * sizeof( ci::Vec3f )
+									+ section->mTriMesh.getTexCoords().size() * sizeof( ci::Vec2f )
+									+ section->mTriMesh.getIndices().size() * sizeof( uint32_t ) );
 			};
 			drawSection( *section.get(), drawMesh);
 		}
@@ -103,24 +161,115 @@ namespace model {
 	
 	void SkinningRenderer::privateDraw(std::shared_ptr<SkinnedVboMesh> skinnedVboMesh ) const
 	{
-		
+		MODEL_PROFILE_SCOPE( "SkinningRenderer::draw(SkinnedVboMesh)" );
 		for( const SkinnedVboMesh::MeshVboSectionRef& section : skinnedVboMesh->getSections() ) {
-			auto drawMesh = [=] {
-				mSkinningShader->bind();
-				mSkinningShader->uniform( "isAnimated", section->isAnimated() );
-				mSkinningShader->uniform( "texture", 0 );
-				if( section->hasSkeleton() ) {
-					mSkinningShader->uniform( "boneMatrices", section->boneMatrices->data(), SkinnedVboMesh::MAXBONES );
-					mSkinningShader->uniform( "invTransposeMatrices", section->invTransposeMatrices->data(), SkinnedVboMesh::MAXBONES );
+			ShaderFeatures features = section->getDrawShaderFeatures();
+			const Permutation& permutation = getPermutation( features );
+			if( ! permutation.mShader )
+				continue;
+			
+			auto drawMesh = [&] {
+				const ci::gl::GlslProgRef& shader = permutation.mShader;
+				shader->bind();
+				if( features & SHADER_TEXTURE ) {
+					shader->uniform( permutation.mTexture, 0 );
+				}
+				if( features & SHADER_PACKED_VERTICES ) {
+					const VertexQuantization& quantization = section->getQuantization();
+					shader->uniform( permutation.mPositionScale, quantization.mPositionScale );
+					shader->uniform( permutation.mPositionOffset, quantization.mPositionOffset );
+					shader->uniform( permutation.mTexcoordScale, quantization.mTexCoordScale );
+					shader->uniform( permutation.mTexcoordOffset, quantization.mTexCoordOffset );
 				}
-				ci::gl::draw( section->getVboMesh() );
-				//    ci::gl::drawRange(mVbo, 0, mVbo.getNumIndices()*3);
-				mSkinningShader->unbind();
+				if( features & SHADER_SKINNED ) {
+					MODEL_PROFILE_COUNT( VERTICES_SKINNED, section->getNumVertices() );
+				}
+				section->draw( shader );
+				shader->unbind();
 			};
 			drawSection( *section.get(), drawMesh );
 		}
 	}
 	
+	void SkinningRenderer::privateDraw( RenderQueue& renderQueue ) const
+	{
+		MODEL_PROFILE_SCOPE( "SkinningRenderer::draw(RenderQueue)" );
+		renderQueue.sort();
+		// One upload per palette buffer, whatever the order of the draws
+		renderQueue.uploadPalettes();
+		
+		const RenderState* previous = nullptr;
+		const Permutation* permutation = nullptr;
+		ci::gl::GlslProgRef boundShader;
+		
+		ci::gl::pushModelView();
+		for( size_t i = 0; i < renderQueue.size(); ++i ) {
+			const RenderQueue::Item& item = renderQueue.getSortedItem( i );
+			const RenderState& state = renderQueue.getSortedState( i );
+			uint32_t changes = getStateChanges( previous, state );
+			
+			if( changes & CHANGE_PROGRAM ) {
+				permutation = &getPermutation( state.mFeatures );
+				if( ! permutation->mShader )
+					continue;
+				boundShader = permutation->mShader;
+				boundShader->bind();
+				if( state.mFeatures & SHADER_TEXTURE ) {
+					permutation->mShader->uniform( permutation->mTexture, 0 );
+				}
+			}
+			if( changes & CHANGE_TEXTURE ) {
+				if( state.mTexture ) {
+					renderQueue.getTexture( state.mTexture ).enableAndBind();
+				} else if( previous && previous->mTexture ) {
+					renderQueue.getTexture( previous->mTexture ).unbind();
+				}
+			}
+			if( changes & CHANGE_MATERIAL ) {
+				renderQueue.getMaterial( state.mMaterial ).apply();
+			}
+			if( changes & CHANGE_CULL_FACE ) {
+				if( state.mCullFace ) {
+					ci::gl::enable( GL_CULL_FACE );
+				} else {
+					ci::gl::disable( GL_CULL_FACE );
+				}
+			}
+			MODEL_PROFILE_COUNT( STATE_CHANGES, countStateChanges( changes ) );
+			previous = &state;
+			
+			const ci::gl::GlslProgRef& shader = permutation->mShader;
+			const SkinnedVboMesh::MeshSection* section = item.mSection;
+			if( state.mFeatures & SHADER_PACKED_VERTICES ) {
+				const VertexQuantization& quantization = section->getQuantization();
+				shader->uniform( permutation->mPositionScale, quantization.mPositionScale );
+				shader->uniform( permutation->mPositionOffset, quantization.mPositionOffset );
+				shader->uniform( permutation->mTexcoordScale, quantization.mTexCoordScale );
+				shader->uniform( permutation->mTexcoordOffset, quantization.mTexCoordOffset );
+			}
+			glLoadMatrixf( item.mModelView.m );
+			
+			if( item.mPalette < 0 ) {
+				section->draw( shader, std::vector<ci::Matrix44f>(), std::vector<ci::Matrix44f>() );
+				continue;
+			}
+			const RenderQueue::Palette& palette = renderQueue.getPalette( item.mPalette );
+			if( palette.mBuffer ) {
+				palette.mBuffer->selectPalette( palette.mBufferPalette );
+			}
+			MODEL_PROFILE_COUNT( VERTICES_SKINNED, section->getNumVertices() );
+			section->draw( shader, palette.mBoneMatrices, palette.mInvTransposeMatrices );
+		}
+		if( previous && previous->mTexture ) {
+			renderQueue.getTexture( previous->mTexture ).unbind();
+		}
+		if( boundShader ) {
+			boundShader->unbind();
+		}
+		ci::gl::popModelView();
+		renderQueue.clear();
+	}
+	
 	void SkinningRenderer::drawRelative( SkeletonRef skeleton, const NodeRef& node, const NodeRef& parent) const
 	{
 		ci::Matrix44f currentTransformation = node->getRelativeTransformation();
@@ -139,7 +288,7 @@ namespace model {
 	void SkinningRenderer::drawAbsolute( SkeletonRef skeleton, const NodeRef& node ) const
 	{
 		skeleton->traverseNodes( node,
-					  [=] ( NodeRef n ) {
+					  [=] ( const NodeRef& n ) {
 						  if( isVisibleNode( skeleton, n ) ) {
 							  drawSkeletonNode( *n );
 						  }
@@ -173,7 +322,7 @@ namespace model {
 		ci::gl::pushMatrices();
 		ci::gl::setMatricesWindow( ci::app::getWindowSize() );
 		skeleton->traverseNodes( skeleton->getRootNode(),
-								[=] ( NodeRef n ) {
+								[=] ( const NodeRef& n ) {
 									if( isVisibleNode( skeleton, n ) ) {
 										drawLabel(*n, camera, mv );
 									}
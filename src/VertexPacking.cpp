@@ -0,0 +1,136 @@
+#include "VertexPacking.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace model {
+
+namespace {
+	float signNotZero( float v ) { return ( v >= 0.0f ) ? 1.0f : -1.0f; }
+
+	float clamp( float v, float lo, float hi ) { return std::min( std::max( v, lo ), hi ); }
+}
+
+int16_t packSnorm16( float value )
+{
+	return int16_t( std::floor( clamp( value, -1.0f, 1.0f ) * 32767.0f + 0.5f ) );
+}
+
+uint16_t packUnorm16( float value )
+{
+	return uint16_t( std::floor( clamp( value, 0.0f, 1.0f ) * 65535.0f + 0.5f ) );
+}
+
+ci::Vec2f encodeOctahedral( const ci::Vec3f& normal )
+{
+	float l1 = std::abs( normal.x ) + std::abs( normal.y ) + std::abs( normal.z );
+	if( l1 == 0.0f )
+		return ci::Vec2f::zero();
+	ci::Vec2f e( normal.x / l1, normal.y / l1 );
+	if( normal.z < 0.0f ) {
+		// Fold the lower hemisphere over the diagonals
+		e = ci::Vec2f( ( 1.0f - std::abs( e.y ) ) * signNotZero( e.x ), ( 1.0f - std::abs( e.x ) ) * signNotZero( e.y ) );
+	}
+	return e;
+}
+
+ci::Vec3f decodeOctahedral( const ci::Vec2f& encoded )
+{
+	ci::Vec3f n( encoded.x, encoded.y, 1.0f - std::abs( encoded.x ) - std::abs( encoded.y ) );
+	if( n.z < 0.0f ) {
+		n = ci::Vec3f( ( 1.0f - std::abs( encoded.y ) ) * signNotZero( encoded.x ), ( 1.0f - std::abs( encoded.x ) ) * signNotZero( encoded.y ), n.z );
+	}
+	return n.normalized();
+}
+
+void packBoneWeights( const BoneWeights& boneWeights, uint8_t weights[BoneWeights::NB_WEIGHTS] )
+{
+	const int n = BoneWeights::NB_WEIGHTS;
+	std::fill( weights, weights + n, 0 );
+
+	float sum = 0.0f;
+	for( size_t b = 0; b < boneWeights.mActiveNbWeights; ++b ) {
+		sum += boneWeights.getWeight( b );
+	}
+	if( sum <= 0.0f )
+		return;
+
+	// Largest remainder rounding
+	float remainders[n] = { 0.0f };
+	int total = 0;
+	for( size_t b = 0; b < boneWeights.mActiveNbWeights; ++b ) {
+		float scaled = 255.0f * boneWeights.getWeight( b ) / sum;
+		weights[b] = uint8_t( std::floor( scaled ) );
+		remainders[b] = scaled - weights[b];
+		total += weights[b];
+	}
+	for( ; total < 255; ++total ) {
+		int largest = int( std::max_element( remainders, remainders + boneWeights.mActiveNbWeights ) - remainders );
+		++weights[largest];
+		remainders[largest] = -1.0f;
+	}
+}
+
+VertexQuantization computeQuantization( const std::vector<ci::Vec3f>& positions, const std::vector<ci::Vec2f>& texCoords )
+{
+	VertexQuantization quantization;
+	if( ! positions.empty() ) {
+		ci::Vec3f lo = positions.front(), hi = positions.front();
+		for( const ci::Vec3f& p : positions ) {
+			lo = ci::Vec3f( std::min( lo.x, p.x ), std::min( lo.y, p.y ), std::min( lo.z, p.z ) );
+			hi = ci::Vec3f( std::max( hi.x, p.x ), std::max( hi.y, p.y ), std::max( hi.z, p.z ) );
+		}
+		// Snorm positions: the offset is the center and the scale the half extent.
+		quantization.mPositionOffset = 0.5f * ( lo + hi );
+		ci::Vec3f half = 0.5f * ( hi - lo );
+		quantization.mPositionScale = ci::Vec3f( half.x > 0.0f ? half.x : 1.0f, half.y > 0.0f ? half.y : 1.0f, half.z > 0.0f ? half.z : 1.0f );
+	}
+	if( ! texCoords.empty() ) {
+		ci::Vec2f lo = texCoords.front(), hi = texCoords.front();
+		for( const ci::Vec2f& t : texCoords ) {
+			lo = ci::Vec2f( std::min( lo.x, t.x ), std::min( lo.y, t.y ) );
+			hi = ci::Vec2f( std::max( hi.x, t.x ), std::max( hi.y, t.y ) );
+		}
+		// Unorm texture coordinates: the offset is the minimum and the scale the extent.
+		quantization.mTexCoordOffset = lo;
+		ci::Vec2f extent = hi - lo;
+		quantization.mTexCoordScale = ci::Vec2f( extent.x > 0.0f ? extent.x : 1.0f, extent.y > 0.0f ? extent.y : 1.0f );
+	}
+	return quantization;
+}
+
+std::vector<PackedVertex> packVertices( const VertexQuantization& quantization, const std::vector<ci::Vec3f>& positions, const std::vector<ci::Vec3f>& normals,
+									    const std::vector<ci::Vec2f>& texCoords, const std::vector<BoneWeights>& boneWeights,
+									    const std::vector<PaletteIndices>& paletteIndices )
+{
+	std::vector<PackedVertex> vertices( positions.size() );
+	for( size_t i = 0; i < positions.size(); ++i ) {
+		PackedVertex& v = vertices[i];
+		std::memset( &v, 0, sizeof( PackedVertex ) );
+
+		ci::Vec3f p = positions[i] - quantization.mPositionOffset;
+		v.mPosition[0] = packSnorm16( p.x / quantization.mPositionScale.x );
+		v.mPosition[1] = packSnorm16( p.y / quantization.mPositionScale.y );
+		v.mPosition[2] = packSnorm16( p.z / quantization.mPositionScale.z );
+
+		if( i < normals.size() ) {
+			ci::Vec2f e = encodeOctahedral( normals[i] );
+			v.mNormal[0] = packSnorm16( e.x );
+			v.mNormal[1] = packSnorm16( e.y );
+		}
+		if( i < texCoords.size() ) {
+			ci::Vec2f t = texCoords[i] - quantization.mTexCoordOffset;
+			v.mTexCoord[0] = packUnorm16( t.x / quantization.mTexCoordScale.x );
+			v.mTexCoord[1] = packUnorm16( t.y / quantization.mTexCoordScale.y );
+		}
+		if( i < boneWeights.size() ) {
+			packBoneWeights( boneWeights[i], v.mBoneWeights );
+			std::copy( paletteIndices[i].begin(), paletteIndices[i].end(), v.mBoneIndices );
+		}
+	}
+	return vertices;
+}
+
+} //end namespace model